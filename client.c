@@ -8,23 +8,37 @@
 //
 
 // Include Files
+#include <sys/uio.h>
+#include <pthread.h>
 
 // Project Include Files
 #include <crud_network.h>
+#include <crud_driver_ext.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 
+// Defines
+#define CRUD_CLIENT_MAX_IOVECS 1024 // Largest gather/scatter list handed to a single writev/readv
+#define CRUD_CLIENT_MAX_CONNECTIONS 8 // Most connections open to the server at once
+
+// Type for one connection to the CRUD server
+typedef struct {
+	int     socket_fd; // Socket of the connection
+	uint8_t connected; // Nonzero once the socket has connected to the server
+	uint8_t busy;      // Nonzero while a request is using the connection
+} CrudConnectionType;
+
 // Global variables
 int            crud_network_shutdown = 0; // Flag indicating shutdown
 unsigned char *crud_network_address = NULL; // Address of CRUD server 
 unsigned short crud_network_port = 0; // Port of CRUD server
 
-// Global flag to determine if the client has connected to the server
-uint8_t CONNECTED = 0;
-int socket_fd;
-struct sockaddr_in caddr;
+// The pool of connections to the server, one request in flight on each at a time
+static CrudConnectionType crud_connections[CRUD_CLIENT_MAX_CONNECTIONS];
+static pthread_mutex_t crud_client_lock = PTHREAD_MUTEX_INITIALIZER; // Guards the busy and connected flags
+static pthread_cond_t crud_client_idle = PTHREAD_COND_INITIALIZER; // Signalled when a connection is released
 	
 
 //
@@ -32,75 +46,188 @@ struct sockaddr_in caddr;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_client_operation
-// Description  : This the client operation that sends a request to the CRUD
-//                server.   It will:
+// Function     : send_vector
+// Description  : Writes every byte described by a gather list to the server,
+//                resuming after partial writes without copying the data
+//
+// Inputs       : socket_fd - the socket to write to
+//                iov - the gather list (modified as bytes are sent)
+//                iovcnt - the number of entries in the gather list
+// Outputs      : 0 if successful, -1 if failure
+
+static int send_vector(int socket_fd, struct iovec *iov, int iovcnt) {
+
+	ssize_t bytesWritten;
+
+	while( iovcnt > 0 ) {
+
+		// Skip over entries that have been completely sent
+		if( iov->iov_len == 0 ) {
+			iov++;
+			iovcnt--;
+			continue;
+		}
+
+		bytesWritten = writev( socket_fd, iov, (iovcnt > CRUD_CLIENT_MAX_IOVECS) ? CRUD_CLIENT_MAX_IOVECS : iovcnt );
+		if( bytesWritten <= 0 )
+			return -1; // ERROR - connection failed while writing
+
+		// Advance the gather list past the bytes that were written
+		while( bytesWritten > 0 ) {
+			if( (size_t)bytesWritten >= iov->iov_len ) {
+				bytesWritten -= iov->iov_len;
+				iov->iov_len = 0;
+				iov++;
+				iovcnt--;
+			} else {
+				iov->iov_base = (char *)iov->iov_base + bytesWritten;
+				iov->iov_len -= bytesWritten;
+				bytesWritten = 0;
+			}
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
 //
-//                1) if INIT make a connection to the server
-//                2) send any request to the server, returning results
-//                3) if CLOSE, will close the connection
+// Function     : recv_vector
+// Description  : Reads "length" bytes from the server directly into a
+//                scatter list, resuming after partial reads
 //
-// Inputs       : op - the request opcode for the command
-//                buf - the block to be read/written from (READ/WRITE)
+// Inputs       : socket_fd - the socket to read from
+//                iov - the scatter list (modified as bytes are received)
+//                iovcnt - the number of entries in the scatter list
+//                length - the number of bytes to receive
+// Outputs      : 0 if successful, -1 if failure
+
+static int recv_vector(int socket_fd, struct iovec *iov, int iovcnt, uint32_t length) {
+
+	ssize_t bytesRead;
+	int cnt;
+	size_t room, excess;
+
+	while( length > 0 ) {
+
+		// Skip over entries that have been completely filled
+		while( iovcnt > 0 && iov->iov_len == 0 ) {
+			iov++;
+			iovcnt--;
+		}
+		if( iovcnt == 0 )
+			return -1; // ERROR - the server sent more data than the scatter list can hold
+
+		// Trim the scatter list so that no more than "length" bytes are requested
+		room = 0;
+		for( cnt=0; cnt<iovcnt && cnt<CRUD_CLIENT_MAX_IOVECS && room < length; cnt++ )
+			room += iov[cnt].iov_len;
+		excess = (room > length) ? room - length : 0;
+
+		iov[cnt-1].iov_len -= excess;
+		bytesRead = readv( socket_fd, iov, cnt );
+		iov[cnt-1].iov_len += excess;
+
+		if( bytesRead <= 0 )
+			return -1; // ERROR - connection failed while reading
+		length -= bytesRead;
+
+		// Advance the scatter list past the bytes that were read
+		while( bytesRead > 0 ) {
+			if( (size_t)bytesRead >= iov->iov_len ) {
+				bytesRead -= iov->iov_len;
+				iov->iov_len = 0;
+				iov++;
+				iovcnt--;
+			} else {
+				iov->iov_base = (char *)iov->iov_base + bytesRead;
+				iov->iov_len -= bytesRead;
+				bytesRead = 0;
+			}
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_operation
+// Description  : This the vectored client operation that sends a request to
+//                the CRUD server over a connection the caller has reserved.
+//                It will:
+//
+//                1) if not yet connected make a connection to the server
+//                2) send any request to the server, gathering the CREATE,
+//                   UPDATE, COPY or CONCAT payload from "iov" in the same
+//                   call as the opcode
+//                3) scatter the payload of a READ or LIST response into "iov"
+//
+// Inputs       : conn - the reserved connection
+//                op - the request opcode for the command
+//                iov - the buffers to be read/written from (READ/WRITE)
+//                iovcnt - the number of buffers in iov
 // Outputs      : the response structure encoded as needed
 
-CrudResponse crud_client_operation(CrudRequest op, void *buf) {
+static CrudResponse client_operation(CrudConnectionType *conn, CrudRequest op, const struct iovec *iov, int iovcnt) {
 
 	uint8_t request; // Request type found from the opcode
 	uint32_t length; // Length of the parameter buffer found from the opcode
-	int bytesRead=0, bytesWritten=0; // Number of bytes read/written after calls to read/write
-	char *tempBuf = NULL;
+	struct iovec vec[CRUD_CLIENT_MAX_IOVECS+1]; // Working copy of the opcode and caller's buffers
+	struct sockaddr_in caddr;
+	CrudRequest netOp;
 
-	// If the server hasn't been connected to yet, connect to the server
-	if( !CONNECTED ) {
+	if( iovcnt < 0 || iovcnt > CRUD_CLIENT_MAX_IOVECS || (iovcnt > 0 && iov == NULL) )
+		return(-1); // ERROR - invalid buffer list
+
+	// If this connection hasn't connected to the server yet, connect to the server
+	if( !conn->connected ) {
 		
 		// Set up address information
+		memset(&caddr, 0, sizeof(caddr));
 		caddr.sin_family = AF_INET;
 		caddr.sin_port = htons(CRUD_DEFAULT_PORT);
 		if( inet_aton( CRUD_DEFAULT_IP, &caddr.sin_addr) == 0 ) {
 			return(-1);
 		}
 
-		socket_fd = socket(PF_INET,SOCK_STREAM,0);
+		conn->socket_fd = socket(PF_INET,SOCK_STREAM,0);
 		
-		if( socket_fd == -1 ) {
+		if( conn->socket_fd == -1 ) {
 			printf("Error on socket creation: %s \n", strerror(errno) );
 			return(-1);
 		}
 
-		if( connect(socket_fd, (const struct sockaddr *)&caddr, sizeof(struct sockaddr)) == -1 ) {
+		if( connect(conn->socket_fd, (const struct sockaddr *)&caddr, sizeof(struct sockaddr)) == -1 ) {
+			close(conn->socket_fd);
 			return(-1);
 		}
 		
-		CONNECTED = 1; // Set flag to true once connected to server
+		conn->connected = 1; // Set flag to true once connected to server
 	}
 
 	request = (op << 32) >> 60; // Extract the request type from the opcode
-	length = (op << 36) >> 40; // Extract the length of the parameter buffer from the opcode
-	op = htonll64(op); // Convert opcode to network byte order
+	netOp = htonll64(op); // Convert opcode to network byte order
 
-	// Send the opcode to the server
-	if( write( socket_fd, &op, sizeof(op)) != sizeof(op) ) {
+	// Send the opcode, followed by the buffers if the request carries a payload, in one gather list
+	vec[0].iov_base = &netOp;
+	vec[0].iov_len = sizeof(netOp);
+	if( request == CRUD_CREATE || request == CRUD_UPDATE || request == CRUD_COPY || request == CRUD_CONCAT ) {
+		memcpy(&vec[1], iov, iovcnt*sizeof(struct iovec));
+		if( send_vector(conn->socket_fd, vec, iovcnt+1) ) {
+			printf("Error writing network data: %s \n", strerror(errno) );
+			return(-1);
+		}
+	} else if( send_vector(conn->socket_fd, vec, 1) ) {
 		// Print error if entire opcode was not written
 		printf("Error writing network data (opcode): %s \n", strerror(errno) );
 		return(-1);
 	}
-
-	// If the request is CREATE or UPDATE, send the buffer to the server in addition to the already sent opcode
-	if( request == CRUD_CREATE || request == CRUD_UPDATE ) {
-		
-		tempBuf = malloc(length); // Allocate enough memory for tempBuf to hold what needs to be written
-		memcpy(tempBuf,buf,length); // Copy what needs to be written into the temporary buffer
-
-		// Continue writing bytes to the server until all bytes have been written
-		while( bytesWritten != length ) {
-
-			bytesWritten = bytesWritten + write( socket_fd, &tempBuf[bytesWritten], length-bytesWritten);
-		}
-	}
 	
 	// Receive the opcode from the server
-	if( read( socket_fd, &op, sizeof(op)) != sizeof(op) ) {
+	vec[0].iov_base = &op;
+	vec[0].iov_len = sizeof(op);
+	if( recv_vector(conn->socket_fd, vec, 1, sizeof(op)) ) {
 		// Print error if the entire opcode was not read
 		printf( "Error reading network data: %s \n", strerror(errno) );
 		return(-1);
@@ -110,31 +237,97 @@ CrudResponse crud_client_operation(CrudRequest op, void *buf) {
 	request = (op << 32) >> 60; // Extract request type from the opcode
 	length = (op << 36) >> 40; // Extract the length of the parameter buffer from the opcode
 
-	// If the request is READ, receive buffer data from the server in addition to the already read opcode
-	if( request == CRUD_READ ) {
-		
-		tempBuf = malloc(length); // Allocate enough memory for tempBuf to hold what needs to be read
-		// memcpy(tempBuf,buf,length);
+	// If the request is READ or LIST, receive buffer data from the server directly into the buffers
+	if( (request == CRUD_READ || request == CRUD_LIST) && length > 0 ) {
+		memcpy(vec, iov, iovcnt*sizeof(struct iovec));
+		if( recv_vector(conn->socket_fd, vec, iovcnt, length) ) {
+			printf( "Error reading network data: %s \n", strerror(errno) );
+			return(-1);
+		}
+	}
 
-		while( bytesRead != length ) {
-		
-			bytesRead = bytesRead + read( socket_fd, &tempBuf[bytesRead], length-bytesRead );
+	return op;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_operation_v
+// Description  : Sends a request to the CRUD server with its payload in a
+//                list of buffers.  Each request runs on its own connection
+//                from the pool, so requests from different threads proceed
+//                in parallel.  A CLOSE closes every connection.
+//
+// Inputs       : op - the request opcode for the command
+//                iov - the buffers to be read/written from (READ/WRITE)
+//                iovcnt - the number of buffers in iov
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_client_operation_v(CrudRequest op, const struct iovec *iov, int iovcnt) {
+
+	int i;
+	CrudConnectionType *conn = NULL;
+	CrudResponse response;
+
+	// Reserve a connection, preferring one that is already connected
+	pthread_mutex_lock(&crud_client_lock);
+	while( conn == NULL ) {
+		for( i=0; i<CRUD_CLIENT_MAX_CONNECTIONS; i++ ) {
+			if( !crud_connections[i].busy && (conn == NULL || crud_connections[i].connected) ) {
+				conn = &crud_connections[i];
+				if( conn->connected )
+					break;
+			}
 		}
-		memcpy(buf,tempBuf,length);
+		if( conn == NULL )
+			pthread_cond_wait(&crud_client_idle, &crud_client_lock);
 	}
-	
-	// If the request is CLOSE, close the connection between client and server
-	if( request == CRUD_CLOSE ) {
-		close(socket_fd);
-		socket_fd = -1;
-		CONNECTED = 0;
+	conn->busy = 1;
+	pthread_mutex_unlock(&crud_client_lock);
+
+	response = client_operation(conn, op, iov, iovcnt);
+
+	pthread_mutex_lock(&crud_client_lock);
+
+	// A connection that failed mid-request can no longer be trusted to be in step with the server
+	if( response == (CrudResponse)-1 && conn->connected ) {
+		close(conn->socket_fd);
+		conn->connected = 0;
 	}
+	conn->busy = 0;
 
-	// If the temporary buffer was used, free the memory it allocated
-	if(tempBuf) {
-		free(tempBuf);
-		tempBuf = NULL;	
+	// If the request is CLOSE, close the connections between client and server
+	if( response != (CrudResponse)-1 && ((op << 32) >> 60) == CRUD_CLOSE ) {
+		for( i=0; i<CRUD_CLIENT_MAX_CONNECTIONS; i++ ) {
+			if( !crud_connections[i].busy && crud_connections[i].connected ) {
+				close(crud_connections[i].socket_fd);
+				crud_connections[i].connected = 0;
+			}
+		}
 	}
 
-	return op;
+	pthread_cond_broadcast(&crud_client_idle);
+	pthread_mutex_unlock(&crud_client_lock);
+
+	return response;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_client_operation
+// Description  : This the client operation that sends a request to the CRUD
+//                server using a single buffer, see crud_client_operation_v
+//
+// Inputs       : op - the request opcode for the command
+//                buf - the block to be read/written from (READ/WRITE)
+// Outputs      : the response structure encoded as needed
+
+CrudResponse crud_client_operation(CrudRequest op, void *buf) {
+
+	struct iovec iov;
+
+	// The length field of the opcode is the size of the buffer for every request that uses one
+	iov.iov_base = buf;
+	iov.iov_len = (op << 36) >> 40;
+
+	return crud_client_operation_v(op, &iov, (buf == NULL) ? 0 : 1);
 }
@@ -0,0 +1,146 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_bench_alloc.c
+//  Description    : This is a count of the heap allocations made by the file IO
+//                   functions once they are warmed up.  It replaces malloc,
+//                   calloc, realloc and posix_memalign with wrappers that count
+//                   their calls before handing them to glibc, runs a steady
+//                   loop of crud_write and crud_read for several sizes, and
+//                   reports the allocations made while warming up and then
+//                   per call.  Build it with glibc and file_io.c, client.c,
+//                   crud_lz.c and crud_sha256.c and run it against a CRUD
+//                   server.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Project Includes
+#include <crud_file_io_ext.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define BENCH_WARMUP 100 // Writes and reads before counting starts
+#define BENCH_OPERATIONS 1000 // Writes and reads counted for each size
+#define BENCH_MAX_IO_SIZE (256*1024) // Largest write and read
+
+// glibc's allocator, which the wrappers below pass every call on to
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+// Allocations made since the count was last reset
+static unsigned long bench_allocations;
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : malloc, calloc, realloc, posix_memalign
+// Description  : Count the call and allocate with glibc
+//
+// Inputs       : as for the C library
+// Outputs      : as for the C library
+
+void *malloc(size_t size) {
+
+	__atomic_add_fetch(&bench_allocations, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+
+	__atomic_add_fetch(&bench_allocations, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+
+	__atomic_add_fetch(&bench_allocations, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+
+	__atomic_add_fetch(&bench_allocations, 1, __ATOMIC_RELAXED);
+	return (*ptr = __libc_memalign(alignment, size)) == NULL ? 12 : 0; // ENOMEM
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_loop
+// Description  : Rewrites the start of a file and reads it back "count" times
+//
+// Inputs       : fd - the file
+//                buf - the bytes to write and room to read them into
+//                size - the bytes in each write and read
+//                count - the number of writes and reads
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_loop(int16_t fd, char *buf, int32_t size, int count) {
+
+	int i;
+
+	for( i=0; i<count; i++ ) {
+		if( crud_seek(fd, 0) || crud_write(fd, buf, size) != size ||
+				crud_seek(fd, 0) || crud_read(fd, buf, size) != size )
+			return -1; // ERROR - the operation failed
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : Counts the allocations of each size of write and read
+//
+// Inputs       : None
+// Outputs      : 0 if successful, 1 if failure
+
+int main(void) {
+
+	int32_t sizes[] = { 64, 4096, 65536, BENCH_MAX_IO_SIZE };
+	unsigned long warmup, counted;
+	char *buf;
+	int16_t fd;
+	int i;
+
+	if( crud_format() || crud_mount() || (fd = crud_open("bench/alloc")) == -1 ) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on format, mount or open operation.");
+		return 1;
+	}
+	if( (buf = malloc(BENCH_MAX_IO_SIZE)) == NULL )
+		return 1;
+	memset(buf, 'x', BENCH_MAX_IO_SIZE);
+
+	printf("%8s %8s %10s %14s %16s\n", "bytes", "warmup", "calls", "allocations", "per write+read");
+	for( i=0; i<(int)(sizeof(sizes)/sizeof(sizes[0])); i++ ) {
+		__atomic_store_n(&bench_allocations, 0, __ATOMIC_RELAXED);
+		if( bench_loop(fd, buf, sizes[i], BENCH_WARMUP) ) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure warming up %d byte operations.", sizes[i]);
+			return 1;
+		}
+		warmup = __atomic_exchange_n(&bench_allocations, 0, __ATOMIC_RELAXED);
+		if( bench_loop(fd, buf, sizes[i], BENCH_OPERATIONS) ) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on %d byte operations.", sizes[i]);
+			return 1;
+		}
+		counted = __atomic_load_n(&bench_allocations, __ATOMIC_RELAXED);
+		printf("%8d %8lu %10d %14lu %16.3f\n", sizes[i], warmup, BENCH_OPERATIONS, counted, (double)counted / BENCH_OPERATIONS);
+	}
+
+	free(buf);
+	if( crud_close(fd) || crud_unmount() ) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on unmount operation.");
+		return 1;
+	}
+
+	return 0;
+}
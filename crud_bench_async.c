@@ -0,0 +1,210 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_bench_async.c
+//  Description    : This is a benchmark of the asynchronous file IO functions.
+//                   Thousands of crud_write_async and then crud_read_async
+//                   calls are submitted at once over a set of files, and the
+//                   completions per second and the latency from submission to
+//                   callback are reported next to the same operations made
+//                   one at a time with crud_write and crud_read.  Build it
+//                   with file_io.c, client.c, crud_lz.c and crud_sha256.c and
+//                   run it against a CRUD server.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Project Includes
+#include <crud_file_io_ext.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define BENCH_FILES 64 // Files the operations are spread over
+#define BENCH_MAX_OUTSTANDING 4096 // Most operations submitted at once
+#define BENCH_IO_SIZE 4096 // Bytes in each write and read
+
+// Type for one operation of a run
+typedef struct {
+	CrudCompletion *completion; // Its completion
+	double          submitted;  // When it was submitted, in nanoseconds
+	double          latency;    // Nanoseconds from submission to its callback
+	char            buf[BENCH_IO_SIZE]; // The bytes written or read
+} BenchOperationType;
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : now_ns
+// Description  : Reads the monotonic clock
+//
+// Inputs       : None
+// Outputs      : the time in nanoseconds
+
+static double now_ns(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1e9 + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_completed
+// Description  : Records the latency of an operation, called on a worker
+//
+// Inputs       : completion - the completion of the operation
+//                result - the result of the operation
+//                arg - the BenchOperationType of the operation
+// Outputs      : none
+
+static void bench_completed(CrudCompletion *completion, int32_t result, void *arg) {
+
+	BenchOperationType *operation = arg;
+
+	(void)completion;
+	(void)result;
+	operation->latency = now_ns() - operation->submitted;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_latency
+// Description  : Orders operations by latency for qsort
+//
+// Inputs       : a, b - the operations
+// Outputs      : <0, 0 or >0 as a is faster, as fast or slower than b
+
+static int compare_latency(const void *a, const void *b) {
+
+	const BenchOperationType *x = a, *y = b;
+
+	return (x->latency > y->latency) - (x->latency < y->latency);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_run
+// Description  : Submits "count" writes or reads at once, one file handle in
+//                turn for each, and waits for them all
+//
+// Inputs       : operations - the operations of the run
+//                count - the number of operations
+//                fds - the file handles
+//                write - nonzero to write, zero to read
+// Outputs      : the seconds until the last one finished, -1 if failure
+
+static double bench_run(BenchOperationType *operations, int count, int16_t *fds, int write) {
+
+	double start, elapsed;
+	int i, failed = 0;
+
+	for( i=0; i<BENCH_FILES; i++ )
+		crud_seek(fds[i], 0);
+
+	start = now_ns();
+	for( i=0; i<count; i++ ) {
+		operations[i].submitted = now_ns();
+		operations[i].completion = write ?
+			crud_write_async(fds[i%BENCH_FILES], operations[i].buf, BENCH_IO_SIZE, bench_completed, &operations[i]) :
+			crud_read_async(fds[i%BENCH_FILES], operations[i].buf, BENCH_IO_SIZE, bench_completed, &operations[i]);
+		if( operations[i].completion == NULL )
+			return -1; // ERROR - the operation could not be started
+	}
+	for( i=0; i<count; i++ ) {
+		if( crud_async_wait(operations[i].completion) != BENCH_IO_SIZE )
+			failed = 1;
+	}
+	elapsed = (now_ns() - start) / 1e9;
+
+	// Store what the writes left in write-back so the reads time only themselves
+	if( write && crud_syncfs() )
+		failed = 1;
+
+	return failed ? -1 : elapsed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : Runs the benchmark for each number of outstanding operations
+//
+// Inputs       : None
+// Outputs      : 0 if successful, 1 if failure
+
+int main(void) {
+
+	BenchOperationType *operations;
+	int16_t fds[BENCH_FILES];
+	char path[CRUD_MAX_PATH_LENGTH];
+	double start, elapsed;
+	int count, write, i;
+
+	if( crud_format() || crud_mount() ) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on format or mount operation.");
+		return 1;
+	}
+	if( (operations = calloc(BENCH_MAX_OUTSTANDING, sizeof(BenchOperationType))) == NULL )
+		return 1;
+	for( i=0; i<BENCH_FILES; i++ ) {
+		sprintf(path, "bench/a%02d", i);
+		if( (fds[i] = crud_open(path)) == -1 ) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure creating %s.", path);
+			return 1;
+		}
+	}
+	for( i=0; i<BENCH_MAX_OUTSTANDING; i++ )
+		memset(operations[i].buf, 'a' + (i%26), BENCH_IO_SIZE);
+
+	// The same operations one at a time, for comparison
+	for( write=1; write>=0; write-- ) {
+		for( i=0; i<BENCH_FILES; i++ )
+			crud_seek(fds[i], 0);
+		start = now_ns();
+		for( i=0; i<BENCH_MAX_OUTSTANDING; i++ ) {
+			if( (write ? crud_write(fds[i%BENCH_FILES], operations[i].buf, BENCH_IO_SIZE) :
+					crud_read(fds[i%BENCH_FILES], operations[i].buf, BENCH_IO_SIZE)) != BENCH_IO_SIZE ) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on blocking operation %d.", i);
+				return 1;
+			}
+		}
+		elapsed = (now_ns() - start) / 1e9;
+		if( write && crud_syncfs() ) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on syncfs operation.");
+			return 1;
+		}
+		printf("blocking %-5s %6d ops %10.0f ops/s %10.1f us/op\n", write ? "write" : "read",
+			BENCH_MAX_OUTSTANDING, BENCH_MAX_OUTSTANDING / elapsed, elapsed*1e6 / BENCH_MAX_OUTSTANDING);
+	}
+
+	printf("%-5s %11s %10s %10s %10s %10s\n", "op", "outstanding", "ops/s", "p50 us", "p99 us", "max us");
+	for( count=256; count<=BENCH_MAX_OUTSTANDING; count*=4 ) {
+		for( write=1; write>=0; write-- ) {
+			if( (elapsed = bench_run(operations, count, fds, write)) < 0 ) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on asynchronous %s.", write ? "write" : "read");
+				return 1;
+			}
+			qsort(operations, count, sizeof(BenchOperationType), compare_latency);
+			printf("%-5s %11d %10.0f %10.1f %10.1f %10.1f\n", write ? "write" : "read", count, count / elapsed,
+				operations[count/2].latency / 1e3, operations[count*99/100].latency / 1e3,
+				operations[count-1].latency / 1e3);
+		}
+	}
+
+	for( i=0; i<BENCH_FILES; i++ )
+		crud_close(fds[i]);
+	free(operations);
+	if( crud_unmount() ) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on unmount operation.");
+		return 1;
+	}
+
+	return 0;
+}
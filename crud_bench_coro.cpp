@@ -0,0 +1,114 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_bench_coro.cpp
+//  Description    : This is a benchmark of the coroutine interface against a
+//                   thread per request.  Each request opens its own file,
+//                   writes a block, reads it back and closes the file.  N
+//                   requests run as crud::Task coroutines spawned on one
+//                   Scheduler, then as N threads making the blocking calls,
+//                   and the requests per second of each are reported.  Build
+//                   it with -std=c++20 and file_io.c, client.c, crud_lz.c and
+//                   crud_sha256.c and run it against a CRUD server.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Project Includes
+#include <crud_file_io_coro.hpp>
+
+namespace {
+
+constexpr int BenchMaxRequests = 512; // Most requests in one run
+constexpr int BenchIoSize = 4096; // Bytes each request writes and reads
+
+// Path of the file of request "i"
+void bench_path(char (&path)[CRUD_MAX_PATH_LENGTH], int i) {
+	std::snprintf(path, sizeof(path), "bench/c%03d", i);
+}
+
+// One request as a coroutine, counts itself in "failed" if it goes wrong
+crud::Task<void> coro_request(crud::Scheduler &scheduler, int i, int &failed) {
+	char path[CRUD_MAX_PATH_LENGTH];
+	std::byte buf[BenchIoSize], got[BenchIoSize];
+
+	bench_path(path, i);
+	std::memset(buf, 'a' + i%26, sizeof(buf));
+	crud::AsyncFile file = co_await crud::AsyncFile::open(scheduler, path);
+	int32_t written = file.valid() ? co_await file.write(buf) : -1;
+	int32_t read = (written == BenchIoSize && file.seek(0) == 0) ? co_await file.read(got) : -1;
+	if( read != BenchIoSize || std::memcmp(buf, got, BenchIoSize) )
+		failed++;
+}
+
+// One request as blocking calls, counts itself in "failed" if it goes wrong
+void thread_request(int i, std::atomic<int> &failed) {
+	char path[CRUD_MAX_PATH_LENGTH], buf[BenchIoSize], got[BenchIoSize];
+	int16_t fd;
+
+	bench_path(path, i);
+	std::memset(buf, 'a' + i%26, sizeof(buf));
+	if( (fd = crud_open(path)) == -1 || crud_write(fd, buf, BenchIoSize) != BenchIoSize || crud_seek(fd, 0) ||
+			crud_read(fd, got, BenchIoSize) != BenchIoSize || std::memcmp(buf, got, BenchIoSize) )
+		failed++;
+	if( fd != -1 )
+		crud_close(fd);
+}
+
+// Seconds since "start"
+double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main() {
+	if( crud_format() || crud_mount() ) {
+		std::fprintf(stderr, "CRUD_BENCH : Failure on format or mount operation.\n");
+		return 1;
+	}
+
+	std::printf("%8s %16s %16s\n", "requests", "coroutines req/s", "threads req/s");
+	for( int requests=16; requests<=BenchMaxRequests; requests*=2 ) {
+
+		// Every request as a coroutine on the one thread running the scheduler
+		crud::Scheduler scheduler;
+		int coroFailed = 0;
+		auto start = std::chrono::steady_clock::now();
+		for( int i=0; i<requests; i++ )
+			scheduler.spawn(coro_request(scheduler, i, coroFailed));
+		scheduler.run();
+		double coroSeconds = seconds_since(start);
+
+		// Every request on a thread of its own
+		std::vector<std::thread> threads;
+		std::atomic<int> threadFailed{0};
+		start = std::chrono::steady_clock::now();
+		for( int i=0; i<requests; i++ )
+			threads.emplace_back(thread_request, i, std::ref(threadFailed));
+		for( std::thread &thread : threads )
+			thread.join();
+		double threadSeconds = seconds_since(start);
+
+		if( coroFailed || threadFailed ) {
+			std::fprintf(stderr, "CRUD_BENCH : %d coroutine and %d thread requests failed.\n", coroFailed, threadFailed.load());
+			return 1;
+		}
+		std::printf("%8d %16.0f %16.0f\n", requests, requests / coroSeconds, requests / threadSeconds);
+	}
+
+	if( crud_unmount() ) {
+		std::fprintf(stderr, "CRUD_BENCH : Failure on unmount operation.\n");
+		return 1;
+	}
+
+	return 0;
+}
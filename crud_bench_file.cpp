@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_bench_file.cpp
+//  Description    : This is a benchmark of the C++ interface against the C file
+//                   IO functions it wraps.  The same crud_pwrite and crud_pread
+//                   loop runs through CrudFile::pwrite and CrudFile::pread and
+//                   through the C functions directly, in alternating rounds so
+//                   both see the same server, and the best round of each is
+//                   reported for several block sizes.  A file short enough
+//                   to live in the file table is then read alone, which
+//                   makes no I/O and so shows what the wrapper itself costs.
+//                   Build it with
+//                   -std=c++20 and file_io.c, client.c, crud_lz.c and
+//                   crud_sha256.c and run it against a CRUD server.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Project Includes
+#include <crud_file_io.hpp>
+
+namespace {
+
+constexpr int BenchRounds = 7; // Rounds of each interface, the fastest is reported
+constexpr int BenchOperations = 2000; // Writes and reads in each round
+constexpr uint32_t BenchFileSize = 256*1024; // Bytes the blocks are spread over
+
+// Nanoseconds per write and read pair of one round through CrudFile
+double round_cpp(const crud::CrudFile &file, std::vector<std::byte> &buf, std::vector<std::byte> &got) {
+	auto start = std::chrono::steady_clock::now();
+	for( int i=0; i<BenchOperations; i++ ) {
+		uint32_t offset = (i*buf.size()) % BenchFileSize;
+		if( file.pwrite(buf, offset) != static_cast<int32_t>(buf.size()) ||
+				file.pread(got, offset) != static_cast<int32_t>(got.size()) )
+			return -1; // ERROR - the operation failed
+	}
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BenchOperations;
+}
+
+// Nanoseconds per write and read pair of one round through the C functions
+double round_c(int16_t fd, std::vector<std::byte> &buf, std::vector<std::byte> &got) {
+	auto start = std::chrono::steady_clock::now();
+	for( int i=0; i<BenchOperations; i++ ) {
+		uint32_t offset = (i*buf.size()) % BenchFileSize;
+		if( crud_pwrite(fd, buf.data(), static_cast<int32_t>(buf.size()), offset) != static_cast<int32_t>(buf.size()) ||
+				crud_pread(fd, got.data(), static_cast<int32_t>(got.size()), offset) != static_cast<int32_t>(got.size()) )
+			return -1; // ERROR - the operation failed
+	}
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BenchOperations;
+}
+
+// Nanoseconds per read of one round through CrudFile
+double read_cpp(const crud::CrudFile &file, std::vector<std::byte> &got) {
+	auto start = std::chrono::steady_clock::now();
+	for( int i=0; i<BenchOperations; i++ ) {
+		if( file.pread(got, 0) != static_cast<int32_t>(got.size()) )
+			return -1; // ERROR - the operation failed
+	}
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BenchOperations;
+}
+
+// Nanoseconds per read of one round through the C functions
+double read_c(int16_t fd, std::vector<std::byte> &got) {
+	auto start = std::chrono::steady_clock::now();
+	for( int i=0; i<BenchOperations; i++ ) {
+		if( crud_pread(fd, got.data(), static_cast<int32_t>(got.size()), 0) != static_cast<int32_t>(got.size()) )
+			return -1; // ERROR - the operation failed
+	}
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BenchOperations;
+}
+
+} // namespace
+
+int main() {
+	crud::CrudFilesystem filesystem(crud::CrudFilesystem::Mount::format);
+	if( !filesystem ) {
+		std::fprintf(stderr, "CRUD_BENCH : Failure on format or mount operation.\n");
+		return 1;
+	}
+	crud::CrudFile file = filesystem.open("bench/file");
+	std::vector<std::byte> fill(BenchFileSize);
+	if( !file || file.write(fill) != static_cast<int32_t>(BenchFileSize) ) {
+		std::fprintf(stderr, "CRUD_BENCH : Failure creating bench/file.\n");
+		return 1;
+	}
+
+	std::printf("%8s %14s %14s %10s\n", "bytes", "CrudFile ns", "C ns", "C++/C");
+	for( std::size_t size : { 64, 4096, 65536 } ) {
+		std::vector<std::byte> buf(size, std::byte{'x'}), got(size);
+		double cpp = 1e18, c = 1e18;
+		for( int round=0; round<BenchRounds; round++ ) {
+			double cppRound = round_cpp(file, buf, got);
+			double cRound = round_c(file.handle(), buf, got);
+			if( cppRound < 0 || cRound < 0 ) {
+				std::fprintf(stderr, "CRUD_BENCH : Failure on %zu byte operation.\n", size);
+				return 1;
+			}
+			cpp = std::min(cpp, cppRound);
+			c = std::min(c, cRound);
+		}
+		std::printf("%8zu %14.0f %14.0f %10.3f\n", size, cpp, c, cpp / c);
+	}
+
+	// A file of CRUD_INLINE_MAX bytes is read from the file table, without going to the server
+	crud::CrudFile tiny = filesystem.open("bench/inline");
+	std::vector<std::byte> bytes(CRUD_INLINE_MAX, std::byte{'x'}), got(CRUD_INLINE_MAX);
+	if( !tiny || tiny.write(bytes) != CRUD_INLINE_MAX ) {
+		std::fprintf(stderr, "CRUD_BENCH : Failure creating bench/inline.\n");
+		return 1;
+	}
+	double cpp = 1e18, c = 1e18;
+	for( int round=0; round<BenchRounds; round++ ) {
+		double cppRound = read_cpp(tiny, got);
+		double cRound = read_c(tiny.handle(), got);
+		if( cppRound < 0 || cRound < 0 ) {
+			std::fprintf(stderr, "CRUD_BENCH : Failure reading bench/inline.\n");
+			return 1;
+		}
+		cpp = std::min(cpp, cppRound);
+		c = std::min(c, cRound);
+	}
+	std::printf("%8s %14.1f %14.1f %10.3f\n", "inline", cpp, c, cpp / c);
+
+	if( tiny.close() || file.close() || filesystem.unmount() ) {
+		std::fprintf(stderr, "CRUD_BENCH : Failure on unmount operation.\n");
+		return 1;
+	}
+
+	return 0;
+}
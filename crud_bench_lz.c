@@ -0,0 +1,255 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_bench_lz.c
+//  Description    : This is a benchmark of the LZ codec and of the files stored
+//                   with it.  A text corpus of log lines and the same number of
+//                   random bytes are each compressed and expanded a stripe at a
+//                   time with crud_lz, and then written to and read from a file
+//                   with CRUD_CODEC_NONE and with CRUD_CODEC_LZ.  The ratio and
+//                   the megabytes per second of each are reported.  Build it
+//                   with file_io.c, client.c, crud_lz.c and crud_sha256.c and
+//                   run it against a CRUD server.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Project Includes
+#include <crud_file_io_ext.h>
+#include <crud_lz.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define BENCH_CORPUS_SIZE (1024*1024) // Bytes of each corpus, the largest file
+#define BENCH_BLOCK_SIZE (128*1024) // Bytes compressed at once, a stripe of a file
+#define BENCH_CODEC_ROUNDS 20 // Passes over the corpus when timing the codec
+#define BENCH_FILE_ROUNDS 5 // Writes and reads of the file when timing file IO
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : now_ns
+// Description  : Reads the monotonic clock
+//
+// Inputs       : None
+// Outputs      : the time in nanoseconds
+
+static double now_ns(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1e9 + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : make_text
+// Description  : Fills a buffer with service log lines, the same every run
+//
+// Inputs       : buf - the buffer
+//                size - the bytes to fill
+// Outputs      : none
+
+static void make_text(char *buf, int32_t size) {
+
+	const char *levels[] = { "INFO", "INFO", "INFO", "WARN", "DEBUG" };
+	const char *paths[] = { "/api/v1/users", "/api/v1/orders", "/health", "/api/v1/items/search", "/static/app.js" };
+	char line[256];
+	uint32_t seed = 12345;
+	int32_t at = 0, length;
+	int i;
+
+	for( i=0; at<size; i++ ) {
+		seed = seed*1103515245 + 12345;
+		length = snprintf(line, sizeof(line),
+			"2014-10-20 12:%02d:%02d.%03d %-5s [worker-%d] request id=%08x path=%s status=%d bytes=%u ms=%u\n",
+			(i/600)%60, (i/10)%60, (seed>>8)%1000, levels[(seed>>12)%5], (seed>>16)%8, seed,
+			paths[(seed>>20)%5], ((seed>>24)%16) ? 200 : 404, (seed>>4)%65536, (seed>>18)%250);
+		if( length > size - at )
+			length = size - at;
+		memcpy(&buf[at], line, length);
+		at += length;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : make_random
+// Description  : Fills a buffer with bytes that do not compress
+//
+// Inputs       : buf - the buffer
+//                size - the bytes to fill
+// Outputs      : none
+
+static void make_random(char *buf, int32_t size) {
+
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+	int32_t i;
+
+	for( i=0; i<size; i++ ) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		buf[i] = (char)state;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_codec
+// Description  : Compresses and expands a corpus a block at a time, as the
+//                driver does a stripe, and reports the ratio and speeds
+//
+// Inputs       : name - the corpus' name
+//                corpus - the bytes
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_codec(const char *name, char *corpus) {
+
+	char *packed, *raw;
+	int32_t lengths[BENCH_CORPUS_SIZE/BENCH_BLOCK_SIZE], stored = 0, at;
+	double start, compressNs, expandNs = 0;
+	int round, block, kept = 0;
+
+	packed = malloc(BENCH_CORPUS_SIZE);
+	raw = malloc(BENCH_BLOCK_SIZE);
+
+	// Blocks that would not get smaller are stored as they are, as the driver does
+	start = now_ns();
+	for( round=0; round<BENCH_CODEC_ROUNDS; round++ ) {
+		for( block=0; block<BENCH_CORPUS_SIZE/BENCH_BLOCK_SIZE; block++ ) {
+			at = block*BENCH_BLOCK_SIZE;
+			lengths[block] = crud_lz_compress(&corpus[at], BENCH_BLOCK_SIZE, &packed[at], BENCH_BLOCK_SIZE - 1);
+		}
+	}
+	compressNs = now_ns() - start;
+
+	for( block=0; block<BENCH_CORPUS_SIZE/BENCH_BLOCK_SIZE; block++ ) {
+		if( lengths[block] < 0 ) {
+			stored += BENCH_BLOCK_SIZE;
+			continue;
+		}
+		kept++;
+		stored += lengths[block];
+		start = now_ns();
+		for( round=0; round<BENCH_CODEC_ROUNDS; round++ ) {
+			if( crud_lz_decompress(&packed[block*BENCH_BLOCK_SIZE], lengths[block], raw, BENCH_BLOCK_SIZE) != BENCH_BLOCK_SIZE ||
+					memcmp(raw, &corpus[block*BENCH_BLOCK_SIZE], BENCH_BLOCK_SIZE) ) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : block %d of %s does not expand to itself.", block, name);
+				free(packed);
+				free(raw);
+				return -1;
+			}
+		}
+		expandNs += now_ns() - start;
+	}
+
+	printf("%-7s %7.2fx %5d/%-3d %12.0f", name, (double)BENCH_CORPUS_SIZE / stored, kept,
+		BENCH_CORPUS_SIZE/BENCH_BLOCK_SIZE, BENCH_CODEC_ROUNDS * (BENCH_CORPUS_SIZE/1e6) / (compressNs/1e9));
+	if( kept > 0 )
+		printf(" %12.0f\n", BENCH_CODEC_ROUNDS * kept * (BENCH_BLOCK_SIZE/1e6) / (expandNs/1e9));
+	else
+		printf(" %12s\n", "-");
+
+	free(packed);
+	free(raw);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_file
+// Description  : Writes a corpus to a file stored with "codec", makes it
+//                durable and reads it back, and reports the speeds
+//
+// Inputs       : name - the corpus' name
+//                corpus - the bytes
+//                codec - the CRUD_CODEC_* to store the file with
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_file(const char *name, char *corpus, uint8_t codec) {
+
+	char path[CRUD_MAX_PATH_LENGTH], *got;
+	double start, writeNs = 0, readNs = 0;
+	int16_t fd;
+	int round;
+
+	sprintf(path, "bench/%s%d", name, codec);
+	got = malloc(BENCH_CORPUS_SIZE);
+	if( (fd = crud_open(path)) == -1 || crud_set_codec(fd, codec) ) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure creating %s.", path);
+		free(got);
+		return -1;
+	}
+
+	for( round=0; round<BENCH_FILE_ROUNDS; round++ ) {
+		start = now_ns();
+		if( crud_pwrite(fd, corpus, BENCH_CORPUS_SIZE, 0) != BENCH_CORPUS_SIZE || crud_fsync(fd) ) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure writing %s.", path);
+			free(got);
+			return -1;
+		}
+		writeNs += now_ns() - start;
+
+		start = now_ns();
+		if( crud_pread(fd, got, BENCH_CORPUS_SIZE, 0) != BENCH_CORPUS_SIZE || memcmp(got, corpus, BENCH_CORPUS_SIZE) ) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure reading back %s.", path);
+			free(got);
+			return -1;
+		}
+		readNs += now_ns() - start;
+	}
+
+	printf("%-7s %-8s %12.0f %12.0f\n", name, codec == CRUD_CODEC_LZ ? "lz" : "none",
+		BENCH_FILE_ROUNDS * (BENCH_CORPUS_SIZE/1e6) / (writeNs/1e9), BENCH_FILE_ROUNDS * (BENCH_CORPUS_SIZE/1e6) / (readNs/1e9));
+
+	free(got);
+	return crud_close(fd) ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : Runs the codec and file benchmarks on both corpora
+//
+// Inputs       : None
+// Outputs      : 0 if successful, 1 if failure
+
+int main(void) {
+
+	char *text, *random;
+
+	text = malloc(BENCH_CORPUS_SIZE);
+	random = malloc(BENCH_CORPUS_SIZE);
+	make_text(text, BENCH_CORPUS_SIZE);
+	make_random(random, BENCH_CORPUS_SIZE);
+
+	printf("%-7s %8s %9s %12s %12s\n", "corpus", "ratio", "blocks", "pack MB/s", "expand MB/s");
+	if( bench_codec("text", text) || bench_codec("random", random) )
+		return 1;
+
+	if( crud_format() || crud_mount() ) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on format or mount operation.");
+		return 1;
+	}
+	printf("\n%-7s %-8s %12s %12s\n", "corpus", "codec", "write MB/s", "read MB/s");
+	if( bench_file("text", text, CRUD_CODEC_NONE) || bench_file("text", text, CRUD_CODEC_LZ) ||
+			bench_file("random", random, CRUD_CODEC_NONE) || bench_file("random", random, CRUD_CODEC_LZ) )
+		return 1;
+	if( crud_unmount() ) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on unmount operation.");
+		return 1;
+	}
+
+	free(text);
+	free(random);
+	return 0;
+}
@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_bench_threads.c
+//  Description    : This is a benchmark of the file IO functions under threads.
+//                   Each of N threads rewrites and reads back stripes of its
+//                   own file with crud_pwrite and crud_pread, and the
+//                   operations per second are reported for N = 1, 2, 4, 8
+//                   and 16.  Build it with file_io.c, client.c, crud_lz.c and
+//                   crud_sha256.c and run it against a CRUD server.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+// Project Includes
+#include <crud_file_io_ext.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define BENCH_MAX_THREADS 16 // Most threads in one run
+#define BENCH_OPERATIONS 2000 // Writes and reads each thread makes in one run
+#define BENCH_IO_SIZE 4096 // Bytes in each write and read
+#define BENCH_FILE_SIZE (16*BENCH_IO_SIZE) // Bytes each thread's file is rewritten over
+
+// Type for one thread of a run
+typedef struct {
+	pthread_t thread; // The thread
+	int16_t   fd;     // Its file
+	int       failed; // Nonzero if one of its operations failed
+} BenchThreadType;
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : now_ns
+// Description  : Reads the monotonic clock
+//
+// Inputs       : None
+// Outputs      : the time in nanoseconds
+
+static double now_ns(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1e9 + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_worker
+// Description  : Writes and reads back BENCH_OPERATIONS blocks of one file
+//
+// Inputs       : arg - the BenchThreadType of the thread
+// Outputs      : NULL
+
+static void *bench_worker(void *arg) {
+
+	BenchThreadType *bench = arg;
+	char buf[BENCH_IO_SIZE], got[BENCH_IO_SIZE];
+	uint32_t offset;
+	int i;
+
+	for( i=0; i<BENCH_OPERATIONS/2; i++ ) {
+		memset(buf, 'a' + (i%26), sizeof(buf));
+		offset = (i*BENCH_IO_SIZE) % BENCH_FILE_SIZE;
+		if( crud_pwrite(bench->fd, buf, BENCH_IO_SIZE, offset) != BENCH_IO_SIZE ||
+				crud_pread(bench->fd, got, BENCH_IO_SIZE, offset) != BENCH_IO_SIZE ||
+				memcmp(buf, got, BENCH_IO_SIZE) ) {
+			bench->failed = 1;
+			return NULL; // ERROR - the operation failed or read back the wrong bytes
+		}
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : Runs the benchmark for each number of threads
+//
+// Inputs       : None
+// Outputs      : 0 if successful, 1 if failure
+
+int main(void) {
+
+	BenchThreadType benches[BENCH_MAX_THREADS];
+	char path[CRUD_MAX_PATH_LENGTH], *fill;
+	double start, elapsed, single = 0;
+	int threads, i;
+
+	if( crud_format() || crud_mount() ) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on format or mount operation.");
+		return 1;
+	}
+
+	// Give each thread a file of BENCH_FILE_SIZE to rewrite
+	fill = calloc(1, BENCH_FILE_SIZE);
+	for( i=0; i<BENCH_MAX_THREADS; i++ ) {
+		sprintf(path, "bench/t%02d", i);
+		if( (benches[i].fd = crud_open(path)) == -1 ||
+				crud_write(benches[i].fd, fill, BENCH_FILE_SIZE) != BENCH_FILE_SIZE ) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure creating %s.", path);
+			return 1;
+		}
+	}
+	free(fill);
+
+	printf("%8s %12s %14s %10s\n", "threads", "ops/s", "ops/s/thread", "speedup");
+	for( threads=1; threads<=BENCH_MAX_THREADS; threads*=2 ) {
+		start = now_ns();
+		for( i=0; i<threads; i++ ) {
+			benches[i].failed = 0;
+			pthread_create(&benches[i].thread, NULL, bench_worker, &benches[i]);
+		}
+		for( i=0; i<threads; i++ ) {
+			pthread_join(benches[i].thread, NULL);
+			if( benches[i].failed ) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure in thread %d of %d.", i, threads);
+				return 1;
+			}
+		}
+		elapsed = (now_ns() - start) / 1e9;
+		if( threads == 1 )
+			single = BENCH_OPERATIONS / elapsed;
+		printf("%8d %12.0f %14.0f %9.2fx\n", threads, threads*BENCH_OPERATIONS / elapsed,
+			BENCH_OPERATIONS / elapsed, threads*BENCH_OPERATIONS / elapsed / single);
+	}
+
+	for( i=0; i<BENCH_MAX_THREADS; i++ )
+		crud_close(benches[i].fd);
+	if( crud_unmount() ) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_BENCH : Failure on unmount operation.");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef CRUD_DRIVER_EXT_INCLUDED
+#define CRUD_DRIVER_EXT_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_driver_ext.h
+//  Description    : This is the interface for the requests added on top of the
+//                   standardized CRUD requests in crud_driver.h.  They move
+//                   bytes between objects on the server, so the bytes never
+//                   cross the client's link, and list the objects it holds.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <stdint.h>
+
+// Project Includes
+#include <crud_driver.h>
+
+// Defines
+#define CRUD_COPY   (CRUD_MAX_CMD)   // Copies a range of one object over a range of the request's object, which keeps its length
+#define CRUD_CONCAT (CRUD_MAX_CMD+1) // Creates an object from a list of ranges of other objects, in order
+#define CRUD_LIST   (CRUD_MAX_CMD+2) // Lists the objects held, in order of their ids
+
+// Type for a range of bytes in an object, sent in network byte order.  The
+// payload of a COPY is the source range followed by the 32 bit offset in the
+// request's object to copy it to.  The payload of a CONCAT is its list of
+// ranges, and the response carries the new object and its length.
+typedef struct {
+	CrudOID  object; // The object holding the bytes
+	uint32_t offset; // First byte of the range in the object
+	uint32_t length; // Bytes in the range
+} CrudObjectRange;
+
+// A LIST asks for the objects whose ids are at least the request's object id, and
+// its length is the room for their ids.  The payload of the response is as many
+// ids as fit, in increasing order and network byte order, and the response's
+// object id is where the next LIST should start, 0 once every object was listed.
+// The priority object is never listed.
+
+#endif
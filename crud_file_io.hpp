@@ -0,0 +1,154 @@
+#ifndef CRUD_FILE_IO_HPP_INCLUDED
+#define CRUD_FILE_IO_HPP_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_file_io.hpp
+//  Description    : This is the C++ interface to the CRUD file IO functions.  A
+//                   CrudFilesystem owns the mount and a CrudFile owns one open
+//                   file handle.  Their spans are handed straight to the C
+//                   functions, so nothing is copied or allocated on the way.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+// Project Includes
+#include <crud_file_io_ext.h>
+
+namespace crud {
+
+// One open file handle, closed when the CrudFile goes away
+class CrudFile {
+public:
+	CrudFile() noexcept = default;
+	explicit CrudFile(int16_t opened) noexcept : fd(opened) {}
+	CrudFile(const CrudFile &) = delete;
+	CrudFile(CrudFile &&other) noexcept : fd(std::exchange(other.fd, -1)) {}
+	CrudFile &operator=(const CrudFile &) = delete;
+	CrudFile &operator=(CrudFile &&other) noexcept {
+		if( this != &other ) {
+			close();
+			fd = std::exchange(other.fd, -1);
+		}
+		return *this;
+	}
+	~CrudFile() { close(); }
+
+	// Reads up to buffer.size() bytes at the file position, returns the count read or -1
+	int32_t read(std::span<std::byte> buffer) const noexcept {
+		return crud_read(fd, buffer.data(), length(buffer.size()));
+	}
+
+	// Writes "buffer" at the file position, returns the count written or -1
+	int32_t write(std::span<const std::byte> buffer) const noexcept {
+		return crud_write(fd, const_cast<std::byte *>(buffer.data()), length(buffer.size()));
+	}
+
+	// Reads up to buffer.size() bytes at "offset" without moving the file position
+	int32_t pread(std::span<std::byte> buffer, uint32_t offset) const noexcept {
+		return crud_pread(fd, buffer.data(), length(buffer.size()), offset);
+	}
+
+	// Writes "buffer" at "offset" without moving the file position
+	int32_t pwrite(std::span<const std::byte> buffer, uint32_t offset) const noexcept {
+		return crud_pwrite(fd, const_cast<std::byte *>(buffer.data()), length(buffer.size()), offset);
+	}
+
+	// Reads into each buffer of "iov" in turn as one read of the file
+	int32_t readv(std::span<const struct iovec> iov) const noexcept {
+		return crud_readv(fd, iov.data(), static_cast<int>(iov.size()));
+	}
+
+	// Writes each buffer of "iov" in turn as one write of the file
+	int32_t writev(std::span<const struct iovec> iov) const noexcept {
+		return crud_writev(fd, iov.data(), static_cast<int>(iov.size()));
+	}
+
+	// Moves the file position, returns 0 or -1
+	int32_t seek(uint32_t loc) const noexcept { return crud_seek(fd, loc); }
+
+	// Returns the length of the file or -1
+	int32_t size() const noexcept { return crud_size(fd); }
+
+	// Sets the length of the file, returns 0 or -1
+	int16_t truncate(uint32_t length) const noexcept { return crud_truncate(fd, length); }
+
+	// Stores the file in full up to "length", returns 0 or -1
+	int16_t allocate(uint32_t length) const noexcept { return crud_fallocate(fd, length); }
+
+	// Makes the writes that returned so far durable, returns 0 or -1
+	int16_t fsync() const noexcept { return crud_fsync(fd); }
+
+	// Closes the handle now, returns 0 or -1
+	int16_t close() noexcept {
+		if( fd < 0 )
+			return 0;
+		return crud_close(std::exchange(fd, -1));
+	}
+
+	// Gives up ownership of the handle without closing it
+	int16_t release() noexcept { return std::exchange(fd, -1); }
+
+	bool valid() const noexcept { return fd >= 0; }
+	explicit operator bool() const noexcept { return valid(); }
+	int16_t handle() const noexcept { return fd; }
+
+private:
+	// Counts past what the C functions take are passed as -1 so they fail
+	static int32_t length(std::size_t size) noexcept {
+		return size > INT32_MAX ? -1 : static_cast<int32_t>(size);
+	}
+
+	int16_t fd = -1;
+};
+
+// The mounted filesystem, unmounted (saving its tables) when it goes away
+class CrudFilesystem {
+public:
+	enum class Mount { keep, format }; // Whether to format the device before mounting
+
+	explicit CrudFilesystem(Mount how = Mount::keep) noexcept {
+		if( how == Mount::format && crud_format() != 0 )
+			return; // ERROR - the format failed, leave the filesystem unmounted
+		mounted = crud_mount() == 0;
+	}
+	CrudFilesystem(const CrudFilesystem &) = delete;
+	CrudFilesystem(CrudFilesystem &&other) noexcept : mounted(std::exchange(other.mounted, false)) {}
+	CrudFilesystem &operator=(const CrudFilesystem &) = delete;
+	CrudFilesystem &operator=(CrudFilesystem &&other) noexcept {
+		if( this != &other ) {
+			unmount();
+			mounted = std::exchange(other.mounted, false);
+		}
+		return *this;
+	}
+	~CrudFilesystem() { unmount(); }
+
+	// Opens (or creates) "path", the result is not valid() if the open fails
+	CrudFile open(const char *path) const noexcept {
+		return CrudFile(crud_open(const_cast<char *>(path)));
+	}
+
+	// Unmounts now, returns 0 or nonzero on failure.  Every CrudFile must be closed first.
+	uint16_t unmount() noexcept {
+		if( !std::exchange(mounted, false) )
+			return 0;
+		return crud_unmount();
+	}
+
+	bool valid() const noexcept { return mounted; }
+	explicit operator bool() const noexcept { return valid(); }
+
+private:
+	bool mounted = false;
+};
+
+} // namespace crud
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef CRUD_FILE_IO_CORO_INCLUDED
+#define CRUD_FILE_IO_CORO_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_file_io_coro.hpp
+//  Description    : This is the C++20 coroutine interface to the CRUD file IO
+//                   functions.  Each co_await starts one of the asynchronous
+//                   operations in crud_file_io_ext.h and suspends the coroutine
+//                   until it completes.  A Scheduler resumes every coroutine on
+//                   the thread running it, so thousands of coroutines share the
+//                   driver's worker and connection pools.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <coroutine>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <utility>
+
+// Project Includes
+#include <crud_file_io_ext.h>
+
+namespace crud {
+
+class Scheduler;
+
+//
+// Coroutine task
+
+template <typename T> class Task;
+
+namespace detail {
+
+// State shared by the promises of every Task
+struct TaskPromiseBase {
+
+	std::coroutine_handle<> continuation; // Coroutine awaiting this one, if any
+	Scheduler *owner = nullptr; // Scheduler of a spawned task, which has no continuation
+	std::exception_ptr exception;
+
+	struct FinalAwaiter {
+		bool await_ready() const noexcept { return false; }
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept;
+		void await_resume() const noexcept {}
+	};
+
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+	FinalAwaiter final_suspend() const noexcept { return {}; }
+	void unhandled_exception() noexcept { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+
+	T value{};
+
+	Task<T> get_return_object() noexcept;
+	template <typename U> void return_value(U &&result) { value = std::forward<U>(result); }
+	T take() {
+		if( exception )
+			std::rethrow_exception(exception);
+		return std::move(value);
+	}
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+
+	Task<void> get_return_object() noexcept;
+	void return_void() const noexcept {}
+	void take() {
+		if( exception )
+			std::rethrow_exception(exception);
+	}
+};
+
+} // namespace detail
+
+// A lazily started coroutine returning T, run by awaiting it or by spawning it
+// on a Scheduler
+template <typename T = void>
+class [[nodiscard]] Task {
+public:
+	using promise_type = detail::TaskPromise<T>;
+
+	Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+	Task &operator=(Task other) noexcept { std::swap(handle, other.handle); return *this; }
+	~Task() { if( handle ) handle.destroy(); }
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+		handle.promise().continuation = awaiting;
+		return handle;
+	}
+	T await_resume() { return handle.promise().take(); }
+
+private:
+	friend promise_type;
+	friend class Scheduler;
+
+	explicit Task(std::coroutine_handle<promise_type> coroutine) noexcept : handle(coroutine) {}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object() noexcept {
+	return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+	return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+//
+// Scheduler
+
+// Runs spawned tasks on the thread calling run().  Completions arriving on the
+// driver's worker threads are queued here and resumed by that thread.
+class Scheduler {
+public:
+	Scheduler() = default;
+	Scheduler(const Scheduler &) = delete;
+	Scheduler &operator=(const Scheduler &) = delete;
+
+	// Starts "task" on the next run(), the scheduler owns it from now on
+	void spawn(Task<void> task) {
+		std::coroutine_handle<detail::TaskPromise<void>> handle = std::exchange(task.handle, {});
+		handle.promise().owner = this;
+		std::lock_guard<std::mutex> guard(lock);
+		live++;
+		ready.push_back(handle);
+	}
+
+	// Resumes tasks until every spawned task has finished, rethrows the first
+	// exception one of them let escape
+	void run() {
+		std::unique_lock<std::mutex> guard(lock);
+		while( live > 0 ) {
+			if( ready.empty() ) {
+				wakeup.wait(guard);
+				continue;
+			}
+			std::coroutine_handle<> handle = ready.front();
+			ready.pop_front();
+			guard.unlock();
+			handle.resume();
+			guard.lock();
+		}
+		if( failure ) {
+			std::exception_ptr thrown = std::exchange(failure, nullptr);
+			std::rethrow_exception(thrown);
+		}
+	}
+
+	// Queues "handle" to be resumed by run(), callable from any thread
+	void post(std::coroutine_handle<> handle) {
+		std::lock_guard<std::mutex> guard(lock);
+		ready.push_back(handle);
+		wakeup.notify_one();
+	}
+
+private:
+	friend struct detail::TaskPromiseBase;
+
+	// Called by a spawned task as it finishes
+	void retire(std::exception_ptr exception) {
+		std::lock_guard<std::mutex> guard(lock);
+		if( exception && !failure )
+			failure = exception;
+		live--;
+	}
+
+	std::mutex lock;
+	std::condition_variable wakeup;
+	std::deque<std::coroutine_handle<>> ready;
+	std::size_t live = 0;
+	std::exception_ptr failure;
+};
+
+template <typename Promise>
+inline std::coroutine_handle<> detail::TaskPromiseBase::FinalAwaiter::await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+	TaskPromiseBase &promise = handle.promise();
+	if( promise.continuation )
+		return promise.continuation;
+	if( promise.owner != nullptr ) {
+		// A spawned task is run from Scheduler::run(), which is not waiting on it
+		promise.owner->retire(promise.exception);
+		handle.destroy();
+	}
+	return std::noop_coroutine();
+}
+
+//
+// Awaitable operations
+
+namespace detail {
+
+// Suspends the awaiting coroutine until one asynchronous driver operation
+// completes, then resumes it on the scheduler with the operation's result
+class Operation {
+public:
+	Operation(Scheduler &runner, CrudCompletion *(*starter)(Operation &)) noexcept
+		: scheduler(runner), start(starter) {}
+
+	bool await_ready() const noexcept { return false; }
+	bool await_suspend(std::coroutine_handle<> awaiting) noexcept {
+		handle = awaiting;
+		CrudCompletion *completion = start(*this);
+		if( completion == nullptr ) {
+			result = -1; // ERROR - the operation could not be started
+			return false;
+		}
+		crud_async_release(completion);
+		return true;
+	}
+	int32_t await_resume() const noexcept { return result; }
+
+	static void finished(CrudCompletion *, int32_t status, void *arg) {
+		Operation *operation = static_cast<Operation *>(arg);
+		operation->result = status;
+		operation->scheduler.post(operation->handle); // Last use, the frame may resume and go away
+	}
+
+	int16_t fd = -1;
+	void *buf = nullptr;
+	int32_t count = 0;
+	char *path = nullptr;
+
+private:
+	Scheduler &scheduler;
+	CrudCompletion *(*start)(Operation &);
+	std::coroutine_handle<> handle;
+	int32_t result = -1;
+};
+
+} // namespace detail
+
+// A file opened for coroutine I/O, closed when it goes away
+class AsyncFile {
+public:
+	AsyncFile() noexcept = default;
+	AsyncFile(AsyncFile &&other) noexcept
+		: scheduler(other.scheduler), fd(std::exchange(other.fd, -1)) {}
+	AsyncFile &operator=(AsyncFile other) noexcept {
+		std::swap(scheduler, other.scheduler);
+		std::swap(fd, other.fd);
+		return *this;
+	}
+	~AsyncFile() { if( fd >= 0 ) crud_close(fd); }
+
+	// Opens (or creates) "path", the result is not valid() if the open fails
+	static Task<AsyncFile> open(Scheduler &runner, const char *path) {
+		detail::Operation operation(runner, [](detail::Operation &op) {
+			return crud_open_async(op.path, detail::Operation::finished, &op);
+		});
+		operation.path = const_cast<char *>(path);
+		int32_t opened = co_await operation;
+		co_return AsyncFile(runner, static_cast<int16_t>(opened));
+	}
+
+	// Reads up to buffer.size() bytes at the file position, returns the count read or -1
+	detail::Operation read(std::span<std::byte> buffer) const noexcept {
+		detail::Operation operation(*scheduler, [](detail::Operation &op) {
+			return crud_read_async(op.fd, op.buf, op.count, detail::Operation::finished, &op);
+		});
+		operation.fd = fd;
+		operation.buf = buffer.data();
+		operation.count = static_cast<int32_t>(buffer.size());
+		return operation;
+	}
+
+	// Writes "buffer" at the file position, returns the count written or -1
+	detail::Operation write(std::span<const std::byte> buffer) const noexcept {
+		detail::Operation operation(*scheduler, [](detail::Operation &op) {
+			return crud_write_async(op.fd, op.buf, op.count, detail::Operation::finished, &op);
+		});
+		operation.fd = fd;
+		operation.buf = const_cast<std::byte *>(buffer.data());
+		operation.count = static_cast<int32_t>(buffer.size());
+		return operation;
+	}
+
+	// Moves the file position, returns 0 or -1
+	int32_t seek(uint32_t loc) const noexcept { return crud_seek(fd, loc); }
+
+	bool valid() const noexcept { return fd >= 0; }
+	int16_t handle() const noexcept { return fd; }
+
+private:
+	AsyncFile(Scheduler &runner, int16_t opened) noexcept : scheduler(&runner), fd(opened) {}
+
+	Scheduler *scheduler = nullptr;
+	int16_t fd = -1;
+};
+
+} // namespace crud
+
+#endif
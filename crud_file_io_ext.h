@@ -0,0 +1,206 @@
+#ifndef CRUD_FILE_IO_EXT_INCLUDED
+#define CRUD_FILE_IO_EXT_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_file_io_ext.h
+//  Description    : This is the interface for the IO functions added on top of
+//                   the standardized CRUD file IO functions in crud_file_io.h.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <stdint.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Project Includes
+#include <crud_file_io.h>
+
+// Defines
+#define CRUD_MAX_IOVECS 512 // Maximum number of buffers in one crud_readv/crud_writev
+#define CRUD_CODEC_NONE 0 // Stripes are stored as they are
+#define CRUD_CODEC_LZ 1 // Stripes are stored compressed with crud_lz when that makes them smaller
+#define CRUD_INLINE_MAX 64 // Longest file that can be stored in the file table instead of in objects
+#define CRUD_DIRENT_FILE 0 // The entry of a directory is a file
+#define CRUD_DIRENT_DIRECTORY 1 // The entry of a directory is a directory
+
+// Type for the tunables of write-back.  Small writes are held in memory and
+// stored later, by a background flusher or by the writer itself once too
+// many bytes are waiting.
+typedef struct {
+	uint32_t dirty_bytes;            // Bytes waiting at which writers store their own, 0 to store every write at once
+	uint32_t dirty_background_bytes; // Bytes waiting at which the flusher stores them without waiting for them to expire
+	uint32_t dirty_expire_ms;        // Age at which the flusher stores a file's waiting bytes
+	uint32_t writeback_interval_ms;  // Time between the flusher's passes
+} CrudWritebackTunables;
+
+// Type for the counters of write-back
+typedef struct {
+	uint64_t dirty_bytes;   // Bytes written but not yet stored
+	uint64_t flushes;       // Runs of bytes stored
+	uint64_t flushed_bytes; // Bytes in those runs
+	uint64_t flush_ns;      // Time spent storing them, in nanoseconds
+	uint64_t max_flush_ns;  // Longest time spent storing one run
+	uint64_t throttled;     // Writes that stored their file's bytes because dirty_bytes was reached
+} CrudWritebackStats;
+
+// Type for the tunables of garbage collection.  Objects the store holds that no
+// file names, left behind by failed writes and crashes, are found by a pass
+// over the store's list of objects and deleted a batch at a time.
+typedef struct {
+	uint32_t gc_interval_ms; // Time between background passes, 0 to collect only in crud_collect_garbage
+	uint32_t gc_batch;       // Most orphans the flusher deletes on each of its passes
+} CrudGcTunables;
+
+// Type for the counters of garbage collection
+typedef struct {
+	uint64_t passes;  // Passes over the store's list of objects
+	uint64_t listed;  // Objects listed by those passes
+	uint64_t orphans; // Objects found that no file names
+	uint64_t deleted; // Orphans deleted
+} CrudGcStats;
+
+// Type for an entry of a directory returned by crud_readdir.  A path's
+// components are separated by single '/', none of them empty, the last naming
+// the entry in its directory.
+typedef struct {
+	char     name[CRUD_MAX_PATH_LENGTH]; // Name of the entry in the directory
+	uint8_t  type;   // CRUD_DIRENT_FILE or CRUD_DIRENT_DIRECTORY
+	uint32_t length; // Bytes in the file, 0 for a directory
+} CrudDirent;
+
+// Type for an iteration over the files whose paths start with a prefix
+typedef struct {
+	char     prefix[CRUD_MAX_PATH_LENGTH]; // The prefix
+	char     last[CRUD_MAX_PATH_LENGTH];   // Path of the last file returned
+	uint16_t next;    // Where the next file was in the name index, checked before it is used
+	uint8_t  started; // Nonzero once a file was returned
+} CrudPrefixIterator;
+
+// Type for the completion of an asynchronous operation
+typedef struct CrudCompletion CrudCompletion;
+
+// Type for the function called on a worker thread when an asynchronous operation finishes
+typedef void (*CrudCompletionCallback)(CrudCompletion *completion, int32_t result, void *arg);
+
+//
+// Interface functions
+
+int32_t crud_pread(int16_t fd, void *buf, int32_t count, uint32_t offset);
+	// Reads up to "count" bytes at "offset" without moving the file position
+
+int32_t crud_pwrite(int16_t fd, void *buf, int32_t count, uint32_t offset);
+	// Writes "count" bytes at "offset" without moving the file position
+
+int32_t crud_readv(int16_t fd, const struct iovec *iov, int iovcnt);
+	// Reads into each buffer of "iov" in turn as one read of the file
+
+int32_t crud_writev(int16_t fd, const struct iovec *iov, int iovcnt);
+	// Writes each buffer of "iov" in turn as one write of the file
+
+int32_t crud_size(int16_t fd);
+	// Returns the length of the file, which may end in a hole
+
+int16_t crud_truncate(int16_t fd, uint32_t length);
+	// Sets the length of the file, cutting it off or growing it with zeros
+
+int16_t crud_fallocate(int16_t fd, uint32_t length);
+	// Stores the file in full up to "length", growing it with zeros if it is shorter
+
+int16_t crud_fsync(int16_t fd);
+	// Makes every write to the file that returned before the call durable
+
+int16_t crud_syncfs(void);
+	// Makes every change to the file system made before the call durable
+
+int16_t crud_set_writeback(const CrudWritebackTunables *tunables);
+	// Replaces the write-back tunables
+
+void crud_get_writeback(CrudWritebackTunables *tunables);
+	// Reads the write-back tunables
+
+void crud_writeback_stats(CrudWritebackStats *stats);
+	// Reads the write-back counters
+
+int32_t crud_collect_garbage(void);
+	// Deletes every object no file names, returns how many or -1 if not mounted or the store could not be listed
+
+int16_t crud_set_gc(const CrudGcTunables *tunables);
+	// Replaces the garbage collection tunables
+
+void crud_get_gc(CrudGcTunables *tunables);
+	// Reads the garbage collection tunables
+
+void crud_gc_stats(CrudGcStats *stats);
+	// Reads the garbage collection counters
+
+int16_t crud_set_inline(uint32_t limit);
+	// Sets the length up to which files are kept in the file table, at most CRUD_INLINE_MAX, 0 for none
+
+uint32_t crud_get_inline(void);
+	// Reads the length up to which files are kept in the file table
+
+int16_t crud_set_codec(int16_t fd, uint8_t codec);
+	// Chooses the CRUD_CODEC_* later writes store the file's stripes with
+
+int16_t crud_set_dedup(int16_t fd, uint8_t enable);
+	// Makes later writes share stripes with any file that already stored the same bytes
+
+int16_t crud_set_append(int16_t fd, uint8_t enable);
+	// Makes later small appends cost one request however long the file is
+
+int16_t crud_set_pack(int16_t fd, uint8_t enable);
+	// Stores the file while it is small in a container shared with other small files
+
+int16_t crud_clone(char *src, char *dst);
+	// Creates "dst" sharing the stripes of "src", copying each only when either file rewrites it
+
+int16_t crud_mkdir(char *path);
+	// Creates an empty directory in one that exists, crud_open creates those a new file's path needs
+
+int16_t crud_opendir(char *path);
+	// Opens a stream over the entries of a directory, "" for the root directory
+
+int16_t crud_readdir(int16_t dd, CrudDirent *dirent);
+	// Reads the next entry in order of names, returns 1 if there was one, 0 at the end or -1 if failure
+
+int16_t crud_closedir(int16_t dd);
+	// Closes a directory stream
+
+int16_t crud_list_prefix(char *prefix, CrudPrefixIterator *iterator);
+	// Starts an iteration over the files whose paths start with "prefix", in order of their paths
+
+int16_t crud_next_prefix(CrudPrefixIterator *iterator, CrudDirent *dirent);
+	// Reads the next file of the iteration, its path as the name, returns 1 if there was one, 0 at the end or -1 if failure
+
+int32_t crud_copy_range(int16_t src_fd, uint32_t src_offset, int16_t dst_fd, uint32_t dst_offset, int32_t count);
+	// Copies up to "count" bytes between files on the server where it can, without moving either position
+
+CrudCompletion *crud_open_async(char *path, CrudCompletionCallback callback, void *arg);
+	// Starts a crud_open without waiting, NULL if it could not be started
+
+CrudCompletion *crud_read_async(int16_t fd, void *buf, int32_t count, CrudCompletionCallback callback, void *arg);
+	// Starts a crud_read without waiting, "buf" must stay valid until it completes
+
+CrudCompletion *crud_write_async(int16_t fd, void *buf, int32_t count, CrudCompletionCallback callback, void *arg);
+	// Starts a crud_write without waiting, "buf" must stay valid until it completes
+
+int crud_async_poll(CrudCompletion *completion, int32_t *result);
+	// Returns 1 and the operation's result once it and its callback have finished, 0 before
+
+int32_t crud_async_wait(CrudCompletion *completion);
+	// Waits for the operation and its callback, returns its result and releases the completion
+
+void crud_async_release(CrudCompletion *completion);
+	// Releases the completion without waiting, the operation still runs
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
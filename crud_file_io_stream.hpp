@@ -0,0 +1,191 @@
+#ifndef CRUD_FILE_IO_STREAM_INCLUDED
+#define CRUD_FILE_IO_STREAM_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_file_io_stream.hpp
+//  Description    : This is the std::streambuf adapter for CRUD files.  Small
+//                   stream reads and writes are gathered in large get and put
+//                   areas so each reaches the device as one crud_read or
+//                   crud_write, and bulk sgetn/sputn calls skip the buffers.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <algorithm>
+#include <cstring>
+#include <ios>
+#include <streambuf>
+#include <vector>
+
+// Project Includes
+#include <crud_file_io.hpp>
+
+namespace crud {
+
+// Stream buffer over one CRUD file, which it owns
+class crud_streambuf : public std::streambuf {
+public:
+	static constexpr std::size_t default_buffer_size = CRUD_MAX_OBJECT_SIZE/8; // One stripe of a file
+
+	explicit crud_streambuf(CrudFile opened, std::size_t get_size = default_buffer_size,
+			std::size_t put_size = default_buffer_size)
+		: file(std::move(opened)), get_area(std::max<std::size_t>(get_size, 1)),
+		  put_area(std::max<std::size_t>(put_size, 1)) {}
+	crud_streambuf(const crud_streambuf &) = delete;
+	crud_streambuf &operator=(const crud_streambuf &) = delete;
+	~crud_streambuf() override { sync(); }
+
+	bool is_open() const noexcept { return file.valid(); }
+
+	// Flushes the put area and closes the file, returns 0 or -1
+	int close() {
+		int ret = sync();
+		if( file.close() != 0 )
+			ret = -1;
+		return ret;
+	}
+
+protected:
+	int_type underflow() override {
+		if( gptr() < egptr() )
+			return traits_type::to_int_type(*gptr());
+		if( !flush_put() )
+			return traits_type::eof(); // ERROR - could not write out the put area first
+		setg(nullptr, nullptr, nullptr);
+
+		int32_t got = file.read(std::as_writable_bytes(std::span(get_area)));
+		if( got <= 0 )
+			return traits_type::eof(); // At the end of the file, or the read failed
+		position += got;
+		setg(get_area.data(), get_area.data(), get_area.data() + got);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	int_type overflow(int_type c) override {
+		if( !drop_get() || !flush_put() )
+			return traits_type::eof(); // ERROR - could not reposition or write out the put area
+		setp(put_area.data(), put_area.data() + put_area.size());
+		if( !traits_type::eq_int_type(c, traits_type::eof()) ) {
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	int sync() override {
+		return flush_put() && drop_get() ? 0 : -1;
+	}
+
+	std::streamsize xsgetn(char *s, std::streamsize n) override {
+		std::streamsize got = std::min<std::streamsize>(n, egptr() - gptr());
+		if( got > 0 ) {
+			std::memcpy(s, gptr(), got);
+			gbump(static_cast<int>(got));
+		}
+		if( n - got < static_cast<std::streamsize>(get_area.size()) )
+			return got + std::streambuf::xsgetn(s + got, n - got);
+
+		// Large reads go straight into the caller's buffer
+		if( !flush_put() )
+			return got; // ERROR - could not write out the put area first
+		setg(nullptr, nullptr, nullptr);
+		int32_t read = file.read(std::as_writable_bytes(std::span(s + got, n - got)));
+		if( read > 0 ) {
+			position += read;
+			got += read;
+		}
+		return got;
+	}
+
+	std::streamsize xsputn(const char *s, std::streamsize n) override {
+		if( n < static_cast<std::streamsize>(put_area.size()) )
+			return std::streambuf::xsputn(s, n);
+
+		// Large writes go straight from the caller's buffer
+		if( !drop_get() || !flush_put() )
+			return 0; // ERROR - could not reposition or write out the put area
+		int32_t written = file.write(std::as_bytes(std::span(s, n)));
+		if( written <= 0 )
+			return 0; // ERROR - the write failed
+		position += written;
+		return written;
+	}
+
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+		off_type current = static_cast<off_type>(position) - (egptr() - gptr()) + (pptr() - pbase());
+		if( dir == std::ios_base::cur && off == 0 )
+			return pos_type(current); // tellg/tellp do not need to move anything
+
+		off_type target = off;
+		if( dir == std::ios_base::cur )
+			target += current;
+		else if( dir == std::ios_base::end ) {
+			if( sync() != 0 )
+				return pos_type(off_type(-1)); // ERROR - could not write out the put area
+			target += static_cast<off_type>(file_length());
+		}
+
+		// Seeks inside the get area only move gptr()
+		if( pptr() == pbase() && eback() != nullptr &&
+				target >= static_cast<off_type>(position) - (egptr() - eback()) &&
+				target <= static_cast<off_type>(position) ) {
+			setg(eback(), egptr() - (static_cast<off_type>(position) - target), egptr());
+			return pos_type(target);
+		}
+		return seekpos(pos_type(target), std::ios_base::in | std::ios_base::out);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode) override {
+		off_type target = static_cast<off_type>(pos);
+		if( sync() != 0 || target < 0 || target > static_cast<off_type>(UINT32_MAX) )
+			return pos_type(off_type(-1)); // ERROR - could not flush, or position out of range
+		setg(nullptr, nullptr, nullptr);
+		if( file.seek(static_cast<uint32_t>(target)) != 0 )
+			return pos_type(off_type(-1)); // ERROR - position is past the end of the largest file
+		position = static_cast<uint32_t>(target);
+		return pos;
+	}
+
+private:
+	// Writes out and forgets the put area, false if the write failed
+	bool flush_put() {
+		std::ptrdiff_t pending = pptr() - pbase();
+		char *start = pbase();
+		setp(nullptr, nullptr);
+		if( pending == 0 )
+			return true;
+		int32_t written = file.write(std::as_bytes(std::span(start, pending)));
+		if( written != pending )
+			return false; // ERROR - the write failed
+		position += written;
+		return true;
+	}
+
+	// Forgets the get area, moving the file position back over what was not
+	// consumed, false if the seek failed
+	bool drop_get() {
+		std::ptrdiff_t unread = egptr() - gptr();
+		setg(nullptr, nullptr, nullptr);
+		if( unread == 0 )
+			return true;
+		position -= static_cast<uint32_t>(unread);
+		return file.seek(position) == 0;
+	}
+
+	// Finds the file length, which costs no device requests
+	uint32_t file_length() {
+		int32_t length = file.size();
+		return length < 0 ? 0 : static_cast<uint32_t>(length);
+	}
+
+	CrudFile file;
+	std::vector<char> get_area;
+	std::vector<char> put_area;
+	uint32_t position = 0; // Position of the file handle
+};
+
+} // namespace crud
+
+#endif
@@ -0,0 +1,249 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_lz.c
+//  Description    : This is the implementation of the LZ codec used to compress
+//                   the objects of compressed files.  Each sequence starts with
+//                   a token whose high nibble is the literal count and whose low
+//                   nibble is the copy length less CRUD_LZ_MIN_MATCH, either
+//                   continued in following bytes when it reaches 15.  Then come
+//                   the literals and a two byte little-endian copy offset.  The
+//                   last sequence of a block has literals only.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <string.h>
+
+// Project Includes
+#include <crud_lz.h>
+
+// Defines
+#define CRUD_LZ_MIN_MATCH 4 // Shortest copy worth encoding
+#define CRUD_LZ_MAX_OFFSET 65535 // Furthest back a copy may reach
+#define CRUD_LZ_HASH_BITS 12 // Log2 of the number of positions remembered while compressing
+#define CRUD_LZ_SKIP_SHIFT 6 // Literal run after which the search starts skipping ahead
+#define CRUD_LZ_NIBBLE 15 // Largest count held in a token nibble
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read32
+// Description  : Loads four bytes from any alignment
+//
+// Inputs       : p - the bytes
+// Outputs      : the bytes as one word
+
+static uint32_t read32(const uint8_t *p) {
+
+	uint32_t word;
+
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hash_word
+// Description  : Picks the hash table slot of four bytes
+//
+// Inputs       : word - the bytes
+// Outputs      : the slot
+
+static uint32_t hash_word(uint32_t word) {
+
+	return (word * 2654435761u) >> (32 - CRUD_LZ_HASH_BITS);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : put_sequence
+// Description  : Appends one sequence to a compressed block
+//
+// Inputs       : op - the output position, moved past the sequence
+//                end - the end of the output
+//                literals - the literal bytes
+//                litLen - the number of literal bytes
+//                offset - how far back the copy starts, unused if matchLen is 0
+//                matchLen - the copy length, 0 for the last sequence
+// Outputs      : 0 if successful, -1 if the sequence does not fit
+
+static int put_sequence(uint8_t **op, uint8_t *end, const uint8_t *literals, uint32_t litLen,
+		uint32_t offset, uint32_t matchLen) {
+
+	uint8_t *out = *op;
+	uint32_t rest, matchCode = matchLen ? matchLen - CRUD_LZ_MIN_MATCH : 0;
+
+	// Worst case is the token, both continued lengths, the literals and the offset
+	if( (uint64_t)(end - out) < 1 + litLen/255 + 1 + litLen + 2 + matchCode/255 + 1 )
+		return -1; // ERROR - the output is full
+
+	*out++ = (uint8_t)(((litLen < CRUD_LZ_NIBBLE) ? litLen : CRUD_LZ_NIBBLE) << 4 |
+		((matchCode < CRUD_LZ_NIBBLE) ? matchCode : CRUD_LZ_NIBBLE));
+	if( litLen >= CRUD_LZ_NIBBLE ) {
+		for( rest = litLen - CRUD_LZ_NIBBLE; rest >= 255; rest -= 255 )
+			*out++ = 255;
+		*out++ = (uint8_t)rest;
+	}
+	memcpy(out, literals, litLen);
+	out += litLen;
+
+	if( matchLen ) {
+		*out++ = (uint8_t)(offset & 0xff);
+		*out++ = (uint8_t)(offset >> 8);
+		if( matchCode >= CRUD_LZ_NIBBLE ) {
+			for( rest = matchCode - CRUD_LZ_NIBBLE; rest >= 255; rest -= 255 )
+				*out++ = 255;
+			*out++ = (uint8_t)rest;
+		}
+	}
+
+	*op = out;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : get_length
+// Description  : Reads the continuation of a length that filled its nibble
+//
+// Inputs       : ip - the input position, moved past the continuation
+//                end - the end of the input
+//                length - the length so far, increased by the continuation
+// Outputs      : 0 if successful, -1 if the input ends first
+
+static int get_length(const uint8_t **ip, const uint8_t *end, uint32_t *length) {
+
+	uint8_t byte;
+
+	do {
+		if( *ip >= end )
+			return -1; // ERROR - the block ends inside a length
+		byte = *(*ip)++;
+		*length += byte;
+	} while( byte == 255 );
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lz_compress
+// Description  : Compresses a buffer, finding copies through a table of the
+//                last position each four byte prefix was seen at.  Long runs
+//                without a copy search more sparsely, so data that does not
+//                compress passes through quickly.
+//
+// Inputs       : src - the bytes to compress
+//                srcLen - the number of bytes
+//                dst - the buffer for the compressed block
+//                dstCap - the size of dst
+// Outputs      : the compressed length, -1 if it would not fit in dstCap
+
+int32_t crud_lz_compress(const void *src, int32_t srcLen, void *dst, int32_t dstCap) {
+
+	const uint8_t *in = src;
+	uint8_t *op = dst, *end = op + ((dstCap > 0) ? dstCap : 0);
+	uint32_t table[1 << CRUD_LZ_HASH_BITS];
+	uint32_t ip = 0, anchor = 0, candidate, slot, length;
+
+	if( srcLen < 0 || dstCap < 1 )
+		return -1; // ERROR - there is no room for even an empty block
+
+	memset(table, 0, sizeof(table));
+	while( ip + CRUD_LZ_MIN_MATCH <= (uint32_t)srcLen ) {
+
+		slot = hash_word(read32(&in[ip]));
+		candidate = table[slot];
+		table[slot] = ip;
+
+		if( candidate >= ip || ip - candidate > CRUD_LZ_MAX_OFFSET || read32(&in[candidate]) != read32(&in[ip]) ) {
+			ip += 1 + ((ip - anchor) >> CRUD_LZ_SKIP_SHIFT);
+			continue;
+		}
+
+		// Extend the copy as far as it goes
+		length = CRUD_LZ_MIN_MATCH;
+		while( ip + length < (uint32_t)srcLen && in[candidate + length] == in[ip + length] )
+			length++;
+
+		if( put_sequence(&op, end, &in[anchor], ip - anchor, ip - candidate, length) )
+			return -1; // ERROR - the block does not fit
+		ip += length;
+		anchor = ip;
+	}
+
+	// Whatever is left over is sent as literals
+	if( put_sequence(&op, end, &in[anchor], srcLen - anchor, 0, 0) )
+		return -1; // ERROR - the block does not fit
+
+	return (int32_t)(op - (uint8_t *)dst);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_lz_decompress
+// Description  : Expands a block made by crud_lz_compress, checking every
+//                length and offset against the buffers
+//
+// Inputs       : src - the compressed block
+//                srcLen - the length of the block
+//                dst - the buffer for the expanded bytes
+//                dstCap - the size of dst
+// Outputs      : the expanded length, -1 if the block is corrupt or too large
+
+int32_t crud_lz_decompress(const void *src, int32_t srcLen, void *dst, int32_t dstCap) {
+
+	const uint8_t *ip = src, *end = ip + ((srcLen > 0) ? srcLen : 0);
+	uint8_t *out = dst, *op = dst;
+	uint32_t litLen, matchLen, offset;
+	uint8_t token;
+
+	if( srcLen < 1 || dstCap < 0 )
+		return -1; // ERROR - there is no block
+
+	while( ip < end ) {
+
+		token = *ip++;
+
+		litLen = token >> 4;
+		if( litLen == CRUD_LZ_NIBBLE && get_length(&ip, end, &litLen) )
+			return -1; // ERROR - the block is corrupt
+		if( litLen > (uint32_t)(end - ip) || litLen > (uint32_t)(dstCap - (op - out)) )
+			return -1; // ERROR - the literals run past either buffer
+		memcpy(op, ip, litLen);
+		ip += litLen;
+		op += litLen;
+
+		// The last sequence ends with its literals
+		if( ip == end )
+			break;
+
+		if( end - ip < 2 )
+			return -1; // ERROR - the block ends inside an offset
+		offset = ip[0] | (uint32_t)ip[1] << 8;
+		ip += 2;
+		if( offset == 0 || offset > (uint32_t)(op - out) )
+			return -1; // ERROR - the copy starts before the output
+
+		matchLen = token & CRUD_LZ_NIBBLE;
+		if( matchLen == CRUD_LZ_NIBBLE && get_length(&ip, end, &matchLen) )
+			return -1; // ERROR - the block is corrupt
+		matchLen += CRUD_LZ_MIN_MATCH;
+		if( matchLen > (uint32_t)(dstCap - (op - out)) )
+			return -1; // ERROR - the copy runs past the output
+
+		// Copies may overlap what they produce, so go a byte at a time when they do
+		if( offset >= matchLen ) {
+			memcpy(op, op - offset, matchLen);
+			op += matchLen;
+		} else {
+			for( ; matchLen > 0; matchLen--, op++ )
+				*op = *(op - offset);
+		}
+	}
+
+	return (int32_t)(op - out);
+}
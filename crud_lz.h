@@ -0,0 +1,35 @@
+#ifndef CRUD_LZ_INCLUDED
+#define CRUD_LZ_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_lz.h
+//  Description    : This is the interface for the LZ codec used to compress the
+//                   objects of compressed files.  A block is a list of
+//                   sequences, each a run of literal bytes followed by a copy
+//                   of earlier output.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Interface functions
+
+int32_t crud_lz_compress(const void *src, int32_t srcLen, void *dst, int32_t dstCap);
+	// Compresses "src" into "dst", returns the compressed length or -1 if it does not fit
+
+int32_t crud_lz_decompress(const void *src, int32_t srcLen, void *dst, int32_t dstCap);
+	// Expands a compressed block into "dst", returns its length or -1 if the block is corrupt
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef CRUD_SHA256_INCLUDED
+#define CRUD_SHA256_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : crud_sha256.h
+//  Description    : This is the interface for the SHA-256 digest used to
+//                   fingerprint the stripes of deduplicated files.
+//
+//  Author         : Michael Onjack
+//
+
+// Includes
+#include <stdint.h>
+#include <stddef.h>
+
+// Defines
+#define CRUD_SHA256_SIZE 32 // Bytes in a digest
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Type for a digest in progress
+typedef struct {
+	uint32_t state[8];  // Hash of the blocks consumed so far
+	uint64_t length;    // Bytes consumed so far
+	uint8_t  block[64]; // Bytes waiting for a full block
+} CrudSha256;
+
+//
+// Interface functions
+
+void crud_sha256_init(CrudSha256 *ctx);
+	// Starts a new digest
+
+void crud_sha256_update(CrudSha256 *ctx, const void *data, size_t len);
+	// Adds "len" bytes to the digest
+
+void crud_sha256_final(CrudSha256 *ctx, uint8_t digest[CRUD_SHA256_SIZE]);
+	// Finishes the digest and writes it out
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
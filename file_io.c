@@ -10,10 +10,19 @@
 
 // Includes
 #include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
 
 // Project Includes
 #include <crud_file_io.h>
+#include <crud_file_io_ext.h>
+#include <crud_driver_ext.h>
+#include <crud_lz.h>
+#include <crud_sha256.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 #include <crud_network.h>
@@ -21,6 +30,45 @@
 // Defines
 #define CIO_UNIT_TEST_MAX_WRITE_SIZE 1024
 #define CRUD_IO_UNIT_TEST_ITERATIONS 10240
+#define CRUD_MAX_OPEN_FILES 1024 // Maximum number of simultaneously open file handles
+#define CRUD_MAX_FILE_OPENS 255 // Maximum number of handles open on one file (limit of the open field)
+#define CRUD_AT_POSITION -1 // Offset meaning "at the handle's current position"
+#define CRUD_STRIPE_SIZE (CRUD_MAX_OBJECT_SIZE/8) // Bytes of a file held by each of its objects
+#define CRUD_MAX_FILE_STRIPES 8 // Most objects one file is spread across
+#define CRUD_MAX_FILE_SIZE (CRUD_STRIPE_SIZE*CRUD_MAX_FILE_STRIPES) // Largest file the layout can describe
+#define CRUD_IO_WORKERS 4 // Threads moving the stripes of reads and writes that span several
+#define CRUD_FILE_TABLE_SIZE (sizeof(CrudFileAllocationType)*CRUD_MAX_TOTAL_FILES) // Bytes of crud_file_table
+#define CRUD_LAYOUT_TABLE_SIZE (sizeof(CrudFileLayoutType)*CRUD_MAX_TOTAL_FILES) // Bytes of crud_layout_table
+#define CRUD_CODEC_TABLE_SIZE (sizeof(CrudFileCodecType)*CRUD_MAX_TOTAL_FILES) // Bytes of crud_codec_table
+#define CRUD_MAX_CHUNKS (CRUD_MAX_TOTAL_FILES*CRUD_MAX_FILE_STRIPES) // Slots in the chunk index, one per possible stripe
+#define CRUD_CHUNK_FILL (CRUD_MAX_CHUNKS/4*3) // Most chunks indexed at once, so probes stay short
+#define CRUD_CHUNK_FINGERPRINT 16 // Leading bytes of a stripe's SHA-256 kept as its fingerprint
+#define CRUD_CHUNK_TABLE_SIZE (sizeof(CrudChunkType)*CRUD_MAX_CHUNKS) // Bytes of crud_chunk_table
+#define CRUD_SPARSE_PAGES 32 // Pages a stripe is split into when looking for holes, one bit each
+#define CRUD_SPARSE_PAGE (CRUD_STRIPE_SIZE/CRUD_SPARSE_PAGES) // Bytes of a page, which is only stored if it holds a nonzero byte
+#define CRUD_EXTENT_TABLE_SIZE (sizeof(CrudFileExtentType)*CRUD_MAX_TOTAL_FILES) // Bytes of crud_extent_table
+#define CRUD_MAX_SEGMENTS 8 // Most appends a file in append mode holds as segments before they are merged
+#define CRUD_SEGMENT_MERGE (CRUD_MAX_SEGMENTS/2) // Segments at which a background merge is queued
+#define CRUD_SEGMENT_LIMIT (CRUD_STRIPE_SIZE/4) // Largest append stored as a segment
+#define CRUD_SEGMENT_TABLE_SIZE (sizeof(CrudFileSegmentType)*CRUD_MAX_TOTAL_FILES) // Bytes of crud_segment_table
+#define CRUD_PACK_SIZE CRUD_STRIPE_SIZE // Most bytes in a container object shared by small files
+#define CRUD_PACK_LIMIT (CRUD_PACK_SIZE/32) // Largest file stored in a container
+#define CRUD_PACK_CACHE 8 // Containers kept in memory once read
+#define CRUD_PACK_TABLE_SIZE (sizeof(CrudFilePackType)*CRUD_MAX_TOTAL_FILES) // Bytes of crud_pack_table
+#define CRUD_INLINE_TABLE_SIZE (sizeof(CrudFileInlineType)*CRUD_MAX_TOTAL_FILES) // Bytes of crud_inline_table
+#define CRUD_MAX_DIRECTORIES 256 // Most directories, the root included
+#define CRUD_DIRECTORY_DEGREE 16 // Minimum degree of the B-tree of a directory's entries
+#define CRUD_DIRECTORY_KEYS (2*CRUD_DIRECTORY_DEGREE-1) // Most entries in one node of the B-tree
+#define CRUD_MAX_OPEN_DIRECTORIES 64 // Most directory streams open at once
+#define CRUD_DIRECTORY_TABLE_SIZE (sizeof(CrudDirectoryType)*CRUD_MAX_DIRECTORIES) // Bytes of crud_directory_table
+#define CRUD_WRITEBACK_SIZE CRUD_STRIPE_SIZE // Most bytes of one file held in memory before they are stored
+#define CRUD_WRITEBACK_LIMIT (CRUD_WRITEBACK_SIZE/4) // Largest write held in memory, larger ones are stored at once
+#define CRUD_WRITEBACK_MIN 4096 // Smallest buffer allocated for a file's bytes held in memory
+#define CRUD_RECLAIM_BATCH 64 // Objects waiting for deletion at which the flusher saves the tables to delete them
+#define CRUD_GC_LIST_SIZE (CRUD_MAX_OBJECT_SIZE/16) // Bytes of object ids asked for by each LIST
+#define CRUD_PRIORITY_SIZE (CRUD_FILE_TABLE_SIZE+CRUD_LAYOUT_TABLE_SIZE+CRUD_CODEC_TABLE_SIZE+CRUD_CHUNK_TABLE_SIZE+CRUD_EXTENT_TABLE_SIZE+CRUD_SEGMENT_TABLE_SIZE+CRUD_PACK_TABLE_SIZE+CRUD_INLINE_TABLE_SIZE+CRUD_DIRECTORY_TABLE_SIZE) // Bytes of the saved tables
+#define CRUD_HUGE_PAGE_SIZE (2*1024*1024) // Staging areas this large are backed by huge pages
+#define CRUD_COMPLETION_POOL 64 // Finished completions kept for reuse
 
 // Other definitions
 
@@ -32,9 +80,340 @@ typedef enum {
 	CIO_UNIT_TEST_SEEK   = 3,
 } CRUD_UNIT_TEST_TYPE;
 
+// Type for an open file description, one per successful crud_open
+typedef struct {
+	int16_t         file;     // Index of the file entry in crud_file_table, -1 if the handle is free
+	uint32_t        position; // Current position of this handle in the file
+	pthread_mutex_t lock;     // Serializes reads and writes that move the position
+} CrudOpenFileType;
+
+// Type for the layout of a file's data across objects.  Byte b of a file lives in
+// stripe b/CRUD_STRIPE_SIZE, and each stripe is held by its own object.
+typedef struct {
+	CrudOID stripes[CRUD_MAX_FILE_STRIPES-1]; // Object of each stripe after the first, whose object is object_id
+} CrudFileLayoutType;
+
+// Type for how a file's stripes are stored.  The raw length of each stripe follows
+// from the file length; a stripe stored compressed also records its object's length.
+typedef struct {
+	uint8_t  codec;                         // Codec later writes store stripes with, CRUD_CODEC_*
+	uint8_t  dedup;                         // Nonzero if later writes share stripes already stored
+	uint8_t  indexed;                       // Bit per stripe whose object is in crud_chunk_table
+	uint32_t stored[CRUD_MAX_FILE_STRIPES]; // Bytes of each stripe's compressed object, 0 if stored raw
+} CrudFileCodecType;
+
+// Type for a stripe object that deduplicated files may share.  The chunk index is
+// open addressed on the fingerprint, so equal stripes written by any file find it.
+typedef struct {
+	uint8_t  fingerprint[CRUD_CHUNK_FINGERPRINT]; // Digest of the stripe's raw bytes
+	CrudOID  object;                              // The object holding the stripe
+	uint32_t stored;                              // As in CrudFileCodecType, 0 if stored raw
+	uint32_t refs;                                // File stripes using the object, 0 if the slot is free
+} CrudChunkType;
+
+// Type for the holes of a file.  A page of a stripe that is all zeros is left
+// out of the stripe's object, which holds the other pages back to back, and a
+// stripe with no object is a hole throughout.
+typedef struct {
+	uint32_t holes[CRUD_MAX_FILE_STRIPES]; // Bit per page of each stripe that reads as zeros without being stored
+} CrudFileExtentType;
+
+// Type for the appends of a file in append mode that are not yet in its stripes.
+// Each small append is stored as a segment object of its own, and the segments
+// hold the end of the file in order, after the bytes in the stripes.
+typedef struct {
+	uint8_t  append;                       // Nonzero if small appends are stored as segments
+	uint8_t  count;                        // Number of segments
+	uint32_t bytes;                        // Bytes held by the segments
+	CrudOID  objects[CRUD_MAX_SEGMENTS];   // Object of each segment
+	uint32_t lengths[CRUD_MAX_SEGMENTS];   // Bytes of each segment
+} CrudFileSegmentType;
+
+// Type for where a small file in pack mode is stored.  Instead of stripes of its
+// own, such a file is a range of a container object it shares with other small
+// files, written together.  The file's length is the length of the range.
+typedef struct {
+	uint8_t  pack;      // Nonzero if the file is stored in a container while it is small
+	CrudOID  container; // The container holding the file, CRUD_NO_OBJECT if it is in its stripes
+	uint32_t offset;    // Offset of the file's first byte in the container
+	uint32_t size;      // Bytes of the container
+} CrudFilePackType;
+
+// Type for the bytes of a tiny file, kept in the tables instead of in objects so
+// reading or writing it costs no requests.  Bytes past the file's length are zero.
+typedef struct {
+	uint8_t inlined;               // Nonzero if the file's bytes are held here, when it has no objects
+	char    data[CRUD_INLINE_MAX]; // The file's bytes
+} CrudFileInlineType;
+
+// Type for a container in use, rebuilt from crud_pack_table when the tables are loaded
+typedef struct {
+	CrudOID  object; // The container, CRUD_NO_OBJECT if the slot is free
+	uint32_t size;   // Bytes of the container
+	uint32_t live;   // Bytes of it still holding a file
+	uint32_t files;  // Files stored in it
+} CrudContainerType;
+
+// Type for a container kept in memory once read.  A container is never changed
+// after it is created, so a copy stays valid until the container is let go of.
+typedef struct {
+	CrudOID   object; // The container, CRUD_NO_OBJECT if the slot is free
+	char     *data;   // Its bytes
+	uint64_t  used;   // When it was last read from, in crud_container_ticks
+} CrudContainerCacheType;
+
+// Type for an entry of a directory, naming a file or a directory in it
+typedef struct {
+	char    name[CRUD_MAX_PATH_LENGTH]; // The last component of the entry's path
+	int16_t file;      // Index of the file in crud_file_table, -1 for a directory
+	int16_t directory; // Index of the directory in crud_directory_table, -1 for a file
+} CrudDirectoryEntryType;
+
+// Type for a node of the B-tree of a directory's entries, stored as an object of
+// its own.  A node is never changed once stored: a changed node is stored again
+// as a new object when the tables are saved, so the saved tables always name a
+// whole tree.
+typedef struct {
+	uint16_t count; // Entries in the node
+	uint8_t  leaf;  // Nonzero if the node has no children
+	CrudDirectoryEntryType entries[CRUD_DIRECTORY_KEYS]; // The entries in order of their names
+	CrudOID  children[CRUD_DIRECTORY_KEYS+1]; // The child before each entry and the one after the last
+} CrudDirectoryNodeType;
+
+// Type for a directory.  Its entries are the B-tree whose root node is "root".
+typedef struct {
+	uint8_t used;   // Nonzero if the directory exists
+	int16_t parent; // The directory holding it, -1 for the root directory
+	CrudOID root;   // Root node of its entries, CRUD_NO_OBJECT if none was stored
+	char    name[CRUD_MAX_PATH_LENGTH]; // Its entry's name in the parent
+} CrudDirectoryType;
+
+// Type for a node of a directory's B-tree in memory.  Nodes are read when they
+// are first needed and kept until the next format or mount.
+typedef struct CrudDirectoryNode {
+	CrudOID object; // The object the node was last stored as, CRUD_NO_OBJECT if none
+	uint8_t dirty;  // Nonzero if the node changed since it was stored
+	CrudDirectoryNodeType stored; // The node as stored, children named by their objects
+	struct CrudDirectoryNode *children[CRUD_DIRECTORY_KEYS+1]; // Children read so far, NULL until needed
+} CrudDirectoryNode;
+
+// Type for an open directory stream.  It remembers the last name returned, so
+// entries added while it is open never make it skip or repeat one.
+typedef struct {
+	uint8_t used;      // Nonzero if the stream is open
+	uint8_t started;   // Nonzero once an entry was returned
+	int16_t directory; // The directory being read
+	char    last[CRUD_MAX_PATH_LENGTH]; // Name of the last entry returned
+} CrudDirectoryStreamType;
+
+// Type for the bytes written to a file that are held in memory until they are
+// stored.  They form one run that starts no later than the stored end of the
+// file, and the tables describe the file without them until it is stored.
+typedef struct {
+	char     *data;     // Buffer holding the run, NULL if none is allocated
+	uint32_t  capacity; // Bytes allocated for data
+	uint32_t  start;    // Offset in the file of the first byte of the run
+	uint32_t  end;      // One past the offset in the file of the last byte of the run
+	uint64_t  since;    // When the run was started, in nanoseconds of CLOCK_MONOTONIC
+	uint8_t   dirty;    // Nonzero while there is a run, read by the flusher without the file's lock
+} CrudFileDirtyType;
+
+// Type for one piece of work queued for the I/O worker pool
+typedef struct CrudWorkItem {
+	void (*run)(struct CrudWorkItem *item); // Does the work, after which the item may be freed
+	struct CrudWorkItem *next;              // Next item in the same queue
+} CrudWorkItem;
+
+// Type for moving one stripe of a read or write
+typedef struct CrudStripeTask {
+	CrudWorkItem work;      // Queue linkage, must come first
+	int16_t      file;      // Index of the file in crud_file_table
+	uint32_t     stripe;    // Index of the stripe within the file
+	uint32_t     start;     // First byte of the stripe touched by the operation
+	uint32_t     end;       // One past the last byte of the stripe touched by the operation
+	uint32_t     oldLength; // Length of the stripe before the operation
+	uint32_t     newLength; // Length of the stripe after the operation
+	uint8_t      write;     // Nonzero to write the stripe, zero to read it
+	struct iovec *iov;      // The caller's buffers covering [start,end)
+	int          iovcnt;    // Number of buffers in iov
+	int          result;    // 0 once the stripe was moved successfully, -1 if failure
+	struct CrudStripeBatch *batch; // The operation the stripe belongs to
+} CrudStripeTask;
+
+// Type for tracking the stripes of one operation handed to the worker pool
+typedef struct CrudStripeBatch {
+	pthread_mutex_t lock;    // Guards pending
+	pthread_cond_t  done;    // Signalled when pending reaches zero
+	int             pending; // Number of stripes the workers have yet to move
+} CrudStripeBatch;
+
+// Type for the staging buffers a thread keeps between operations, so moving a
+// stripe never allocates
+typedef struct {
+	char         *stripe;  // Receives the parts of a stripe outside a read or write
+	char         *packed;  // Holds a stripe's object while it is compressed or expanded
+	char         *copy;    // Holds a stripe of a range copied through the client
+	struct iovec *slices;  // Slices of the caller's buffers, CRUD_MAX_IOVECS per stripe
+	size_t        size;    // Bytes mapped for the arena
+} CrudThreadArena;
+
+// Type for the asynchronous operations
+typedef enum {
+	CRUD_ASYNC_OPEN  = 0,
+	CRUD_ASYNC_READ  = 1,
+	CRUD_ASYNC_WRITE = 2,
+} CRUD_ASYNC_TYPE;
+
+// Type for an asynchronous operation and its completion
+struct CrudCompletion {
+	CrudWorkItem    work;     // Queue linkage, must come first
+	CRUD_ASYNC_TYPE type;     // The operation to run
+	int16_t         fd;       // File handle to read or write
+	void           *buf;      // Buffer to read into or write from
+	int32_t         count;    // Number of bytes to read or write
+	char            path[CRUD_MAX_PATH_LENGTH]; // Path to open
+	CrudCompletionCallback callback; // Called on completion if not NULL
+	void           *arg;      // Passed to the callback
+	int32_t         result;   // Return value of the operation once done
+	uint8_t         done;     // Nonzero once the operation and its callback have finished
+	uint8_t         refs;     // References held by the caller and the worker pool
+	pthread_mutex_t lock;     // Guards done and refs
+	pthread_cond_t  finished; // Signalled when done is set
+};
+
 // File system Static Data
 // This the definition of the file table
-CrudFileAllocationType crud_file_table[CRUD_MAX_TOTAL_FILES]; // The file handle table
+CrudFileAllocationType crud_file_table[CRUD_MAX_TOTAL_FILES]; // The file entry table
+CrudFileLayoutType crud_layout_table[CRUD_MAX_TOTAL_FILES]; // The stripe objects of each file, saved after the file table
+CrudFileCodecType crud_codec_table[CRUD_MAX_TOTAL_FILES]; // How each file's stripes are stored, saved after the layouts
+CrudChunkType crud_chunk_table[CRUD_MAX_CHUNKS]; // Index of shared stripe objects, saved after the codecs
+CrudFileExtentType crud_extent_table[CRUD_MAX_TOTAL_FILES]; // The holes of each file, saved after the chunk index
+CrudFileSegmentType crud_segment_table[CRUD_MAX_TOTAL_FILES]; // The appended segments of each file, saved after the extents
+CrudFilePackType crud_pack_table[CRUD_MAX_TOTAL_FILES]; // Where each small file is packed, saved after the segments
+CrudFileInlineType crud_inline_table[CRUD_MAX_TOTAL_FILES]; // The bytes of each tiny file, saved after the packs
+CrudDirectoryType crud_directory_table[CRUD_MAX_DIRECTORIES]; // The directories, saved after the inline table
+CrudOpenFileType crud_open_table[CRUD_MAX_OPEN_FILES]; // The open file handle table
+
+// The I/O worker pool and its queues.  Stripes of operations already in progress are
+// always taken before asynchronous operations that have not started.
+static pthread_once_t crud_workers_once = PTHREAD_ONCE_INIT;
+static int crud_io_workers = 0; // Number of workers that started
+static pthread_mutex_t crud_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t crud_queue_ready = PTHREAD_COND_INITIALIZER;
+static CrudWorkItem *crud_stripe_head = NULL, *crud_stripe_tail = NULL;
+static CrudWorkItem *crud_async_head = NULL, *crud_async_tail = NULL;
+static CrudWorkItem *crud_completion_pool = NULL; // Finished completions, guarded by crud_queue_lock
+static int crud_pooled_completions = 0;
+
+// Background merges of segments, one queued per file at most, guarded by crud_queue_lock
+static CrudWorkItem crud_merge_work[CRUD_MAX_TOTAL_FILES];
+static uint8_t crud_merge_queued[CRUD_MAX_TOTAL_FILES];
+static int crud_merges_pending = 0;
+static pthread_cond_t crud_merges_done = PTHREAD_COND_INITIALIZER; // Signalled when no merge is pending
+
+// Containers of small files, guarded by crud_container_lock, which is taken after any
+// other lock.  Each packed file refers to its container's slot.
+static pthread_mutex_t crud_container_lock = PTHREAD_MUTEX_INITIALIZER;
+static CrudContainerType crud_containers[CRUD_MAX_TOTAL_FILES];
+static uint16_t crud_container_slot[CRUD_MAX_TOTAL_FILES]; // Slot of each packed file's container, guarded by the file's lock
+static CrudContainerCacheType crud_container_cache[CRUD_PACK_CACHE];
+static uint64_t crud_container_ticks = 0;
+
+// Directories in memory, guarded by crud_directory_lock
+static CrudDirectoryNode *crud_directory_trees[CRUD_MAX_DIRECTORIES]; // Root node of each directory, NULL until needed
+static CrudDirectoryStreamType crud_directory_streams[CRUD_MAX_OPEN_DIRECTORIES];
+
+// The files in order of their paths, rebuilt when the tables are loaded and guarded by crud_table_lock
+static int16_t crud_name_index[CRUD_MAX_TOTAL_FILES];
+static uint16_t crud_names_indexed = 0;
+
+// Length up to which files are kept in the tables, read and set atomically
+static uint32_t crud_inline_limit = CRUD_INLINE_MAX;
+
+// Write-back of small writes.  Each file's run is guarded by the file's lock, and the
+// tunables and counters by crud_writeback_lock, which is taken after any file lock.
+static CrudFileDirtyType crud_dirty_table[CRUD_MAX_TOTAL_FILES];
+static pthread_mutex_t crud_writeback_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t crud_writeback_wake = PTHREAD_COND_INITIALIZER; // Signalled to start a flusher pass early
+static pthread_t crud_flusher_thread;
+static uint8_t crud_flusher_started = 0; // Set while the flusher is running, so runs cannot be left behind
+static uint8_t crud_flusher_stopped = 0; // Set by unmount until the next format or mount, which holds the flusher off
+static CrudWritebackTunables crud_writeback_tunables = {
+	8*1024*1024, // dirty_bytes
+	2*1024*1024, // dirty_background_bytes
+	500,         // dirty_expire_ms
+	100,         // writeback_interval_ms
+};
+static CrudWritebackStats crud_writeback_counters;
+
+// Deferred deletion.  An object a file lets go of may still be named by the tables last
+// saved, so it is only deleted once a later save no longer names it.  The objects wait
+// in a ring in the order they were retired, guarded by crud_reclaim_lock.
+static pthread_mutex_t crud_reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t crud_reclaim_idle = PTHREAD_COND_INITIALIZER; // Signalled when no deletion is in progress
+static CrudOID *crud_reclaim_ring = NULL; // The object retired n-th is at n % crud_reclaim_size
+static uint32_t crud_reclaim_size = 0;
+static uint64_t crud_reclaim_head = 0; // Number of the oldest object waiting
+static uint64_t crud_reclaim_tail = 0; // Number the next object retired gets
+static uint64_t crud_reclaim_safe = 0; // Objects numbered below this are named by no saved table
+static int crud_reclaims_running = 0; // Deletions taken off the ring and not yet finished
+static uint8_t crud_gc_listing = 0; // Set while a garbage collection pass lists the store, which holds off deletions
+
+// Garbage collection.  A pass lists the objects on the store, then marks those the
+// tables or the retired objects name, and the rest are orphans the flusher deletes a
+// batch at a time.  The orphans, tunables and counters are guarded by crud_gc_lock,
+// which is taken after any other lock, and one pass runs at a time.
+static pthread_mutex_t crud_gc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t crud_gc_pass_lock = PTHREAD_MUTEX_INITIALIZER;
+static CrudOID *crud_gc_orphans = NULL; // Orphans found by the last pass
+static uint32_t crud_gc_count = 0; // Number of orphans found by the last pass
+static uint32_t crud_gc_next = 0; // Index of the next orphan to delete
+static uint64_t crud_gc_epoch = 0; // Changed by format, mount and unmount, so a pass they overlap finds nothing
+static uint64_t crud_gc_last = 0; // When the last pass finished, in nanoseconds of CLOCK_MONOTONIC, 0 if none since mount
+static uint8_t crud_gc_mounted = 0; // Set from a mount to the next unmount, as only then do the tables describe the store
+static CrudGcTunables crud_gc_tunables = {
+	60000, // gc_interval_ms
+	32,    // gc_batch
+};
+static CrudGcStats crud_gc_counters;
+
+// Staging buffers.  Each thread gets its own arena the first time it moves a stripe,
+// and the table image is shared by mount and unmount, which serialize on its lock.
+static pthread_key_t crud_arena_key;
+static pthread_once_t crud_arena_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t crud_image_lock = PTHREAD_MUTEX_INITIALIZER;
+static char crud_table_image[CRUD_PRIORITY_SIZE];
+static uint32_t crud_priority_length = CRUD_PRIORITY_SIZE; // Size of the priority object on the device
+static uint8_t crud_image_saved = 0; // Set while the image holds what the priority object does
+
+// Group commit of the tables.  Each sync takes a ticket, and one caller at a time saves
+// the tables for every ticket handed out before it started, guarded by crud_sync_lock.
+static pthread_mutex_t crud_sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t crud_sync_done = PTHREAD_COND_INITIALIZER; // Signalled when a save finishes
+static uint64_t crud_sync_requested = 0; // Last ticket handed out
+static uint64_t crud_sync_completed = 0; // Last ticket whose save succeeded
+static uint64_t crud_sync_failed = 0; // Last ticket whose save failed
+static uint8_t crud_sync_running = 0; // Set while a caller is saving the tables
+
+// crud_chunk_lock guards the chunk index, which stripes of any file may update
+static pthread_mutex_t crud_chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+static int crud_chunks_used = 0;
+static int crud_chunks_reserved = 0; // Entries held by clones until they share their source's stripes
+
+// Locking
+// crud_directory_lock guards the directories, whose nodes are read and stored under it
+// alone.  crud_table_lock guards file names, open counts and handle allocation, while
+// each file entry's object and length are guarded by its own reader/writer lock.  Locks
+// are always taken in the order: directory, table, handle, file, so no two paths can
+// deadlock.
+static pthread_mutex_t crud_directory_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t crud_table_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t crud_file_locks[CRUD_MAX_TOTAL_FILES];
+static pthread_once_t crud_tables_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t crud_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Pick up the vectored client operation from the client side of the protocol
+CrudResponse crud_client_operation_v(CrudRequest op, const struct iovec *iov, int iovcnt);
 
 // Pick up these definitions from the unit test of the crud driver
 CrudRequest construct_crud_request(CrudOID oid, CRUD_REQUEST_TYPES req,
@@ -95,161 +474,239 @@ void extract_crud_response(CrudResponse response, uint32_t *object_id, uint8_t *
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_format
-// Description  : This function formats the crud drive, and adds the file
-//                allocation table.
+// Function     : init_tables
+// Description  : Creates the handle and file locks and marks every handle free,
+//                run exactly once before the tables are first used
+//
+// Inputs       : none
+// Outputs      : none
+
+static void init_tables(void) {
+
+	int i;
+
+	for( i=0; i<CRUD_MAX_OPEN_FILES; i++ ) {
+		pthread_mutex_init(&crud_open_table[i].lock, NULL);
+		crud_open_table[i].file = -1;
+	}
+	for( i=0; i<CRUD_MAX_TOTAL_FILES; i++ )
+		pthread_rwlock_init(&crud_file_locks[i], NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_initialize
+// Description  : Initializes the object store on first use.  Only one thread
+//                sends the INIT, later callers see the flag without locking,
+//                and a failed INIT is retried by the next caller.
 //
 // Inputs       : none
 // Outputs      : 0 if successful, -1 if failure
 
-uint16_t crud_format(void) {
-	
-	int i, priorityOID=0; // The object id of the priority object
-	int prioritySize = sizeof(CrudFileAllocationType)*CRUD_MAX_TOTAL_FILES; // Size of priority object
+static int crud_initialize(void) {
+
 	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
-	uint32_t id, length; // variables needed for extract_crud_response function 
-	void *buf = malloc(prioritySize); // buffer to hold file allocation table
+	uint32_t id, length; // variables needed for extract_crud_response function
 	CrudResponse response;
 	CrudRequest request;
 
+	pthread_once(&crud_tables_once, init_tables);
+
 	// Determine if the object store has been initialized yet
+	if( __atomic_load_n(&INITIALIZED, __ATOMIC_ACQUIRE) )
+		return 0;
+
+	pthread_mutex_lock(&crud_init_lock);
 	if( !INITIALIZED ) {
-		
+
 		// Initialize object store
 		request = create_crud_request(0, CRUD_INIT, 0, 0, 0);
 		response = crud_client_operation(request, NULL);
-		
+
 		// Check for CRUD command success
 		extract_crud_response(response, &id, &req, &length, &flag, &result);
-		
-		if( result ) 
-			return -1; // ERROR - result code is 1 meaning there was a failure 
-		
+		if( result ) {
+			pthread_mutex_unlock(&crud_init_lock);
+			return -1; // ERROR - result code is 1 meaning there was a failure
+		}
+
 		// Set INITIALIZED to true to show the object store has now been initialized
-		INITIALIZED = 1;
+		__atomic_store_n(&INITIALIZED, 1, __ATOMIC_RELEASE);
 	}
+	pthread_mutex_unlock(&crud_init_lock);
 
-	// Delete crud_content.crd and all objects in the object store
-	request = create_crud_request(0, CRUD_FORMAT, 0, CRUD_NULL_FLAG, 0);
-	response = crud_client_operation(request, NULL);
+	return 0;
+}
 
-	// Check for CRUD command success
-	extract_crud_response(response, &id, &req, &length, &flag, &result);
-	if( result )
-		return -1; // ERROR - result code is 1 meaning there was a failure 
-	
-	// Initialize the file allocation table with all zeros
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : reset_open_table
+// Description  : Marks every file handle as free and every file entry as
+//                closed, called with crud_table_lock held
+//
+// Inputs       : none
+// Outputs      : none
+
+static void reset_open_table(void) {
+
+	int i;
+
+	for( i=0; i<CRUD_MAX_OPEN_FILES; i++ ) {
+		__atomic_store_n(&crud_open_table[i].file, -1, __ATOMIC_RELEASE);
+		crud_open_table[i].position = 0;
+	}
+
+	// The open field of a file entry counts the handles open on it, which do not survive a mount
 	for( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
-		
-		memset(crud_file_table[i].filename,0,CRUD_MAX_PATH_LENGTH);
-		crud_file_table[i].object_id = CRUD_NO_OBJECT;
-		crud_file_table[i].position = 0;
-		crud_file_table[i].length = 0;
 		crud_file_table[i].open = 0;
+		crud_file_table[i].position = 0;
 	}
+}
 
-	// Copy table data into buf
-	memcpy(buf,crud_file_table,prioritySize);
-	// Create priority object containing the table data
-	request = create_crud_request(priorityOID, CRUD_CREATE, prioritySize, CRUD_PRIORITY_OBJECT, 0);
-	response = crud_client_operation(request, buf);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : wait_for_merges
+// Description  : Waits until no background merge of segments is queued or
+//                running, so the tables can be replaced under them
+//
+// Inputs       : none
+// Outputs      : none
 
-	// Check for CRUD command success
-	extract_crud_response(response, &id, &req, &length, &flag, &result);
-	if( result )
-		return -1; // ERROR - result code is 1 meaning there was a failure
+static void wait_for_merges(void) {
 
-	free(buf);
-	buf = NULL;
+	pthread_mutex_lock(&crud_queue_lock);
+	while( crud_merges_pending > 0 )
+		pthread_cond_wait(&crud_merges_done, &crud_queue_lock);
+	pthread_mutex_unlock(&crud_queue_lock);
+}
 
-	// Log, return successfully
-	logMessage(LOG_INFO_LEVEL, "... formatting complete.");
-	return(0);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : discard_dirty_runs
+// Description  : Drops every file's bytes held in memory without storing
+//                them, so the tables can be replaced under them.  A flusher
+//                pass in progress on a file finishes first.
+//
+// Inputs       : none
+// Outputs      : none
+
+static void discard_dirty_runs(void) {
+
+	int i;
+	CrudFileDirtyType *dirty;
+
+	for( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
+		dirty = &crud_dirty_table[i];
+		pthread_rwlock_wrlock(&crud_file_locks[i]);
+		if( dirty->dirty ) {
+			pthread_mutex_lock(&crud_writeback_lock);
+			crud_writeback_counters.dirty_bytes -= dirty->end - dirty->start;
+			pthread_mutex_unlock(&crud_writeback_lock);
+			__atomic_store_n(&dirty->dirty, 0, __ATOMIC_RELEASE);
+		}
+		free(dirty->data);
+		dirty->data = NULL;
+		dirty->capacity = 0;
+		pthread_rwlock_unlock(&crud_file_locks[i]);
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_mount
-// Description  : This function mount the current crud file system and loads
-//                the file allocation table.
+// Function     : stop_flusher
+// Description  : Stops the background flusher once its pass in progress
+//                finishes, and keeps it from starting again until the next
+//                format or mount
 //
 // Inputs       : none
-// Outputs      : 0 if successful, -1 if failure
+// Outputs      : none
 
-uint16_t crud_mount(void) {
-	
-	int priorityOID=0; // The object id of the priority object
-	int tableSize = sizeof(CrudFileAllocationType)*CRUD_MAX_TOTAL_FILES;
-	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
-	uint32_t id, length; // variables needed for extract_crud_response function 
-	void *buf = malloc(tableSize); // Buffer to hold read priority object
-	CrudRequest request;
-	CrudResponse response;
+static void stop_flusher(void) {
 
-	// Determine if the object store has been initialized yet
-	if( !INITIALIZED ) {
-		// Initialize object store
-		request = create_crud_request(0, CRUD_INIT, 0, 0, 0);
-		response = crud_client_operation(request, NULL);
+	uint8_t running;
 
-		// Check for CRUD command success
-		extract_crud_response(response, &id, &req, &length, &flag, &result);
-		if( result )
-			return -1; // ERROR - result code is 1 meaning there was a failure 
-		
-		// Set INITIALIZED to true to show the object store has now been initialized
-		INITIALIZED = 1;
+	pthread_mutex_lock(&crud_writeback_lock);
+	crud_flusher_stopped = 1;
+	running = crud_flusher_started;
+	pthread_cond_broadcast(&crud_writeback_wake);
+	pthread_mutex_unlock(&crud_writeback_lock);
+
+	if( running ) {
+		pthread_join(crud_flusher_thread, NULL);
+		pthread_mutex_lock(&crud_writeback_lock);
+		__atomic_store_n(&crud_flusher_started, 0, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&crud_writeback_lock);
 	}
+}
 
-	request = create_crud_request(priorityOID, CRUD_READ, tableSize, CRUD_PRIORITY_OBJECT, 0);
-	response = crud_client_operation(request, buf);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : get_open_file
+// Description  : Validates a file handle and finds the open file description
+//                for it.  This takes no locks, so it never waits on I/O.
+//
+// Inputs       : fd - the file handle returned by crud_open
+//                file - set to the index of the file the handle is open on
+// Outputs      : pointer to the open file description, NULL if the handle is not open
 
-	// Check for CRUD command success
-	extract_crud_response(response, &id, &req, &length, &flag, &result);
-	if( result )
-		return -1; // ERROR - result code is 1 meaning there was a failure
+static CrudOpenFileType *get_open_file(int16_t fd, int16_t *file) {
 
-	// Copy contents of the file allocation table read from the priority object into crud_file_table structure
-	memcpy(crud_file_table,buf,tableSize);
+	if( fd < 0 || fd > CRUD_MAX_OPEN_FILES-1 )
+		return NULL; // ERROR - requested file handle out of range
 
-	free(buf);
-	buf = NULL;
+	pthread_once(&crud_tables_once, init_tables);
 
-	// Log, return successfully
-	logMessage(LOG_INFO_LEVEL, "... mount complete.");
-	return(0);
+	*file = __atomic_load_n(&crud_open_table[fd].file, __ATOMIC_ACQUIRE);
+	if( *file < 0 )
+		return NULL; // ERROR - requested file handle has not been opened
+
+	return &crud_open_table[fd];
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_unmount
-// Description  : This function unmounts the current crud file system and
-//                saves the file allocation table.
+// Function     : lock_open_file
+// Description  : Validates a file handle and locks it so its position can be
+//                used and moved
 //
-// Inputs       : none
+// Inputs       : fd - the file handle returned by crud_open
+//                file - set to the index of the file the handle is open on
+// Outputs      : pointer to the locked open file description, NULL if the handle is not open
+
+static CrudOpenFileType *lock_open_file(int16_t fd, int16_t *file) {
+
+	CrudOpenFileType *handle = get_open_file(fd, file);
+
+	if( handle == NULL )
+		return NULL; // ERROR - requested file handle is out of range or not open
+
+	// The handle may have been closed while waiting for the lock
+	pthread_mutex_lock(&handle->lock);
+	*file = handle->file;
+	if( *file < 0 ) {
+		pthread_mutex_unlock(&handle->lock);
+		return NULL; // ERROR - requested file handle has been closed
+	}
+
+	return handle;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : delete_object
+// Description  : Deletes one object from the object store
+//
+// Inputs       : oid - the object
 // Outputs      : 0 if successful, -1 if failure
 
-uint16_t crud_unmount(void) {
-	
-	int priorityOID=0; // The object id of the priority object
-	int tableSize = sizeof(CrudFileAllocationType)*CRUD_MAX_TOTAL_FILES;
-	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
-	uint32_t id, length; // variables needed for extract_crud_response function 
-	void *buf = malloc(tableSize); // Buffer to hold read priority object
-	memcpy(buf,crud_file_table,tableSize); // Copy file table contents to buffer
+static int delete_object(CrudOID oid) {
+
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
 	CrudRequest request;
 	CrudResponse response;
-	
-	// Update the priority object with the current file table
-	request = create_crud_request(priorityOID, CRUD_UPDATE, tableSize, CRUD_PRIORITY_OBJECT, 0);
-	response = crud_client_operation(request, buf);
-
-	// Check for CRUD command success
-	extract_crud_response(response, &id, &req, &length, &flag, &result);
-	if( result )
-		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
 
-	request = create_crud_request(0, CRUD_CLOSE, 0, 0, 0);
+	request = create_crud_request(oid, CRUD_DELETE, 0, 0, 0);
 	response = crud_client_operation(request, NULL);
 
 	// Check for CRUD command success
@@ -257,370 +714,6665 @@ uint16_t crud_unmount(void) {
 	if( result )
 		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
 
-	free(buf);
-	buf = NULL;
+	return 0;
+}
 
-	// Log, return successfully
-	logMessage(LOG_INFO_LEVEL, "... unmount complete.");
-	return (0);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : retire_object
+// Description  : Queues an object no file refers to any more for deletion
+//                once the tables naming it have been replaced on the device.
+//                The object is deleted at once if the queue cannot grow.
+//
+// Inputs       : oid - the object
+// Outputs      : 0 if successful, -1 if failure
+
+static int retire_object(CrudOID oid) {
+
+	CrudOID *ring;
+	uint32_t size;
+	uint64_t n;
+
+	pthread_mutex_lock(&crud_reclaim_lock);
+	if( crud_reclaim_tail - crud_reclaim_head == crud_reclaim_size ) {
+		size = crud_reclaim_size ? crud_reclaim_size * 2 : CRUD_RECLAIM_BATCH * 4;
+		if( (ring = malloc(size * sizeof(CrudOID))) == NULL ) {
+
+			// While the store is listed the object is left for garbage collection to find
+			n = crud_gc_listing;
+			pthread_mutex_unlock(&crud_reclaim_lock);
+			return n ? 0 : delete_object(oid);
+		}
+		for( n=crud_reclaim_head; n<crud_reclaim_tail; n++ )
+			ring[n % size] = crud_reclaim_ring[n % crud_reclaim_size];
+		free(crud_reclaim_ring);
+		crud_reclaim_ring = ring;
+		crud_reclaim_size = size;
+	}
+	crud_reclaim_ring[crud_reclaim_tail++ % crud_reclaim_size] = oid;
+	n = crud_reclaim_tail - crud_reclaim_head;
+	pthread_mutex_unlock(&crud_reclaim_lock);
+
+	// A full batch starts a flusher pass
+	if( n >= CRUD_RECLAIM_BATCH )
+		pthread_cond_signal(&crud_writeback_wake);
+
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_open
-// Description  : This function finds an unopen file and returns its file handle
+// Function     : drop_retired
+// Description  : Forgets the objects waiting for deletion without deleting
+//                them, once any deletion in progress finishes, so the tables
+//                can be replaced under them.  Called with crud_image_lock
+//                held, as the tables loaded may still name them.
 //
-// Inputs       : path - the path "in the storage array"
-// Outputs      : file handle if successful, -1 if failure
+// Inputs       : none
+// Outputs      : none
+
+static void drop_retired(void) {
+
+	pthread_mutex_lock(&crud_reclaim_lock);
+	while( crud_reclaims_running > 0 )
+		pthread_cond_wait(&crud_reclaim_idle, &crud_reclaim_lock);
+	crud_reclaim_head = crud_reclaim_safe = crud_reclaim_tail;
+	pthread_mutex_unlock(&crud_reclaim_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : drop_orphans
+// Description  : Forgets the orphans found so far, once any deletion of them
+//                in progress finishes, and makes a pass in progress find none.
+//                Called with crud_table_lock held, as the store is about to
+//                hold other objects, the tables about to name them, or the
+//                tables about to stop describing the store.
+//
+// Inputs       : none
+// Outputs      : none
+
+static void drop_orphans(void) {
+
+	pthread_mutex_lock(&crud_gc_lock);
+	free(crud_gc_orphans);
+	crud_gc_orphans = NULL;
+	crud_gc_count = crud_gc_next = 0;
+	crud_gc_epoch++;
+	crud_gc_last = 0;
+	pthread_mutex_unlock(&crud_gc_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : add_container
+// Description  : Finds the slot of a container in use, taking a free slot for
+//                one not yet in use, called with crud_container_lock held
+//
+// Inputs       : oid - the container
+//                size - the bytes of the container
+// Outputs      : the slot
+
+static int add_container(CrudOID oid, uint32_t size) {
+
+	int i, slot = 0;
+
+	// There is a slot per file, and every container in use holds a file
+	for( i=CRUD_MAX_TOTAL_FILES-1; i>=0; i-- ) {
+		if( crud_containers[i].object == oid )
+			return i;
+		if( crud_containers[i].object == CRUD_NO_OBJECT )
+			slot = i;
+	}
+
+	crud_containers[slot].object = oid;
+	crud_containers[slot].size = size;
+	crud_containers[slot].live = 0;
+	crud_containers[slot].files = 0;
+	return slot;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : index_containers
+// Description  : Forgets the containers in use and kept in memory, then finds
+//                those the files are packed in, called with crud_table_lock
+//                held whenever the tables are replaced
+//
+// Inputs       : none
+// Outputs      : none
+
+static void index_containers(void) {
+
+	int16_t file;
+	int i;
+	CrudContainerType *container;
+
+	pthread_mutex_lock(&crud_container_lock);
+	for( i=0; i<CRUD_MAX_TOTAL_FILES; i++ )
+		crud_containers[i].object = CRUD_NO_OBJECT;
+	for( i=0; i<CRUD_PACK_CACHE; i++ ) {
+		free(crud_container_cache[i].data);
+		crud_container_cache[i].data = NULL;
+		crud_container_cache[i].object = CRUD_NO_OBJECT;
+	}
+
+	for( file=0; file<CRUD_MAX_TOTAL_FILES; file++ ) {
+		if( crud_pack_table[file].container == CRUD_NO_OBJECT )
+			continue;
+		crud_container_slot[file] = add_container(crud_pack_table[file].container, crud_pack_table[file].size);
+		container = &crud_containers[crud_container_slot[file]];
+		container->files++;
+		container->live += crud_file_table[file].length;
+	}
+	pthread_mutex_unlock(&crud_container_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : free_tree
+// Description  : Frees a node of a directory's B-tree and every child of it
+//                read into memory
+//
+// Inputs       : node - the node, may be NULL
+// Outputs      : none
+
+static void free_tree(CrudDirectoryNode *node) {
+
+	int i;
+
+	if( node == NULL )
+		return;
+	for( i=0; i<=CRUD_DIRECTORY_KEYS; i++ )
+		free_tree(node->children[i]);
+	free(node);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : drop_directories
+// Description  : Forgets the directory nodes in memory and closes every
+//                directory stream, called with crud_directory_lock held when
+//                the directory table is about to be replaced
+//
+// Inputs       : none
+// Outputs      : none
+
+static void drop_directories(void) {
+
+	int i;
+
+	for( i=0; i<CRUD_MAX_DIRECTORIES; i++ ) {
+		free_tree(crud_directory_trees[i]);
+		crud_directory_trees[i] = NULL;
+	}
+	for( i=0; i<CRUD_MAX_OPEN_DIRECTORIES; i++ )
+		crud_directory_streams[i].used = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_node
+// Description  : Reads a node of a directory's B-tree into memory
+//
+// Inputs       : oid - the node's object
+// Outputs      : the node, NULL if failure
+
+static CrudDirectoryNode *load_node(CrudOID oid) {
 
-int16_t crud_open(char *path) {
-	
-	int i, fileExists=0; // Boolean flag to determine if the requested file exists
-	int existingFd; // File descriptor of the existing file if it is found
 	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
-	uint32_t occupy; // Meaningless variable needed in order to use the extract_crud_response function
-	CrudResponse response;
+	uint32_t id, length; // variables needed for extract_crud_response function
+	CrudDirectoryNode *node;
 	CrudRequest request;
+	CrudResponse response;
 
-	// Determine if the object store has been initialized yet
-	if( !INITIALIZED ) {
-		// Initialize object store
-		request = create_crud_request(0, CRUD_INIT, 0, 0, 0);
-		response = crud_client_operation(request, NULL);
+	if( (node = calloc(1, sizeof(CrudDirectoryNode))) == NULL )
+		return NULL; // ERROR - no memory for the node
 
-		// Check for CRUD command success
-		extract_crud_response(response, &occupy, &req, &occupy, &flag, &result);
-		if( result )
-			return -1; // ERROR - result code is 1 meaning there was a failure 
-		
-		// Set INITIALIZED to true to show the object store has now been initialized
-		INITIALIZED = 1;
+	request = create_crud_request(oid, CRUD_READ, sizeof(CrudDirectoryNodeType), 0, 0);
+	response = crud_client_operation(request, &node->stored);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result || length != sizeof(CrudDirectoryNodeType) || node->stored.count > CRUD_DIRECTORY_KEYS ) {
+		free(node);
+		return NULL; // ERROR - the node could not be read
 	}
+	node->object = oid;
 
-	// Search for existing file in file table with the same name as parameter 'path'
-	for( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
-		// Test if the current file in the iteration has a name
-		if( strcmp(crud_file_table[i].filename,"") != 0 ) {
-			// Test if the current file's name matches 'path'
-			if( strncmp( crud_file_table[i].filename, path, strlen(path)) == 0 ) {
-				fileExists = 1; // Set fileExists flag to true
-				existingFd = i; // Set the existing file's descriptor to be its index in the table
-			}
-		}
+	return node;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : directory_root
+// Description  : Finds the root node of a directory's B-tree, reading it if
+//                it is not in memory, called with crud_directory_lock held
+//
+// Inputs       : dir - the directory
+//                create - nonzero to give an empty directory a root node
+//                root - set to the root node, NULL if the directory is empty
+// Outputs      : 0 if successful, -1 if failure
+
+static int directory_root(int16_t dir, uint8_t create, CrudDirectoryNode **root) {
+
+	CrudDirectoryNode *node = crud_directory_trees[dir];
+
+	if( node == NULL && crud_directory_table[dir].root != CRUD_NO_OBJECT ) {
+		if( (node = load_node(crud_directory_table[dir].root)) == NULL )
+			return -1; // ERROR - the root node could not be read
+	} else if( node == NULL && create ) {
+		if( (node = calloc(1, sizeof(CrudDirectoryNode))) == NULL )
+			return -1; // ERROR - no memory for the node
+		node->stored.leaf = 1;
+		node->dirty = 1;
 	}
+	crud_directory_trees[dir] = node;
 
-	// CASE 1: File specified by 'path' exists but is simply closed
-	// If the requested file exists, set file to open and set position to the beginning of the file
-	if( fileExists ) {
+	*root = node;
+	return 0;
+}
 
-		crud_file_table[existingFd].open = 1;
-		crud_file_table[existingFd].position = 0;
-		return existingFd;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : child_node
+// Description  : Finds a child of a node, reading it if it is not in memory
+//
+// Inputs       : node - the node, which is not a leaf
+//                i - the index of the child
+// Outputs      : the child, NULL if failure
+
+static CrudDirectoryNode *child_node(CrudDirectoryNode *node, int i) {
+
+	if( node->children[i] == NULL )
+		node->children[i] = load_node(node->stored.children[i]);
+
+	return node->children[i];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : search_node
+// Description  : Finds where a name falls among the entries of a node by
+//                binary search
+//
+// Inputs       : node - the node
+//                name - the name
+//                found - set to nonzero if an entry has the name
+// Outputs      : the index of the entry with the name, or of the first entry
+//                after it, which is also the child the name would be under
+
+static int search_node(const CrudDirectoryNodeType *node, const char *name, uint8_t *found) {
+
+	int low = 0, high = node->count, mid, cmp;
+
+	while( low < high ) {
+		mid = (low + high) / 2;
+		cmp = strcmp(node->entries[mid].name, name);
+		if( cmp == 0 ) {
+			*found = 1;
+			return mid;
+		}
+		if( cmp < 0 )
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	*found = 0;
+	return low;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lookup_entry
+// Description  : Looks a name up in a directory, reading only the nodes on
+//                the way down from its root, called with crud_directory_lock
+//                held
+//
+// Inputs       : dir - the directory
+//                name - the name
+//                entry - set to the entry with the name
+// Outputs      : 1 if the name was found, 0 if not, -1 if failure
+
+static int lookup_entry(int16_t dir, const char *name, CrudDirectoryEntryType *entry) {
+
+	CrudDirectoryNode *node;
+	uint8_t found;
+	int i;
+
+	if( directory_root(dir, 0, &node) )
+		return -1; // ERROR - the root node could not be read
+
+	while( node != NULL ) {
+		i = search_node(&node->stored, name, &found);
+		if( found ) {
+			*entry = node->stored.entries[i];
+			return 1;
+		}
+		if( node->stored.leaf )
+			break;
+		if( (node = child_node(node, i)) == NULL )
+			return -1; // ERROR - a node could not be read
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_entry
+// Description  : Finds the entry of a directory that comes first after a
+//                name, called with crud_directory_lock held
+//
+// Inputs       : dir - the directory
+//                name - the name
+//                inclusive - nonzero if an entry with the name itself counts
+//                entry - set to the entry found
+// Outputs      : 1 if an entry was found, 0 if none comes after the name, -1 if failure
+
+static int next_entry(int16_t dir, const char *name, uint8_t inclusive, CrudDirectoryEntryType *entry) {
+
+	CrudDirectoryNode *node;
+	uint8_t found;
+	int i, ret = 0;
+
+	if( directory_root(dir, 0, &node) )
+		return -1; // ERROR - the root node could not be read
+
+	// The last entry after the name met on the way down is the first of those after it
+	while( node != NULL ) {
+		i = search_node(&node->stored, name, &found);
+		if( found && inclusive ) {
+			*entry = node->stored.entries[i];
+			return 1;
+		}
+		i += found;
+		if( i < node->stored.count ) {
+			*entry = node->stored.entries[i];
+			ret = 1;
+		}
+		if( node->stored.leaf )
+			break;
+		if( (node = child_node(node, i)) == NULL )
+			return -1; // ERROR - a node could not be read
+	}
+
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : split_child
+// Description  : Splits a full child of a node in two around its middle
+//                entry, which moves up into the node
+//
+// Inputs       : node - the node, which is not full
+//                i - the index of the full child, which is in memory
+// Outputs      : 0 if successful, -1 if failure
+
+static int split_child(CrudDirectoryNode *node, int i) {
+
+	CrudDirectoryNode *child = node->children[i], *sibling;
+	int t = CRUD_DIRECTORY_DEGREE;
+
+	if( (sibling = calloc(1, sizeof(CrudDirectoryNode))) == NULL )
+		return -1; // ERROR - no memory for the node
+
+	// The sibling takes the upper half of the child's entries and children
+	sibling->dirty = 1;
+	sibling->stored.leaf = child->stored.leaf;
+	sibling->stored.count = t - 1;
+	memcpy(sibling->stored.entries, &child->stored.entries[t], (t-1) * sizeof(CrudDirectoryEntryType));
+	memcpy(sibling->stored.children, &child->stored.children[t], t * sizeof(CrudOID));
+	memcpy(sibling->children, &child->children[t], t * sizeof(CrudDirectoryNode *));
+
+	// The middle entry moves up, with the sibling after it
+	memmove(&node->stored.entries[i+1], &node->stored.entries[i], (node->stored.count - i) * sizeof(CrudDirectoryEntryType));
+	memmove(&node->stored.children[i+2], &node->stored.children[i+1], (node->stored.count - i) * sizeof(CrudOID));
+	memmove(&node->children[i+2], &node->children[i+1], (node->stored.count - i) * sizeof(CrudDirectoryNode *));
+	node->stored.entries[i] = child->stored.entries[t-1];
+	node->stored.children[i+1] = CRUD_NO_OBJECT;
+	node->children[i+1] = sibling;
+	node->stored.count++;
+	node->dirty = 1;
+
+	// The child keeps the lower half, cleared past it so stored nodes hold no stale names
+	child->stored.count = t - 1;
+	memset(&child->stored.entries[t-1], 0, t * sizeof(CrudDirectoryEntryType));
+	memset(&child->stored.children[t], 0, t * sizeof(CrudOID));
+	memset(&child->children[t], 0, t * sizeof(CrudDirectoryNode *));
+	child->dirty = 1;
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : insert_entry
+// Description  : Adds an entry to a directory, replacing any with its name.
+//                Full nodes are split on the way down, so the entry always
+//                fits where it lands.  Every node on the way is stored again
+//                at the next save, as each names its changed child.  Called
+//                with crud_directory_lock held.
+//
+// Inputs       : dir - the directory
+//                entry - the entry
+// Outputs      : 0 if successful, -1 if failure
+
+static int insert_entry(int16_t dir, const CrudDirectoryEntryType *entry) {
+
+	CrudDirectoryNode *node, *child;
+	CrudOID oid;
+	uint8_t found;
+	int i, cmp;
+
+	if( directory_root(dir, 1, &node) )
+		return -1; // ERROR - the root node could not be read
+
+	// A full root moves into a new child, which is split, so the tree grows at the top
+	if( node->stored.count == CRUD_DIRECTORY_KEYS ) {
+		i = search_node(&node->stored, entry->name, &found);
+		if( found ) {
+			node->stored.entries[i] = *entry;
+			node->dirty = 1;
+			return 0;
+		}
+		if( (child = malloc(sizeof(CrudDirectoryNode))) == NULL )
+			return -1; // ERROR - no memory for the node
+		*child = *node;
+		child->object = CRUD_NO_OBJECT;
+		child->dirty = 1;
+		memset(&node->stored, 0, sizeof(node->stored));
+		memset(node->children, 0, sizeof(node->children));
+		node->children[0] = child;
+		if( split_child(node, 0) ) {
+			oid = node->object;
+			*node = *child;
+			node->object = oid;
+			free(child);
+			return -1; // ERROR - no memory for the node
+		}
+	}
+
+	for( ;; ) {
+		node->dirty = 1;
+		i = search_node(&node->stored, entry->name, &found);
+		if( found ) {
+			node->stored.entries[i] = *entry;
+			return 0;
+		}
+
+		// A leaf has room, as it would have been split on the way down if it were full
+		if( node->stored.leaf ) {
+			memmove(&node->stored.entries[i+1], &node->stored.entries[i], (node->stored.count - i) * sizeof(CrudDirectoryEntryType));
+			node->stored.entries[i] = *entry;
+			node->stored.count++;
+			return 0;
+		}
+
+		if( (child = child_node(node, i)) == NULL )
+			return -1; // ERROR - a node could not be read
+		if( child->stored.count == CRUD_DIRECTORY_KEYS ) {
+			if( split_child(node, i) )
+				return -1; // ERROR - no memory for the node
+			cmp = strcmp(entry->name, node->stored.entries[i].name);
+			if( cmp == 0 ) {
+				node->stored.entries[i] = *entry;
+				return 0;
+			}
+			if( cmp > 0 )
+				child = node->children[i+1];
+		}
+		node = child;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : make_directory
+// Description  : Creates an empty directory in a directory, called with
+//                crud_directory_lock held
+//
+// Inputs       : dir - the directory to create it in
+//                name - its name, which no entry of "dir" has
+// Outputs      : the index of the new directory, -1 if failure
+
+static int16_t make_directory(int16_t dir, const char *name) {
+
+	CrudDirectoryEntryType entry;
+	int16_t i;
+
+	for( i=1; i<CRUD_MAX_DIRECTORIES; i++ ) {
+		if( !crud_directory_table[i].used )
+			break;
+	}
+	if( i == CRUD_MAX_DIRECTORIES )
+		return -1; // ERROR - the directory table is full
+
+	memset(&entry, 0, sizeof(entry));
+	strcpy(entry.name, name);
+	entry.file = -1;
+	entry.directory = i;
+	if( insert_entry(dir, &entry) )
+		return -1; // ERROR - the entry could not be added
+
+	memset(&crud_directory_table[i], 0, sizeof(CrudDirectoryType));
+	crud_directory_table[i].used = 1;
+	crud_directory_table[i].parent = dir;
+	crud_directory_table[i].root = CRUD_NO_OBJECT;
+	strcpy(crud_directory_table[i].name, name);
+	free_tree(crud_directory_trees[i]);
+	crud_directory_trees[i] = NULL;
+
+	return i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : valid_path
+// Description  : Checks that a path names an entry, each of its components
+//                being a nonempty name, so it has no leading, trailing or
+//                doubled '/'
+//
+// Inputs       : path - the path
+// Outputs      : 1 if the path is valid, 0 if not
+
+static int valid_path(const char *path) {
+
+	size_t length;
+
+	if( path == NULL || (length = strlen(path)) == 0 || length > CRUD_MAX_PATH_LENGTH-1 )
+		return 0; // ERROR - the path is empty or too long
+
+	return path[0] != '/' && path[length-1] != '/' && strstr(path, "//") == NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_directory
+// Description  : Resolves every component of a path but the last, each the
+//                name of a directory in the one before, starting from the
+//                root directory.  Missing directories are only created if
+//                the directory table has room for all of them, so a path
+//                that does not fit leaves none behind.  Called with
+//                crud_directory_lock held.
+//
+// Inputs       : path - the path, which valid_path accepts
+//                create - nonzero to create the directories that are missing
+//                leaf - set to the last component of the path
+// Outputs      : the index of the directory holding the last component, -1
+//                if one is missing or is a file, or if failure
+
+static int16_t find_directory(const char *path, uint8_t create, char *leaf) {
+
+	CrudDirectoryEntryType entry;
+	const char *slash, *rest;
+	int16_t dir = 0, i;
+	int found, needed;
+
+	while( (slash = strchr(path, '/')) != NULL ) {
+		memcpy(leaf, path, slash - path);
+		leaf[slash - path] = '\0';
+
+		if( (found = lookup_entry(dir, leaf, &entry)) < 0 )
+			return -1; // ERROR - the directory could not be read
+		if( found && entry.directory < 0 )
+			return -1; // ERROR - a file is in the way
+		if( found ) {
+			dir = entry.directory;
+			path = slash + 1;
+			continue;
+		}
+		if( !create )
+			return -1; // ERROR - the directory does not exist
+
+		// The directories after a missing one are missing too
+		for( needed=0, rest=path; (rest = strchr(rest, '/')) != NULL; rest++ )
+			needed++;
+		for( i=1; i<CRUD_MAX_DIRECTORIES && needed>0; i++ )
+			needed -= !crud_directory_table[i].used;
+		if( needed > 0 || (dir = make_directory(dir, leaf)) < 0 )
+			return -1; // ERROR - the directory table is full or the directory could not be created
+		path = slash + 1;
+	}
+	strcpy(leaf, path);
+
+	return dir;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : index_directories
+// Description  : Builds the directories from the names of the files, for
+//                tables saved before there were directories.  Called with
+//                crud_directory_lock held.
+//
+// Inputs       : none
+// Outputs      : none
+
+static void index_directories(void) {
+
+	CrudDirectoryEntryType entry;
+	int16_t file, dir;
+
+	memset(crud_directory_table, 0, CRUD_DIRECTORY_TABLE_SIZE);
+	crud_directory_table[0].used = 1;
+	crud_directory_table[0].parent = -1;
+
+	// A file whose name has an empty component or clashes with a directory's cannot be reached and is left out
+	for( file=0; file<CRUD_MAX_TOTAL_FILES; file++ ) {
+		memset(&entry, 0, sizeof(entry));
+		if( strcmp(crud_file_table[file].filename, "") == 0 )
+			continue;
+		if( !valid_path(crud_file_table[file].filename) ||
+				(dir = find_directory(crud_file_table[file].filename, 1, entry.name)) < 0 ) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_MOUNT : file %s left out of the directories.", crud_file_table[file].filename);
+			continue;
+		}
+		entry.file = file;
+		entry.directory = -1;
+		insert_entry(dir, &entry);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : store_node
+// Description  : Stores a changed node of a directory's B-tree as a new
+//                object, its changed children first so it can name them,
+//                and retires the object it was stored as before
+//
+// Inputs       : node - the node, which is dirty
+// Outputs      : 0 if successful, -1 if failure
+
+static int store_node(CrudDirectoryNode *node) {
+
+	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
+	uint32_t id, length; // variables needed for extract_crud_response function
+	CrudRequest request;
+	CrudResponse response;
+	int i;
+
+	for( i=0; !node->stored.leaf && i<=node->stored.count; i++ ) {
+		if( node->children[i] != NULL && node->children[i]->dirty ) {
+			if( store_node(node->children[i]) )
+				return -1; // ERROR - a child could not be stored
+			node->stored.children[i] = node->children[i]->object;
+		}
+	}
+
+	request = create_crud_request(0, CRUD_CREATE, sizeof(CrudDirectoryNodeType), 0, 0);
+	response = crud_client_operation(request, &node->stored);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result )
+		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+
+	if( node->object != CRUD_NO_OBJECT )
+		retire_object(node->object);
+	node->object = id;
+	node->dirty = 0;
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : store_directories
+// Description  : Stores every changed directory node and points the
+//                directory table at the new roots, called with
+//                crud_directory_lock held before the tables are saved
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int store_directories(void) {
+
+	int i;
+
+	for( i=0; i<CRUD_MAX_DIRECTORIES; i++ ) {
+		if( !crud_directory_table[i].used || crud_directory_trees[i] == NULL || !crud_directory_trees[i]->dirty )
+			continue;
+		if( store_node(crud_directory_trees[i]) )
+			return -1; // ERROR - a node could not be stored
+		crud_directory_table[i].root = crud_directory_trees[i]->object;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mark_tree
+// Description  : Adds the objects the nodes of a directory's B-tree are
+//                stored as to a list, reading the nodes not yet in memory
+//
+// Inputs       : node - the root node of the tree
+//                marked - the list, NULL to only count the objects
+//                n - the number of objects in the list, counted up
+// Outputs      : 0 if successful, -1 if failure
+
+static int mark_tree(CrudDirectoryNode *node, CrudOID *marked, uint32_t *n) {
+
+	int i;
+
+	if( node->object != CRUD_NO_OBJECT ) {
+		if( marked != NULL )
+			marked[*n] = node->object;
+		(*n)++;
+	}
+	for( i=0; !node->stored.leaf && i<=node->stored.count; i++ ) {
+		if( child_node(node, i) == NULL || mark_tree(node->children[i], marked, n) )
+			return -1; // ERROR - a node could not be read
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mark_directories
+// Description  : Adds the objects of every directory's nodes to a list of
+//                objects, called with crud_directory_lock held
+//
+// Inputs       : marked - the list, grown to hold them
+//                n - the number of objects in the list, counted up
+// Outputs      : 0 if successful, -1 if failure
+
+static int mark_directories(CrudOID **marked, uint32_t *n) {
+
+	CrudDirectoryNode *root;
+	CrudOID *grown;
+	uint32_t count = 0;
+	int i;
+
+	for( i=0; i<CRUD_MAX_DIRECTORIES; i++ ) {
+		if( !crud_directory_table[i].used )
+			continue;
+		if( directory_root(i, 0, &root) || (root != NULL && mark_tree(root, NULL, &count)) )
+			return -1; // ERROR - a node could not be read
+	}
+
+	if( (grown = realloc(*marked, (*n + count + 1) * sizeof(CrudOID))) == NULL )
+		return -1; // ERROR - no memory for the ids
+	*marked = grown;
+	for( i=0; i<CRUD_MAX_DIRECTORIES; i++ ) {
+		if( crud_directory_table[i].used && crud_directory_trees[i] != NULL )
+			mark_tree(crud_directory_trees[i], grown, n);
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_names
+// Description  : Orders files by their paths for qsort
+//
+// Inputs       : a, b - the indexes of the files in crud_file_table
+// Outputs      : less than, equal to or greater than 0 as a's path is before, at or after b's
+
+static int compare_names(const void *a, const void *b) {
+
+	return strcmp(crud_file_table[*(const int16_t *)a].filename, crud_file_table[*(const int16_t *)b].filename);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : name_position
+// Description  : Finds where a path falls in the name index by binary
+//                search, called with crud_table_lock held
+//
+// Inputs       : path - the path
+//                after - nonzero to skip a file with the path itself
+// Outputs      : the position of the first file whose path comes after "path",
+//                or is "path" unless "after" is set
+
+static uint16_t name_position(const char *path, uint8_t after) {
+
+	uint16_t low = 0, high = crud_names_indexed, mid;
+	int cmp;
+
+	while( low < high ) {
+		mid = (low + high) / 2;
+		cmp = strcmp(crud_file_table[crud_name_index[mid]].filename, path);
+		if( cmp < 0 || (cmp == 0 && after) )
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : index_name
+// Description  : Adds a new file to the name index, called with
+//                crud_table_lock held
+//
+// Inputs       : file - the index of the file in crud_file_table
+// Outputs      : none
+
+static void index_name(int16_t file) {
+
+	uint16_t i = name_position(crud_file_table[file].filename, 0);
+
+	memmove(&crud_name_index[i+1], &crud_name_index[i], (crud_names_indexed - i) * sizeof(int16_t));
+	crud_name_index[i] = file;
+	crud_names_indexed++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : index_names
+// Description  : Builds the name index from the file table when the tables
+//                are loaded, called with crud_table_lock held
+//
+// Inputs       : none
+// Outputs      : none
+
+static void index_names(void) {
+
+	int16_t file;
+
+	crud_names_indexed = 0;
+	for( file=0; file<CRUD_MAX_TOTAL_FILES; file++ ) {
+		if( strcmp(crud_file_table[file].filename, "") != 0 )
+			crud_name_index[crud_names_indexed++] = file;
+	}
+	qsort(crud_name_index, crud_names_indexed, sizeof(int16_t), compare_names);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_format
+// Description  : This function formats the crud drive, and adds the file
+//                allocation table.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+uint16_t crud_format(void) {
+	
+	int i, priorityOID=0; // The object id of the priority object
+	int prioritySize = CRUD_PRIORITY_SIZE; // Size of priority object
+	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
+	uint32_t id, length; // variables needed for extract_crud_response function 
+	struct iovec tables[9]; // The file allocation, layout, codec, chunk, extent, segment, pack, inline and directory tables
+	CrudResponse response;
+	CrudRequest request;
+
+	// Determine if the object store has been initialized yet
+	if( crud_initialize() )
+		return -1; // ERROR - the object store could not be initialized
+
+	// Formatting closes every handle, so no I/O may be in flight while it runs
+	pthread_mutex_lock(&crud_image_lock);
+	pthread_mutex_lock(&crud_directory_lock);
+	pthread_mutex_lock(&crud_table_lock);
+	wait_for_merges();
+	discard_dirty_runs();
+	drop_retired();
+	drop_orphans();
+	crud_image_saved = 0;
+	pthread_mutex_lock(&crud_writeback_lock);
+	crud_flusher_stopped = 0;
+	pthread_mutex_unlock(&crud_writeback_lock);
+
+	// Delete crud_content.crd and all objects in the object store
+	request = create_crud_request(0, CRUD_FORMAT, 0, CRUD_NULL_FLAG, 0);
+	response = crud_client_operation(request, NULL);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result ) {
+		pthread_mutex_unlock(&crud_table_lock);
+		pthread_mutex_unlock(&crud_directory_lock);
+		pthread_mutex_unlock(&crud_image_lock);
+		return -1; // ERROR - result code is 1 meaning there was a failure 
+	}
+	
+	// Initialize the file allocation table with all zeros
+	for( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
+		
+		memset(crud_file_table[i].filename,0,CRUD_MAX_PATH_LENGTH);
+		crud_file_table[i].object_id = CRUD_NO_OBJECT;
+		crud_file_table[i].position = 0;
+		crud_file_table[i].length = 0;
+		crud_file_table[i].open = 0;
+	}
+	memset(crud_layout_table,0,CRUD_LAYOUT_TABLE_SIZE);
+	memset(crud_codec_table,0,CRUD_CODEC_TABLE_SIZE);
+	memset(crud_chunk_table,0,CRUD_CHUNK_TABLE_SIZE);
+	memset(crud_extent_table,0,CRUD_EXTENT_TABLE_SIZE);
+	memset(crud_segment_table,0,CRUD_SEGMENT_TABLE_SIZE);
+	memset(crud_pack_table,0,CRUD_PACK_TABLE_SIZE);
+	memset(crud_inline_table,0,CRUD_INLINE_TABLE_SIZE);
+	crud_chunks_used = 0;
+	index_containers();
+	drop_directories();
+	index_directories();
+	index_names();
+	reset_open_table();
+
+	// Create priority object containing the table data
+	tables[0].iov_base = crud_file_table;
+	tables[0].iov_len = CRUD_FILE_TABLE_SIZE;
+	tables[1].iov_base = crud_layout_table;
+	tables[1].iov_len = CRUD_LAYOUT_TABLE_SIZE;
+	tables[2].iov_base = crud_codec_table;
+	tables[2].iov_len = CRUD_CODEC_TABLE_SIZE;
+	tables[3].iov_base = crud_chunk_table;
+	tables[3].iov_len = CRUD_CHUNK_TABLE_SIZE;
+	tables[4].iov_base = crud_extent_table;
+	tables[4].iov_len = CRUD_EXTENT_TABLE_SIZE;
+	tables[5].iov_base = crud_segment_table;
+	tables[5].iov_len = CRUD_SEGMENT_TABLE_SIZE;
+	tables[6].iov_base = crud_pack_table;
+	tables[6].iov_len = CRUD_PACK_TABLE_SIZE;
+	tables[7].iov_base = crud_inline_table;
+	tables[7].iov_len = CRUD_INLINE_TABLE_SIZE;
+	tables[8].iov_base = crud_directory_table;
+	tables[8].iov_len = CRUD_DIRECTORY_TABLE_SIZE;
+	request = create_crud_request(priorityOID, CRUD_CREATE, prioritySize, CRUD_PRIORITY_OBJECT, 0);
+	response = crud_client_operation_v(request, tables, 9);
+	pthread_mutex_unlock(&crud_table_lock);
+	pthread_mutex_unlock(&crud_directory_lock);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result ) {
+		pthread_mutex_unlock(&crud_image_lock);
+		return -1; // ERROR - result code is 1 meaning there was a failure
+	}
+	crud_priority_length = CRUD_PRIORITY_SIZE;
+	pthread_mutex_unlock(&crud_image_lock);
+
+	// Log, return successfully
+	logMessage(LOG_INFO_LEVEL, "... formatting complete.");
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_mount
+// Description  : This function mount the current crud file system and loads
+//                the file allocation table.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+uint16_t crud_mount(void) {
+	
+	int i, priorityOID=0; // The object id of the priority object
+	int tableSize = CRUD_PRIORITY_SIZE;
+	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
+	uint32_t id, length; // variables needed for extract_crud_response function 
+	char *buf = crud_table_image; // Buffer to hold read priority object
+	CrudRequest request;
+	CrudResponse response;
+
+	// Determine if the object store has been initialized yet
+	if( crud_initialize() )
+		return -1; // ERROR - the object store could not be initialized
+
+	pthread_mutex_lock(&crud_image_lock);
+	request = create_crud_request(priorityOID, CRUD_READ, tableSize, CRUD_PRIORITY_OBJECT, 0);
+	response = crud_client_operation(request, buf);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result || length < CRUD_FILE_TABLE_SIZE ) {
+		pthread_mutex_unlock(&crud_image_lock);
+		return -1; // ERROR - result code is 1 meaning there was a failure
+	}
+
+	// Copy contents of the file allocation table read from the priority object into crud_file_table structure
+	// Mounting closes every handle, so no I/O may be in flight while it runs
+	pthread_mutex_lock(&crud_directory_lock);
+	pthread_mutex_lock(&crud_table_lock);
+	wait_for_merges();
+	discard_dirty_runs();
+	drop_retired();
+	drop_orphans();
+	pthread_mutex_lock(&crud_writeback_lock);
+	crud_flusher_stopped = 0;
+	pthread_mutex_unlock(&crud_writeback_lock);
+	memcpy(crud_file_table,buf,CRUD_FILE_TABLE_SIZE);
+
+	// A table saved before files were striped has no layout, so every file is a single object
+	if( length >= CRUD_FILE_TABLE_SIZE+CRUD_LAYOUT_TABLE_SIZE )
+		memcpy(crud_layout_table,&buf[CRUD_FILE_TABLE_SIZE],CRUD_LAYOUT_TABLE_SIZE);
+	else
+		memset(crud_layout_table,0,CRUD_LAYOUT_TABLE_SIZE);
+
+	// A table saved before files could be compressed stores every stripe raw
+	if( length >= CRUD_FILE_TABLE_SIZE+CRUD_LAYOUT_TABLE_SIZE+CRUD_CODEC_TABLE_SIZE )
+		memcpy(crud_codec_table,&buf[CRUD_FILE_TABLE_SIZE+CRUD_LAYOUT_TABLE_SIZE],CRUD_CODEC_TABLE_SIZE);
+	else
+		memset(crud_codec_table,0,CRUD_CODEC_TABLE_SIZE);
+
+	// A table saved before files could be deduplicated shares no stripes
+	crud_chunks_used = 0;
+	if( length >= CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE-CRUD_INLINE_TABLE_SIZE-CRUD_PACK_TABLE_SIZE-CRUD_SEGMENT_TABLE_SIZE-CRUD_EXTENT_TABLE_SIZE ) {
+		memcpy(crud_chunk_table,&buf[CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE-CRUD_INLINE_TABLE_SIZE-CRUD_PACK_TABLE_SIZE-CRUD_SEGMENT_TABLE_SIZE-CRUD_EXTENT_TABLE_SIZE-CRUD_CHUNK_TABLE_SIZE],CRUD_CHUNK_TABLE_SIZE);
+		for( i=0; i<CRUD_MAX_CHUNKS; i++ )
+			crud_chunks_used += (crud_chunk_table[i].refs > 0);
+	} else
+		memset(crud_chunk_table,0,CRUD_CHUNK_TABLE_SIZE);
+
+	// A table saved before files could have holes stores every page
+	if( length >= CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE-CRUD_INLINE_TABLE_SIZE-CRUD_PACK_TABLE_SIZE-CRUD_SEGMENT_TABLE_SIZE )
+		memcpy(crud_extent_table,&buf[CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE-CRUD_INLINE_TABLE_SIZE-CRUD_PACK_TABLE_SIZE-CRUD_SEGMENT_TABLE_SIZE-CRUD_EXTENT_TABLE_SIZE],CRUD_EXTENT_TABLE_SIZE);
+	else
+		memset(crud_extent_table,0,CRUD_EXTENT_TABLE_SIZE);
+
+	// A table saved before files could be appended to in segments has none
+	if( length >= CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE-CRUD_INLINE_TABLE_SIZE-CRUD_PACK_TABLE_SIZE )
+		memcpy(crud_segment_table,&buf[CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE-CRUD_INLINE_TABLE_SIZE-CRUD_PACK_TABLE_SIZE-CRUD_SEGMENT_TABLE_SIZE],CRUD_SEGMENT_TABLE_SIZE);
+	else
+		memset(crud_segment_table,0,CRUD_SEGMENT_TABLE_SIZE);
+
+	// A table saved before small files could be packed keeps every file in its stripes
+	if( length >= CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE-CRUD_INLINE_TABLE_SIZE )
+		memcpy(crud_pack_table,&buf[CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE-CRUD_INLINE_TABLE_SIZE-CRUD_PACK_TABLE_SIZE],CRUD_PACK_TABLE_SIZE);
+	else
+		memset(crud_pack_table,0,CRUD_PACK_TABLE_SIZE);
+	index_containers();
+
+	// A table saved before tiny files could be kept in it holds none
+	if( length >= CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE )
+		memcpy(crud_inline_table,&buf[CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE-CRUD_INLINE_TABLE_SIZE],CRUD_INLINE_TABLE_SIZE);
+	else
+		memset(crud_inline_table,0,CRUD_INLINE_TABLE_SIZE);
+
+	// A table saved before there were directories has its files' names split into them
+	drop_directories();
+	if( length >= CRUD_PRIORITY_SIZE )
+		memcpy(crud_directory_table,&buf[CRUD_PRIORITY_SIZE-CRUD_DIRECTORY_TABLE_SIZE],CRUD_DIRECTORY_TABLE_SIZE);
+	else
+		index_directories();
+	index_names();
+	crud_priority_length = length;
+	crud_image_saved = (length == CRUD_PRIORITY_SIZE);
+
+	// No file handles are open on a freshly mounted file system
+	reset_open_table();
+	pthread_mutex_lock(&crud_gc_lock);
+	crud_gc_mounted = 1;
+	pthread_mutex_unlock(&crud_gc_lock);
+	pthread_mutex_unlock(&crud_table_lock);
+	pthread_mutex_unlock(&crud_directory_lock);
+	pthread_mutex_unlock(&crud_image_lock);
+
+	// Log, return successfully
+	logMessage(LOG_INFO_LEVEL, "... mount complete.");
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : save_tables
+// Description  : Copies the tables into the image and writes it to the
+//                priority object, called with crud_image_lock held.  Each
+//                entry is copied once any write in progress on it finishes,
+//                and nothing is written if no entry changed since the image
+//                was last saved.  Objects retired before the copy started
+//                are named by no table once the save succeeds, so they may
+//                then be deleted.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int save_tables(void) {
+
+	int i, changed = 0, priorityOID=0; // The object id of the priority object
+	int tableSize = CRUD_PRIORITY_SIZE;
+	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
+	uint32_t id, length; // variables needed for extract_crud_response function 
+	CrudFileAllocationType *buf = (CrudFileAllocationType *)crud_table_image; // Buffer to hold the priority object
+	CrudFileLayoutType *layouts = (CrudFileLayoutType *)&buf[CRUD_MAX_TOTAL_FILES]; // Layout part of the buffer
+	CrudFileCodecType *codecs = (CrudFileCodecType *)&layouts[CRUD_MAX_TOTAL_FILES]; // Codec part of the buffer
+	CrudChunkType *chunks = (CrudChunkType *)&codecs[CRUD_MAX_TOTAL_FILES]; // Chunk index part of the buffer
+	CrudFileExtentType *extents = (CrudFileExtentType *)&chunks[CRUD_MAX_CHUNKS]; // Extent part of the buffer
+	CrudFileSegmentType *segments = (CrudFileSegmentType *)&extents[CRUD_MAX_TOTAL_FILES]; // Segment part of the buffer
+	CrudFilePackType *packs = (CrudFilePackType *)&segments[CRUD_MAX_TOTAL_FILES]; // Pack part of the buffer
+	CrudFileInlineType *inlines = (CrudFileInlineType *)&packs[CRUD_MAX_TOTAL_FILES]; // Inline part of the buffer
+	CrudDirectoryType *directories = (CrudDirectoryType *)&inlines[CRUD_MAX_TOTAL_FILES]; // Directory part of the buffer
+	uint64_t retired;
+	CrudRequest request;
+	CrudResponse response;
+
+	pthread_once(&crud_tables_once, init_tables);
+	pthread_mutex_lock(&crud_directory_lock);
+
+	// The directories' changed nodes are stored before the table lock is taken, so the
+	// tables name whole trees and the nodes they replace are retired before the copy
+	// starts.  The directory lock is held until the files are copied, so each file
+	// created since is copied along with the entry naming it.
+	if( store_directories() ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - a directory node could not be stored
+	}
+	pthread_mutex_lock(&crud_reclaim_lock);
+	retired = crud_reclaim_tail;
+	pthread_mutex_unlock(&crud_reclaim_lock);
+	if( memcmp(directories,crud_directory_table,CRUD_DIRECTORY_TABLE_SIZE) ) {
+		memcpy(directories,crud_directory_table,CRUD_DIRECTORY_TABLE_SIZE);
+		changed = 1;
+	}
+
+	pthread_mutex_lock(&crud_table_lock);
+	for( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
+		pthread_rwlock_rdlock(&crud_file_locks[i]);
+		if( memcmp(&buf[i], &crud_file_table[i], sizeof(buf[i])) ||
+				memcmp(&layouts[i], &crud_layout_table[i], sizeof(layouts[i])) ||
+				memcmp(&codecs[i], &crud_codec_table[i], sizeof(codecs[i])) ||
+				memcmp(&extents[i], &crud_extent_table[i], sizeof(extents[i])) ||
+				memcmp(&segments[i], &crud_segment_table[i], sizeof(segments[i])) ||
+				memcmp(&packs[i], &crud_pack_table[i], sizeof(packs[i])) ||
+				memcmp(&inlines[i], &crud_inline_table[i], sizeof(inlines[i])) ) {
+			buf[i] = crud_file_table[i];
+			layouts[i] = crud_layout_table[i];
+			codecs[i] = crud_codec_table[i];
+			extents[i] = crud_extent_table[i];
+			segments[i] = crud_segment_table[i];
+			packs[i] = crud_pack_table[i];
+			inlines[i] = crud_inline_table[i];
+			changed = 1;
+		}
+		pthread_rwlock_unlock(&crud_file_locks[i]);
+	}
+	pthread_mutex_lock(&crud_chunk_lock);
+	if( memcmp(chunks,crud_chunk_table,CRUD_CHUNK_TABLE_SIZE) ) {
+		memcpy(chunks,crud_chunk_table,CRUD_CHUNK_TABLE_SIZE);
+		changed = 1;
+	}
+	pthread_mutex_unlock(&crud_chunk_lock);
+	pthread_mutex_unlock(&crud_table_lock);
+	pthread_mutex_unlock(&crud_directory_lock);
+
+	if( !changed && crud_image_saved )
+		goto saved;
+	
+	// Update the priority object with the current file table, recreating it if it was
+	// saved by an older driver with fewer tables
+	crud_image_saved = 0;
+	request = create_crud_request(priorityOID, (crud_priority_length == CRUD_PRIORITY_SIZE) ? CRUD_UPDATE : CRUD_CREATE,
+		tableSize, CRUD_PRIORITY_OBJECT, 0);
+	response = crud_client_operation(request, buf);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result )
+		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+	crud_priority_length = CRUD_PRIORITY_SIZE;
+	crud_image_saved = 1;
+
+saved:
+	pthread_mutex_lock(&crud_reclaim_lock);
+	if( retired > crud_reclaim_safe )
+		crud_reclaim_safe = retired;
+	pthread_mutex_unlock(&crud_reclaim_lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sync_tables
+// Description  : Makes every change to the tables made before the call
+//                durable.  Concurrent callers share one save: whoever finds
+//                none running saves on behalf of every ticket handed out so
+//                far, and the rest wait for a save that started after they
+//                arrived.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int sync_tables(void) {
+
+	uint64_t ticket, target;
+	int ret;
+
+	pthread_mutex_lock(&crud_sync_lock);
+	ticket = ++crud_sync_requested;
+	for( ;; ) {
+		if( crud_sync_completed >= ticket ) {
+			pthread_mutex_unlock(&crud_sync_lock);
+			return 0;
+		}
+		if( crud_sync_failed >= ticket ) {
+			pthread_mutex_unlock(&crud_sync_lock);
+			return -1; // ERROR - the save covering this call failed
+		}
+		if( !crud_sync_running )
+			break;
+		pthread_cond_wait(&crud_sync_done, &crud_sync_lock);
+	}
+
+	// Save for everyone who has arrived so far
+	crud_sync_running = 1;
+	target = crud_sync_requested;
+	pthread_mutex_unlock(&crud_sync_lock);
+
+	pthread_mutex_lock(&crud_image_lock);
+	ret = save_tables();
+	pthread_mutex_unlock(&crud_image_lock);
+
+	pthread_mutex_lock(&crud_sync_lock);
+	if( ret )
+		crud_sync_failed = target;
+	else
+		crud_sync_completed = target;
+	crud_sync_running = 0;
+	pthread_cond_broadcast(&crud_sync_done);
+	pthread_mutex_unlock(&crud_sync_lock);
+
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : reclaim_objects
+// Description  : Deletes the retired objects no saved table names, oldest
+//                first.  Once a batch is waiting on a save the tables are
+//                saved first, so retired objects never pile up.  Nothing is
+//                deleted while a garbage collection pass lists the store.
+//
+// Inputs       : save - nonzero to save the tables when a batch waits on it
+// Outputs      : none
+
+static void reclaim_objects(uint8_t save) {
+
+	uint64_t waiting, deletable;
+	CrudOID oid;
+
+	pthread_mutex_lock(&crud_reclaim_lock);
+	waiting = crud_reclaim_tail - crud_reclaim_head;
+	deletable = crud_reclaim_safe - crud_reclaim_head;
+	pthread_mutex_unlock(&crud_reclaim_lock);
+
+	if( save && waiting >= CRUD_RECLAIM_BATCH && deletable < waiting )
+		sync_tables();
+
+	for( ;; ) {
+		pthread_mutex_lock(&crud_reclaim_lock);
+		if( crud_reclaim_head >= crud_reclaim_safe || crud_gc_listing ) {
+			pthread_mutex_unlock(&crud_reclaim_lock);
+			break;
+		}
+		oid = crud_reclaim_ring[crud_reclaim_head++ % crud_reclaim_size];
+		crud_reclaims_running++;
+		pthread_mutex_unlock(&crud_reclaim_lock);
+
+		// An object that could not be deleted only wastes space, no table names it
+		delete_object(oid);
+
+		pthread_mutex_lock(&crud_reclaim_lock);
+		if( --crud_reclaims_running == 0 )
+			pthread_cond_broadcast(&crud_reclaim_idle);
+		pthread_mutex_unlock(&crud_reclaim_lock);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_unmount
+// Description  : This function unmounts the current crud file system and
+//                saves the file allocation table, stopping the background
+//                flusher until the next format or mount.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+uint16_t crud_unmount(void) {
+	
+	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
+	uint32_t id, length; // variables needed for extract_crud_response function 
+	CrudRequest request;
+	CrudResponse response;
+
+	if( crud_syncfs() )
+		return -1; // ERROR - the file system could not be made durable
+
+	// The flusher's last pass may change the tables again, so they are saved once more after it
+	stop_flusher();
+	if( crud_syncfs() )
+		return -1; // ERROR - the file system could not be made durable
+	reclaim_objects(0);
+
+	// The tables no longer describe the store, which another client may now change, so
+	// garbage collection stops and forgets what it found
+	pthread_mutex_lock(&crud_table_lock);
+	drop_orphans();
+	pthread_mutex_lock(&crud_gc_lock);
+	crud_gc_mounted = 0;
+	pthread_mutex_unlock(&crud_gc_lock);
+	pthread_mutex_unlock(&crud_table_lock);
+
+	request = create_crud_request(0, CRUD_CLOSE, 0, 0, 0);
+	response = crud_client_operation(request, NULL);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result )
+		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+
+	// Log, return successfully
+	logMessage(LOG_INFO_LEVEL, "... unmount complete.");
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_file
+// Description  : Looks a file up by name, one directory of its path at a
+//                time, called with crud_directory_lock held
+//
+// Inputs       : path - the path "in the storage array"
+// Outputs      : the index of the file in crud_file_table, -1 if there is none
+
+static int16_t find_file(char *path) {
+
+	char leaf[CRUD_MAX_PATH_LENGTH];
+	CrudDirectoryEntryType entry;
+	int16_t dir;
+
+	if( !valid_path(path) || (dir = find_directory(path, 0, leaf)) < 0 )
+		return -1; // ERROR - the path is not valid or a directory on it does not exist
+
+	if( lookup_entry(dir, leaf, &entry) <= 0 || entry.file < 0 )
+		return -1; // ERROR - the directory has no file with the name
+
+	return entry.file;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : create_file
+// Description  : Makes a new empty file with no handles open on it, adding
+//                it to its directory and creating the directories on its
+//                path that are missing, called with crud_directory_lock held.
+//                Only this function takes a free file entry, so the one it
+//                finds stays free while the directories are read.
+//
+// Inputs       : path - the path "in the storage array"
+// Outputs      : the index of the file in crud_file_table, -1 if the table is
+//                full, the name is taken by a directory, or failure
+
+static int16_t create_file(char *path) {
+
+	CrudDirectoryEntryType entry;
+	int16_t i, dir;
+
+	// Find unopen file that does not already exist, before any directory is created for it
+	pthread_mutex_lock(&crud_table_lock);
+	for( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
+		if( !crud_file_table[i].open && strcmp(crud_file_table[i].filename,"")==0 )
+			break;
+	}
+	pthread_mutex_unlock(&crud_table_lock);
+	if( i == CRUD_MAX_TOTAL_FILES )
+		return -1; // ERROR - End of for loop reached without finding a unopen file
+
+	memset(&entry, 0, sizeof(entry));
+	if( (dir = find_directory(path, 1, entry.name)) < 0 )
+		return -1; // ERROR - a directory on the path could not be created
+	if( lookup_entry(dir, entry.name, &entry) != 0 )
+		return -1; // ERROR - the name is taken or the directory could not be read
+
+	// Give initial values to the file variables
+	pthread_mutex_lock(&crud_table_lock);
+	strcpy( crud_file_table[i].filename, path); // make filename the parameter path
+	crud_file_table[i].object_id = CRUD_NO_OBJECT;
+	crud_file_table[i].length = 0;
+	crud_file_table[i].position = 0;
+	memset(&crud_layout_table[i],0,sizeof(CrudFileLayoutType));
+	memset(&crud_codec_table[i],0,sizeof(CrudFileCodecType));
+	memset(&crud_extent_table[i],0,sizeof(CrudFileExtentType));
+	memset(&crud_segment_table[i],0,sizeof(CrudFileSegmentType));
+	memset(&crud_pack_table[i],0,sizeof(CrudFilePackType));
+	memset(&crud_inline_table[i],0,sizeof(CrudFileInlineType));
+
+	// The file only exists once its directory names it, and the lookup read every node
+	// the entry goes in on the way down, so adding it reads none
+	entry.file = i;
+	entry.directory = -1;
+	if( insert_entry(dir, &entry) ) {
+		memset(crud_file_table[i].filename,0,CRUD_MAX_PATH_LENGTH);
+		pthread_mutex_unlock(&crud_table_lock);
+		return -1; // ERROR - the entry could not be added
+	}
+	index_name(i);
+	pthread_mutex_unlock(&crud_table_lock);
+	return i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_open
+// Description  : This function finds the file named by path, creating it and
+//                the directories on its path if it does not exist, and
+//                returns a new handle open on it.
+//                Every call returns a distinct handle with its own position,
+//                so the same file may be opened many times at once.
+//
+// Inputs       : path - the path "in the storage array"
+// Outputs      : file handle if successful, -1 if failure
+
+int16_t crud_open(char *path) {
+	
+	int16_t file; // Index of the file in the file table
+	int16_t fd; // The file handle that will be returned
+
+	// Determine if the object store has been initialized yet
+	if( crud_initialize() )
+		return -1; // ERROR - the object store could not be initialized
+
+	if( !valid_path(path) )
+		return -1; // ERROR - path is not a valid file name
+
+	// Find a free handle for the open file description, which stays free as only opens
+	// take handles and each holds the directory lock
+	pthread_mutex_lock(&crud_directory_lock);
+	pthread_mutex_lock(&crud_table_lock);
+	for( fd=0; fd<CRUD_MAX_OPEN_FILES; fd++ ) {
+		if( crud_open_table[fd].file < 0 )
+			break;
+	}
+	pthread_mutex_unlock(&crud_table_lock);
+	if( fd == CRUD_MAX_OPEN_FILES ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - all file handles are in use
+	}
+
+	// An existing file gets another handle at its beginning and a missing one is created
+	// for this handle.  Either may read directory nodes, so the table lock is taken after.
+	if( (file = find_file(path)) < 0 && (file = create_file(path)) < 0 ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - the file table is full
+	}
+
+	pthread_mutex_lock(&crud_table_lock);
+	if( crud_file_table[file].open == CRUD_MAX_FILE_OPENS ) {
+		pthread_mutex_unlock(&crud_table_lock);
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - too many handles open on this file
+	}
+	crud_file_table[file].open++;
+
+	// Attach the new handle to the file at its beginning
+	crud_open_table[fd].position = 0;
+	__atomic_store_n(&crud_open_table[fd].file, file, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&crud_table_lock);
+	pthread_mutex_unlock(&crud_directory_lock);
+	return fd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_close
+// Description  : This function closes the file handle
+//
+// Inputs       : fd - the file handle of the object to close
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_close(int16_t fd) {
+	
+	int16_t file;
+	CrudOpenFileType *handle;
+
+	pthread_mutex_lock(&crud_table_lock);
+	handle = lock_open_file(fd, &file);
+	if( handle == NULL ) {
+		pthread_mutex_unlock(&crud_table_lock);
+		return -1; // ERROR - requested file handle is out of range or not open
+	}
+
+	// Release the handle and drop its reference on the file
+	crud_file_table[file].open--;
+	__atomic_store_n(&handle->file, -1, __ATOMIC_RELEASE);
+	handle->position = 0;
+	pthread_mutex_unlock(&handle->lock);
+	pthread_mutex_unlock(&crud_table_lock);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_mkdir
+// Description  : Creates an empty directory.  Every directory on its path
+//                must exist already.
+//
+// Inputs       : path - the path of the new directory
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_mkdir(char *path) {
+
+	char leaf[CRUD_MAX_PATH_LENGTH];
+	CrudDirectoryEntryType entry;
+	int16_t dir;
+
+	// Determine if the object store has been initialized yet
+	if( crud_initialize() )
+		return -1; // ERROR - the object store could not be initialized
+
+	if( !valid_path(path) )
+		return -1; // ERROR - path is not a valid directory name
+
+	pthread_mutex_lock(&crud_directory_lock);
+	if( (dir = find_directory(path, 0, leaf)) < 0 || lookup_entry(dir, leaf, &entry) != 0 ||
+			make_directory(dir, leaf) < 0 ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - the parent does not exist, the name is taken or the directory table is full
+	}
+	pthread_mutex_unlock(&crud_directory_lock);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_opendir
+// Description  : Opens a stream over the entries of a directory, which
+//                crud_readdir returns in order of their names
+//
+// Inputs       : path - the path of the directory, "" for the root directory
+// Outputs      : the directory stream if successful, -1 if failure
+
+int16_t crud_opendir(char *path) {
+
+	char leaf[CRUD_MAX_PATH_LENGTH];
+	CrudDirectoryEntryType entry;
+	int16_t dir = 0, dd;
+
+	// Determine if the object store has been initialized yet
+	if( crud_initialize() )
+		return -1; // ERROR - the object store could not be initialized
+
+	if( path == NULL || (strlen(path) > 0 && !valid_path(path)) )
+		return -1; // ERROR - path is not a valid directory name
+
+	pthread_mutex_lock(&crud_directory_lock);
+	if( strlen(path) > 0 ) {
+		if( (dir = find_directory(path, 0, leaf)) < 0 || lookup_entry(dir, leaf, &entry) <= 0 || entry.directory < 0 ) {
+			pthread_mutex_unlock(&crud_directory_lock);
+			return -1; // ERROR - there is no directory with the path
+		}
+		dir = entry.directory;
+	}
+
+	for( dd=0; dd<CRUD_MAX_OPEN_DIRECTORIES; dd++ ) {
+		if( !crud_directory_streams[dd].used )
+			break;
+	}
+	if( dd == CRUD_MAX_OPEN_DIRECTORIES ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - all directory streams are in use
+	}
+	crud_directory_streams[dd].used = 1;
+	crud_directory_streams[dd].started = 0;
+	crud_directory_streams[dd].directory = dir;
+	crud_directory_streams[dd].last[0] = '\0';
+	pthread_mutex_unlock(&crud_directory_lock);
+
+	return dd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_readdir
+// Description  : Returns the entry of a directory after the one the stream
+//                returned last.  Each call looks the entry up from the root
+//                of the directory's B-tree, so entries added while the
+//                stream is open are returned if they come later.
+//
+// Inputs       : dd - the directory stream
+//                dirent - filled in with the entry
+// Outputs      : 1 if an entry was returned, 0 at the end of the directory,
+//                -1 if failure
+
+int16_t crud_readdir(int16_t dd, CrudDirent *dirent) {
+
+	CrudDirectoryStreamType *stream;
+	CrudDirectoryEntryType entry;
+	int found;
+
+	if( dd < 0 || dd >= CRUD_MAX_OPEN_DIRECTORIES || dirent == NULL )
+		return -1; // ERROR - the stream is out of range
+
+	pthread_mutex_lock(&crud_directory_lock);
+	stream = &crud_directory_streams[dd];
+	if( !stream->used ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - the stream is not open
+	}
+	if( (found = next_entry(stream->directory, stream->last, !stream->started, &entry)) <= 0 ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		return found; // The end of the directory, or ERROR - a node could not be read
+	}
+	stream->started = 1;
+	strcpy(stream->last, entry.name);
+
+	memset(dirent, 0, sizeof(CrudDirent));
+	strcpy(dirent->name, entry.name);
+	if( entry.directory >= 0 )
+		dirent->type = CRUD_DIRENT_DIRECTORY;
+	else {
+		dirent->type = CRUD_DIRENT_FILE;
+		pthread_rwlock_rdlock(&crud_file_locks[entry.file]);
+		dirent->length = crud_file_table[entry.file].length;
+		if( crud_dirty_table[entry.file].dirty && crud_dirty_table[entry.file].end > dirent->length )
+			dirent->length = crud_dirty_table[entry.file].end;
+		pthread_rwlock_unlock(&crud_file_locks[entry.file]);
+	}
+	pthread_mutex_unlock(&crud_directory_lock);
+
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_closedir
+// Description  : Closes a directory stream
+//
+// Inputs       : dd - the directory stream
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_closedir(int16_t dd) {
+
+	if( dd < 0 || dd >= CRUD_MAX_OPEN_DIRECTORIES )
+		return -1; // ERROR - the stream is out of range
+
+	pthread_mutex_lock(&crud_directory_lock);
+	if( !crud_directory_streams[dd].used ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - the stream is not open
+	}
+	crud_directory_streams[dd].used = 0;
+	pthread_mutex_unlock(&crud_directory_lock);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_list_prefix
+// Description  : Starts an iteration over the files whose paths start with
+//                a prefix, which crud_next_prefix returns in order of their
+//                paths.  The iteration holds no resources.
+//
+// Inputs       : prefix - the prefix, "" for every file
+//                iterator - the iteration to start
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_list_prefix(char *prefix, CrudPrefixIterator *iterator) {
+
+	if( prefix == NULL || iterator == NULL || strlen(prefix) > CRUD_MAX_PATH_LENGTH-1 )
+		return -1; // ERROR - the prefix is not a valid path
+
+	memset(iterator, 0, sizeof(CrudPrefixIterator));
+	strcpy(iterator->prefix, prefix);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_next_prefix
+// Description  : Returns the file after the one an iteration returned last,
+//                found by binary search in the name index, or straight after
+//                it when no file was created before it since.  Files created
+//                during the iteration are returned if they come later.
+//
+// Inputs       : iterator - the iteration
+//                dirent - filled in with the file, its whole path as the name
+// Outputs      : 1 if a file was returned, 0 at the end of the iteration,
+//                -1 if failure
+
+int16_t crud_next_prefix(CrudPrefixIterator *iterator, CrudDirent *dirent) {
+
+	uint16_t i;
+	int16_t file;
+
+	if( iterator == NULL || dirent == NULL )
+		return -1; // ERROR - no iteration to continue
+
+	pthread_mutex_lock(&crud_table_lock);
+	i = iterator->next;
+	if( !iterator->started )
+		i = name_position(iterator->prefix, 0);
+	else if( i == 0 || i > crud_names_indexed || strcmp(crud_file_table[crud_name_index[i-1]].filename, iterator->last) != 0 )
+		i = name_position(iterator->last, 1);
+
+	// The paths with the prefix are together in the index, so the first one without ends it
+	if( i == crud_names_indexed ||
+			strncmp(crud_file_table[crud_name_index[i]].filename, iterator->prefix, strlen(iterator->prefix)) != 0 ) {
+		pthread_mutex_unlock(&crud_table_lock);
+		return 0;
+	}
+	file = crud_name_index[i];
+	strcpy(iterator->last, crud_file_table[file].filename);
+	iterator->next = i + 1;
+	iterator->started = 1;
+
+	memset(dirent, 0, sizeof(CrudDirent));
+	strcpy(dirent->name, crud_file_table[file].filename);
+	dirent->type = CRUD_DIRENT_FILE;
+	pthread_rwlock_rdlock(&crud_file_locks[file]);
+	dirent->length = crud_file_table[file].length;
+	if( crud_dirty_table[file].dirty && crud_dirty_table[file].end > dirent->length )
+		dirent->length = crud_dirty_table[file].end;
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+	pthread_mutex_unlock(&crud_table_lock);
+
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : iovec_length
+// Description  : Totals the number of bytes described by a buffer list.  A
+//                read never returns more bytes than the largest file holds,
+//                so a longer list only counts that many.
+//
+// Inputs       : iov - the buffer list
+//                iovcnt - the number of buffers in the list
+//                write - nonzero if the list holds bytes to write
+// Outputs      : the total number of bytes, -1 if the list is invalid or
+//                holds more bytes than any file can
+
+static int32_t iovec_length(const struct iovec *iov, int iovcnt, uint8_t write) {
+
+	int i;
+	uint64_t total = 0;
+
+	if( iovcnt < 0 || iovcnt > CRUD_MAX_IOVECS || (iovcnt > 0 && iov == NULL) )
+		return -1; // ERROR - invalid buffer list
+
+	for( i=0; i<iovcnt; i++ ) {
+		if( iov[i].iov_base == NULL && iov[i].iov_len > 0 )
+			return -1; // ERROR - buffer doesn't point to meaningful data
+		total += iov[i].iov_len;
+	}
+
+	if( total > CRUD_MAX_FILE_SIZE ) {
+		if( write )
+			return -1; // ERROR - no file can hold this many bytes
+		total = CRUD_MAX_FILE_SIZE;
+	}
+
+	return (int32_t)total;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : slice_iovec
+// Description  : Describes a byte range of a buffer list as a new buffer list
+//                pointing into the same memory
+//
+// Inputs       : iov - the buffer list
+//                iovcnt - the number of buffers in iov
+//                from - the first byte of the range, counted from the start of iov
+//                len - the number of bytes in the range
+//                out - array of at least iovcnt entries to receive the slice
+// Outputs      : the number of buffers in the slice
+
+static int slice_iovec(const struct iovec *iov, int iovcnt, uint32_t from, uint32_t len, struct iovec *out) {
+
+	int i, n=0;
+
+	for( i=0; i<iovcnt && len>0; i++ ) {
+
+		// Skip buffers wholly before the range
+		if( from >= iov[i].iov_len ) {
+			from -= iov[i].iov_len;
+			continue;
+		}
+
+		out[n].iov_base = (char *)iov[i].iov_base + from;
+		out[n].iov_len = (iov[i].iov_len - from < len) ? iov[i].iov_len - from : len;
+		len -= out[n].iov_len;
+		from = 0;
+		n++;
+	}
+
+	return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : scatter_bytes
+// Description  : Copies bytes into the start of a buffer list, in order
+//
+// Inputs       : iov - the buffer list, holding at least len bytes
+//                iovcnt - the number of buffers in iov
+//                bytes - the bytes to copy
+//                len - the number of bytes
+// Outputs      : none
+
+static void scatter_bytes(const struct iovec *iov, int iovcnt, const char *bytes, uint32_t len) {
+
+	int i;
+	uint32_t n;
+
+	for( i=0; i<iovcnt && len>0; i++, bytes+=n, len-=n ) {
+		n = (iov[i].iov_len < len) ? iov[i].iov_len : len;
+		memcpy(iov[i].iov_base, bytes, n);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_object
+// Description  : Finds where the object holding one stripe of a file is recorded
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                stripe - the index of the stripe within the file
+// Outputs      : pointer to the object id of the stripe
+
+static CrudOID *stripe_object(int16_t file, uint32_t stripe) {
+
+	// The first stripe lives in the file table entry itself, so small files look exactly as they always have
+	if( stripe == 0 )
+		return &crud_file_table[file].object_id;
+
+	return &crud_layout_table[file].stripes[stripe-1];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : striped_length
+// Description  : Finds the bytes of a file held by its stripes, which is all
+//                of it but any appended segments
+//
+// Inputs       : file - the index of the file in crud_file_table
+// Outputs      : the number of bytes in the stripes
+
+static uint32_t striped_length(int16_t file) {
+
+	return crud_file_table[file].length - crud_segment_table[file].bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_length
+// Description  : Finds the bytes of one stripe of a file of a given length
+//
+// Inputs       : fileLength - the bytes held by the file's stripes
+//                stripe - the index of the stripe within the file
+// Outputs      : the number of bytes in the stripe
+
+static uint32_t stripe_length(uint32_t fileLength, uint32_t stripe) {
+
+	uint32_t stripeStart = stripe * CRUD_STRIPE_SIZE;
+
+	if( fileLength <= stripeStart )
+		return 0;
+	return (fileLength - stripeStart < CRUD_STRIPE_SIZE) ? fileLength - stripeStart : CRUD_STRIPE_SIZE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : free_arena
+// Description  : Unmaps a thread's staging arena as the thread exits
+//
+// Inputs       : arg - the arena
+// Outputs      : none
+
+static void free_arena(void *arg) {
+
+	CrudThreadArena *arena = arg;
+
+	munmap(arena->stripe, arena->size);
+	free(arena);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : create_arena_key
+// Description  : Creates the key holding each thread's staging arena
+//
+// Inputs       : none
+// Outputs      : none
+
+static void create_arena_key(void) {
+
+	pthread_key_create(&crud_arena_key, free_arena);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : thread_arena
+// Description  : Returns the calling thread's staging arena, mapping it the
+//                first time the thread asks.  An arena large enough for huge
+//                pages is asked to be backed by them.
+//
+// Inputs       : none
+// Outputs      : the arena, NULL if failure
+
+static CrudThreadArena *thread_arena(void) {
+
+	CrudThreadArena *arena;
+	size_t size = 3*CRUD_STRIPE_SIZE + CRUD_MAX_FILE_STRIPES*CRUD_MAX_IOVECS*sizeof(struct iovec);
+	char *mapped;
+
+	pthread_once(&crud_arena_once, create_arena_key);
+	arena = pthread_getspecific(crud_arena_key);
+	if( arena != NULL )
+		return arena;
+
+	arena = malloc(sizeof(CrudThreadArena));
+	if( arena == NULL )
+		return NULL; // ERROR - malloc returned a NULL pointer
+
+	mapped = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if( mapped == MAP_FAILED ) {
+		free(arena);
+		return NULL; // ERROR - the arena could not be mapped
+	}
+#ifdef MADV_HUGEPAGE
+	if( size >= CRUD_HUGE_PAGE_SIZE )
+		madvise(mapped, size, MADV_HUGEPAGE);
+#endif
+
+	arena->stripe = mapped;
+	arena->packed = &mapped[CRUD_STRIPE_SIZE];
+	arena->copy = &mapped[2*CRUD_STRIPE_SIZE];
+	arena->slices = (struct iovec *)&mapped[3*CRUD_STRIPE_SIZE];
+	arena->size = size;
+	if( pthread_setspecific(crud_arena_key, arena) ) {
+		free_arena(arena);
+		return NULL; // ERROR - the arena could not be attached to the thread
+	}
+	return arena;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : is_zero
+// Description  : Checks whether a run of bytes is all zeros, comparing the
+//                run against itself shifted by one byte
+//
+// Inputs       : bytes - the run
+//                len - the number of bytes in the run
+// Outputs      : 1 if every byte is zero, 0 otherwise
+
+static int is_zero(const char *bytes, uint32_t len) {
+
+	return len == 0 || (bytes[0] == 0 && memcmp(bytes, bytes + 1, len - 1) == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : page_length
+// Description  : Finds the bytes of one page of a stripe, the last page being
+//                cut short by the end of the stripe
+//
+// Inputs       : length - the length of the stripe
+//                page - the index of the page within the stripe
+// Outputs      : the number of bytes in the page
+
+static uint32_t page_length(uint32_t length, uint32_t page) {
+
+	uint32_t start = page * CRUD_SPARSE_PAGE;
+
+	if( start >= length )
+		return 0;
+	return (length - start < CRUD_SPARSE_PAGE) ? length - start : CRUD_SPARSE_PAGE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stored_length
+// Description  : Finds the bytes of a stripe that its object holds
+//
+// Inputs       : length - the length of the stripe
+//                holes - the stripe's pages that are not stored
+// Outputs      : the number of bytes stored
+
+static uint32_t stored_length(uint32_t length, uint32_t holes) {
+
+	uint32_t page, stored = 0;
+
+	for( page=0; page<CRUD_SPARSE_PAGES; page++ ) {
+		if( !(holes & (1u << page)) )
+			stored += page_length(length, page);
+	}
+	return stored;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_holes
+// Description  : Finds the pages of a stripe that are all zeros
+//
+// Inputs       : stripe - the stripe's bytes
+//                length - the length of the stripe
+// Outputs      : a bit per page that is all zeros
+
+static uint32_t find_holes(const char *stripe, uint32_t length) {
+
+	uint32_t page, holes = 0;
+
+	for( page=0; page*CRUD_SPARSE_PAGE < length; page++ ) {
+		if( is_zero(&stripe[page*CRUD_SPARSE_PAGE], page_length(length, page)) )
+			holes |= 1u << page;
+	}
+	return holes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compact_pages
+// Description  : Moves the stored pages of a stripe to the front of its
+//                buffer, in order, leaving out the holes
+//
+// Inputs       : stripe - the stripe's bytes, compacted in place
+//                length - the length of the stripe
+//                holes - the stripe's pages to leave out
+// Outputs      : the number of bytes left at the front of the buffer
+
+static uint32_t compact_pages(char *stripe, uint32_t length, uint32_t holes) {
+
+	uint32_t page, at = 0, len;
+
+	for( page=0; page*CRUD_SPARSE_PAGE < length; page++ ) {
+		len = page_length(length, page);
+		if( !(holes & (1u << page)) ) {
+			memmove(&stripe[at], &stripe[page*CRUD_SPARSE_PAGE], len);
+			at += len;
+		}
+	}
+	return at;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : expand_pages
+// Description  : Spreads the stored pages at the front of a stripe's buffer
+//                back to their places, zeroing the holes.  Pages are moved
+//                from the last, so none is overwritten before it moves.
+//
+// Inputs       : stripe - the stripe's stored bytes, expanded in place
+//                length - the length of the stripe
+//                holes - the stripe's pages that were left out
+// Outputs      : none
+
+static void expand_pages(char *stripe, uint32_t length, uint32_t holes) {
+
+	uint32_t page = (length + CRUD_SPARSE_PAGE - 1) / CRUD_SPARSE_PAGE, at = stored_length(length, holes), len;
+
+	while( page-- > 0 ) {
+		len = page_length(length, page);
+		if( holes & (1u << page) )
+			memset(&stripe[page*CRUD_SPARSE_PAGE], 0, len);
+		else {
+			at -= len;
+			memmove(&stripe[page*CRUD_SPARSE_PAGE], &stripe[at], len);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : in_hole
+// Description  : Checks whether a range of a stripe lies wholly in its holes,
+//                so it reads as zeros without asking the server
+//
+// Inputs       : task - the stripe and range
+// Outputs      : 1 if every page the range touches is a hole, 0 otherwise
+
+static int in_hole(const CrudStripeTask *task) {
+
+	uint32_t page, holes = crud_extent_table[task->file].holes[task->stripe];
+
+	for( page = task->start / CRUD_SPARSE_PAGE; page*CRUD_SPARSE_PAGE < task->end; page++ ) {
+		if( !(holes & (1u << page)) )
+			return 0;
+	}
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writes_zero_page
+// Description  : Checks whether a write fills a whole page of a stripe with
+//                zeros, so the stripe should be stored with a hole
+//
+// Inputs       : task - the stripe and range to write
+// Outputs      : 1 if some page written in full is all zeros, 0 otherwise
+
+static int writes_zero_page(const CrudStripeTask *task) {
+
+	int i, zero = (task->start % CRUD_SPARSE_PAGE == 0); // A page the write starts inside is not written in full
+	uint32_t at = task->start, done, take;
+	const char *bytes;
+
+	for( i=0; i<task->iovcnt; i++ ) {
+		bytes = task->iov[i].iov_base;
+		for( done=0; done<task->iov[i].iov_len; done += take, at += take ) {
+			take = CRUD_SPARSE_PAGE - at % CRUD_SPARSE_PAGE;
+			if( take > task->iov[i].iov_len - done )
+				take = task->iov[i].iov_len - done;
+			zero = zero && is_zero(&bytes[done], take);
+
+			// The page ends at its boundary or at the end of the stripe
+			if( (at + take) % CRUD_SPARSE_PAGE == 0 || at + take == task->newLength ) {
+				if( zero )
+					return 1;
+				zero = 1;
+			}
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_stripe
+// Description  : Receives the whole of a stripe into a staging buffer,
+//                expanding it if it is stored compressed or with holes
+//
+// Inputs       : task - the stripe, whose oldLength is its current length
+//                oid - the object holding the stripe
+//                raw - receives the stripe's bytes
+//                packed - holds a compressed object while it is expanded
+// Outputs      : 0 if successful, -1 if failure
+
+static int load_stripe(CrudStripeTask *task, CrudOID oid, char *raw, char *packed) {
+
+	uint32_t stored = crud_codec_table[task->file].stored[task->stripe];
+	uint32_t holes = crud_extent_table[task->file].holes[task->stripe];
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
+	CrudRequest request;
+	CrudResponse response;
+
+	request = create_crud_request(oid, CRUD_READ, CRUD_STRIPE_SIZE, 0, 0);
+	response = crud_client_operation(request, stored ? packed : raw);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result )
+		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+
+	if( stored )
+		length = crud_lz_decompress(packed, length, raw, CRUD_STRIPE_SIZE);
+	if( length != stored_length(task->oldLength, holes) )
+		return -1; // ERROR - the object does not hold the stored pages of the stripe
+	if( holes )
+		expand_pages(raw, task->oldLength, holes);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_stripe
+// Description  : Reads part of one stripe of a file straight into the task's
+//                buffers.  The object store has no ranged reads, so the parts
+//                of the object outside the read land in a scratch buffer.
+//
+// Inputs       : task - the stripe and range to read
+// Outputs      : 0 if successful, -1 if failure
+
+static int read_stripe(CrudStripeTask *task) {
+
+	// Temporary buffer used to receive the parts of the object outside of the read
+	char *tempBuf = NULL;
+	CrudThreadArena *arena;
+	// The object is received as [bytes before start][task's buffers][bytes after end]
+	struct iovec vec[CRUD_MAX_IOVECS+2];
+
+	int i, n=0;
+	CrudOID oid = *stripe_object(task->file, task->stripe);
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
+	CrudRequest request;
+	CrudResponse response;
+
+	// A stripe with no object, or a range in its holes, reads as zeros
+	if( oid == CRUD_NO_OBJECT || in_hole(task) ) {
+		for( i=0; i<task->iovcnt; i++ )
+			memset(task->iov[i].iov_base, 0, task->iov[i].iov_len);
+		return 0;
+	}
+
+	// A compressed stripe or one with holes is expanded in the thread's staging buffer and copied out
+	if( crud_codec_table[task->file].stored[task->stripe] || crud_extent_table[task->file].holes[task->stripe] ) {
+		arena = thread_arena();
+		if( arena == NULL || load_stripe(task, oid, arena->stripe, arena->packed) )
+			return -1; // ERROR - the stripe could not be received
+		for( i=0, n=task->start; i<task->iovcnt; n += task->iov[i++].iov_len )
+			memcpy(task->iov[i].iov_base, &arena->stripe[n], task->iov[i].iov_len);
+		return 0;
+	}
+
+	// Use the thread's staging buffer to hold the parts of the object that were not asked for
+	if( task->start > 0 || task->end < CRUD_STRIPE_SIZE ) {
+		arena = thread_arena();
+		if( arena == NULL )
+			return -1; // ERROR - the thread has no staging buffer
+		tempBuf = arena->stripe;
+	}
+
+	// Both discarded regions may share tempBuf since neither is ever looked at
+	if( task->start > 0 ) {
+		vec[n].iov_base = tempBuf;
+		vec[n++].iov_len = task->start;
+	}
+	memcpy(&vec[n], task->iov, task->iovcnt*sizeof(struct iovec));
+	n += task->iovcnt;
+	if( task->end < CRUD_STRIPE_SIZE ) {
+		vec[n].iov_base = tempBuf;
+		vec[n++].iov_len = CRUD_STRIPE_SIZE - task->end;
+	}
+
+	request = create_crud_request(oid, CRUD_READ, CRUD_STRIPE_SIZE, 0, 0);
+	response = crud_client_operation_v(request, vec, n);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result || length < task->end )
+		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : chunk_home
+// Description  : Picks the slot of the chunk index a fingerprint probes from
+//
+// Inputs       : fingerprint - the fingerprint
+// Outputs      : the slot
+
+static uint32_t chunk_home(const uint8_t *fingerprint) {
+
+	uint32_t word;
+
+	memcpy(&word, fingerprint, sizeof(word));
+	return word % CRUD_MAX_CHUNKS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_chunk
+// Description  : Looks a fingerprint up in the chunk index, called with
+//                crud_chunk_lock held
+//
+// Inputs       : fingerprint - the fingerprint
+// Outputs      : the slot holding it, or the free slot it would go in
+
+static uint32_t find_chunk(const uint8_t *fingerprint) {
+
+	uint32_t i = chunk_home(fingerprint);
+
+	while( crud_chunk_table[i].refs &&
+			memcmp(crud_chunk_table[i].fingerprint, fingerprint, CRUD_CHUNK_FINGERPRINT) != 0 )
+		i = (i + 1) % CRUD_MAX_CHUNKS;
+	return i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : chunk_of
+// Description  : Finds the slot of the chunk index holding an object, called
+//                with crud_chunk_lock held
+//
+// Inputs       : oid - the object
+// Outputs      : the slot, CRUD_MAX_CHUNKS if the object is not indexed
+
+static uint32_t chunk_of(CrudOID oid) {
+
+	uint32_t i;
+
+	for( i=0; i<CRUD_MAX_CHUNKS; i++ ) {
+		if( crud_chunk_table[i].refs && crud_chunk_table[i].object == oid )
+			break;
+	}
+	return i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : share_chunk
+// Description  : Takes a reference on the indexed object with a fingerprint
+//
+// Inputs       : fingerprint - the fingerprint
+//                oid - set to the object if it is indexed
+//                stored - set to how the object is stored if it is indexed
+// Outputs      : 1 if the object was found, 0 if not
+
+static int share_chunk(const uint8_t *fingerprint, CrudOID *oid, uint32_t *stored) {
+
+	uint32_t i;
+	int found;
+
+	pthread_mutex_lock(&crud_chunk_lock);
+	i = find_chunk(fingerprint);
+	found = crud_chunk_table[i].refs > 0;
+	if( found ) {
+		crud_chunk_table[i].refs++;
+		*oid = crud_chunk_table[i].object;
+		*stored = crud_chunk_table[i].stored;
+	}
+	pthread_mutex_unlock(&crud_chunk_lock);
+
+	return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : index_chunk
+// Description  : Adds a newly created object to the chunk index.  If another
+//                writer indexed the same contents meanwhile, its object is
+//                shared instead and the new one deleted.
+//
+// Inputs       : fingerprint - the fingerprint of the object's stripe
+//                oid - the new object, set to the one to use
+//                stored - how the new object is stored, set to how the one to use is
+// Outputs      : 1 if the object to use is indexed, 0 if the index is full
+
+static int index_chunk(const uint8_t *fingerprint, CrudOID *oid, uint32_t *stored) {
+
+	CrudOID created = *oid;
+	uint32_t i;
+
+	pthread_mutex_lock(&crud_chunk_lock);
+	i = find_chunk(fingerprint);
+	if( crud_chunk_table[i].refs > 0 ) {
+		crud_chunk_table[i].refs++;
+		*oid = crud_chunk_table[i].object;
+		*stored = crud_chunk_table[i].stored;
+	} else if( crud_chunks_used + crud_chunks_reserved < CRUD_CHUNK_FILL ) {
+		memcpy(crud_chunk_table[i].fingerprint, fingerprint, CRUD_CHUNK_FINGERPRINT);
+		crud_chunk_table[i].object = created;
+		crud_chunk_table[i].stored = *stored;
+		crud_chunk_table[i].refs = 1;
+		crud_chunks_used++;
+	} else {
+		pthread_mutex_unlock(&crud_chunk_lock);
+		return 0; // The index is full, so the object stays private to its stripe
+	}
+	pthread_mutex_unlock(&crud_chunk_lock);
+
+	if( *oid != created )
+		retire_object(created); // A failure only leaves an unreferenced object behind
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : release_chunk
+// Description  : Drops a stripe's reference on an indexed object, retiring
+//                the object along with its last reference.  The slot is
+//                emptied by moving later entries of its probe run back, so
+//                lookups never need tombstones.
+//
+// Inputs       : oid - the object
+// Outputs      : 0 if successful, -1 if failure
+
+static int release_chunk(CrudOID oid) {
+
+	uint32_t i, j, home;
+	int last = 1;
+
+	pthread_mutex_lock(&crud_chunk_lock);
+	i = chunk_of(oid);
+	if( i < CRUD_MAX_CHUNKS ) {
+		last = (--crud_chunk_table[i].refs == 0);
+		if( last ) {
+			crud_chunks_used--;
+			for( j = (i + 1) % CRUD_MAX_CHUNKS; crud_chunk_table[j].refs; j = (j + 1) % CRUD_MAX_CHUNKS ) {
+				home = chunk_home(crud_chunk_table[j].fingerprint);
+				// Move the entry back unless its home lies cyclically in (i, j]
+				if( (i < j) ? (home <= i || home > j) : (home <= i && home > j) ) {
+					crud_chunk_table[i] = crud_chunk_table[j];
+					crud_chunk_table[j].refs = 0;
+					i = j;
+				}
+			}
+			crud_chunk_table[i].refs = 0;
+		}
+	}
+	pthread_mutex_unlock(&crud_chunk_lock);
+
+	// An object missing from the index belonged to this stripe alone
+	return last ? retire_object(oid) : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : store_stripe
+// Description  : Sends the new contents of a stripe, updating its object in
+//                place when the object keeps its length and replacing the
+//                object otherwise
+//
+// Inputs       : slot - the stripe's object, updated if it is replaced
+//                vec - the stripe's new contents
+//                n - the number of buffers in vec
+//                length - the new length of the stripe's object
+//                oldLength - the current length of the stripe's object
+// Outputs      : 0 if successful, -1 if failure
+
+static int store_stripe(CrudOID *slot, const struct iovec *vec, int n, uint32_t length, uint32_t oldLength) {
+
+	CrudOID oldOid;
+	uint32_t id, rlength; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
+	CrudRequest request;
+	CrudResponse response;
+
+	// CASE 1: The write DOES NOT change the size of the object, so update it in place
+	if( *slot != CRUD_NO_OBJECT && length == oldLength ) {
+
+		request = create_crud_request(*slot, CRUD_UPDATE, length, 0, 0);
+		response = crud_client_operation_v(request, vec, n);
+
+		// Check for CRUD command success
+		extract_crud_response(response, &id, &req, &rlength, &flag, &result);
+		if( result )
+			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+	}
+
+	// CASE 2: The stripe is new or its object DOES change size, so replace the object
+	else {
+
+		// Create the new object of the new length, leaving the old one whole if that fails
+		request = create_crud_request(0, CRUD_CREATE, length, 0, 0);
+		response = crud_client_operation_v(request, vec, n);
+
+		// Check for CRUD command success
+		extract_crud_response(response, &id, &req, &rlength, &flag, &result);
+		if( result )
+			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+
+		// Swap the stripe over to it, and let the old object go once no saved table names it
+		oldOid = *slot;
+		*slot = id;
+		if( oldOid != CRUD_NO_OBJECT && retire_object(oldOid) )
+			return -1; // ERROR - the old object could not be released
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_packed_stripe
+// Description  : Writes part of a stripe of a file that is compressed,
+//                deduplicated or has holes, or was.  The whole stripe is
+//                assembled in the thread's staging buffer, shared with any
+//                file that already stored the same bytes if the file is
+//                deduplicated, and stored without its pages of zeros and
+//                compressed when that makes it smaller.
+//
+// Inputs       : task - the stripe and range to write
+// Outputs      : 0 if successful, -1 if failure
+
+static int write_packed_stripe(CrudStripeTask *task) {
+
+	CrudFileCodecType *codec = &crud_codec_table[task->file];
+	uint32_t *holes = &crud_extent_table[task->file].holes[task->stripe];
+	CrudOID *slot = stripe_object(task->file, task->stripe), oldOid = *slot, newOid = CRUD_NO_OBJECT;
+	uint8_t bit = 1 << task->stripe, oldIndexed = __atomic_load_n(&codec->indexed, __ATOMIC_RELAXED) & bit, newIndexed = 0;
+	uint8_t digest[CRUD_SHA256_SIZE];
+	uint32_t at, length, oldStored = codec->stored[task->stripe], newStored = 0, newHoles;
+	int32_t packedLength = -1;
+	CrudThreadArena *arena = thread_arena();
+	CrudSha256 sha;
+	struct iovec vec;
+	int i;
+
+	if( arena == NULL )
+		return -1; // ERROR - the thread has no staging buffer
+
+	// Expand the current stripe if any of it is kept, a stripe with no object or the
+	// bytes past its end being zeros
+	if( task->start > 0 || task->end < task->newLength ) {
+		if( oldOid == CRUD_NO_OBJECT )
+			memset(arena->stripe, 0, task->newLength);
+		else {
+			if( load_stripe(task, oldOid, arena->stripe, arena->packed) )
+				return -1; // ERROR - the stripe could not be received
+			if( task->newLength > task->oldLength )
+				memset(&arena->stripe[task->oldLength], 0, task->newLength - task->oldLength);
+		}
+	}
+	for( i=0, at=task->start; i<task->iovcnt; at += task->iov[i++].iov_len )
+		memcpy(&arena->stripe[at], task->iov[i].iov_base, task->iov[i].iov_len);
+
+	// A stripe of nothing but zeros needs no object at all
+	newHoles = find_holes(arena->stripe, task->newLength);
+	if( stored_length(task->newLength, newHoles) == 0 ) {
+		newHoles = 0;
+		goto replace;
+	}
+
+	// A deduplicated stripe whose bytes are already stored just shares their object
+	if( codec->dedup ) {
+		crud_sha256_init(&sha);
+		crud_sha256_update(&sha, arena->stripe, task->newLength);
+		crud_sha256_final(&sha, digest);
+		if( share_chunk(digest, &newOid, &newStored) ) {
+			newIndexed = bit;
+			goto replace;
+		}
+	}
+
+	// Leave the holes out of the object, then keep it compressed only if that makes it smaller
+	length = newHoles ? compact_pages(arena->stripe, task->newLength, newHoles) : task->newLength;
+	if( codec->codec == CRUD_CODEC_LZ )
+		packedLength = crud_lz_compress(arena->stripe, length, arena->packed, length - 1);
+	if( packedLength > 0 ) {
+		vec.iov_base = arena->packed;
+		vec.iov_len = packedLength;
+		newStored = packedLength;
+	} else {
+		vec.iov_base = arena->stripe;
+		vec.iov_len = length;
+	}
+
+	// A private object can be rewritten where it is
+	if( !codec->dedup && !oldIndexed ) {
+		if( store_stripe(slot, &vec, 1, vec.iov_len, oldStored ? oldStored : stored_length(task->oldLength, *holes)) ) {
+			if( *slot == CRUD_NO_OBJECT ) {
+				codec->stored[task->stripe] = 0;
+				*holes = 0;
+			}
+			return -1; // ERROR - the stripe could not be stored
+		}
+		codec->stored[task->stripe] = newStored;
+		*holes = newHoles;
+		return 0;
+	}
+
+	// Otherwise the stripe gets a new object, indexed if the file is deduplicated
+	if( store_stripe(&newOid, &vec, 1, vec.iov_len, 0) )
+		return -1; // ERROR - the stripe could not be stored
+	if( codec->dedup && index_chunk(digest, &newOid, &newStored) )
+		newIndexed = bit;
+
+replace:
+	// Point the stripe at its new object and let go of the old one
+	*slot = newOid;
+	codec->stored[task->stripe] = newStored;
+	*holes = newHoles;
+	// Other stripes of the file may be written at the same time, so only this bit is touched
+	if( newIndexed )
+		__atomic_fetch_or(&codec->indexed, bit, __ATOMIC_RELAXED);
+	else
+		__atomic_fetch_and(&codec->indexed, (uint8_t)~bit, __ATOMIC_RELAXED);
+	if( oldOid != CRUD_NO_OBJECT && (oldIndexed ? release_chunk(oldOid) : retire_object(oldOid)) )
+		return -1; // ERROR - the old object could not be released
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_stripe
+// Description  : Writes the task's buffers into part of one stripe of a file.
+//                The old object is only read back when some of it survives
+//                the write, and a stripe whose length does not change is
+//                updated in place.  Stripes that have or would get a hole
+//                are left to write_packed_stripe.
+//
+// Inputs       : task - the stripe and range to write
+// Outputs      : 0 if successful, -1 if failure
+
+static int write_stripe(CrudStripeTask *task) {
+
+	// Temporary buffer used to hold the bytes that are currently in the stripe
+	char *tempBuf2 = NULL;
+	CrudThreadArena *arena;
+	// The stripe is sent as [old bytes before start][task's buffers][old bytes after end]
+	struct iovec vec[CRUD_MAX_IOVECS+2];
+
+	int n=0;
+	CrudOID *slot = stripe_object(task->file, task->stripe);
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
+	CrudRequest request;
+	CrudResponse response;
+
+	// Stripes of compressed or deduplicated files go through the staging buffer
+	if( crud_codec_table[task->file].codec != CRUD_CODEC_NONE || crud_codec_table[task->file].dedup ||
+			crud_codec_table[task->file].stored[task->stripe] || (__atomic_load_n(&crud_codec_table[task->file].indexed, __ATOMIC_RELAXED) & (1 << task->stripe)) )
+		return write_packed_stripe(task);
+
+	// So do stripes with holes, stripes the write leaves a gap in and writes of pages of zeros
+	if( crud_extent_table[task->file].holes[task->stripe] || (*slot == CRUD_NO_OBJECT && task->oldLength > 0) ||
+			(task->newLength > task->oldLength && (task->start > task->oldLength || task->end < task->newLength)) ||
+			writes_zero_page(task) )
+		return write_packed_stripe(task);
+
+	// Read the current stripe if any of it is kept
+	if( task->start > 0 || task->end < task->newLength ) {
+
+		if( *slot == CRUD_NO_OBJECT )
+			return -1; // ERROR - the bytes to keep are not stored anywhere
+
+		arena = thread_arena();
+		if( arena == NULL )
+			return -1; // ERROR - the thread has no staging buffer
+		tempBuf2 = arena->stripe;
+
+		request = create_crud_request(*slot, CRUD_READ, CRUD_STRIPE_SIZE, 0, 0);
+		response = crud_client_operation(request, tempBuf2);
+
+		// Check for CRUD command success
+		extract_crud_response(response, &id, &req, &length, &flag, &result);
+		if( result )
+			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+
+		if( task->start > 0 ) {
+			vec[n].iov_base = tempBuf2;
+			vec[n++].iov_len = task->start;
+		}
+	}
+	if( task->iovcnt > 0 )
+		memcpy(&vec[n], task->iov, task->iovcnt*sizeof(struct iovec));
+	n += task->iovcnt;
+	if( task->end < task->newLength ) {
+		vec[n].iov_base = &tempBuf2[task->end];
+		vec[n++].iov_len = task->newLength - task->end;
+	}
+
+	return store_stripe(slot, vec, n, task->newLength, task->oldLength);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : enqueue_work
+// Description  : Adds an item to the back of a worker queue, called with
+//                crud_queue_lock held
+//
+// Inputs       : head, tail - the queue
+//                item - the work to add
+// Outputs      : none
+
+static void enqueue_work(CrudWorkItem **head, CrudWorkItem **tail, CrudWorkItem *item) {
+
+	item->next = NULL;
+	if( *head == NULL )
+		*head = item;
+	else
+		(*tail)->next = item;
+	*tail = item;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : dequeue_work
+// Description  : Takes the item at the front of a worker queue, called with
+//                crud_queue_lock held
+//
+// Inputs       : head, tail - the queue
+// Outputs      : the item, NULL if the queue is empty
+
+static CrudWorkItem *dequeue_work(CrudWorkItem **head, CrudWorkItem **tail) {
+
+	CrudWorkItem *item = *head;
+
+	if( item != NULL ) {
+		*head = item->next;
+		if( *head == NULL )
+			*tail = NULL;
+	}
+
+	return item;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_stripe_work
+// Description  : Moves one queued stripe and tells its operation once the
+//                last of its stripes is done
+//
+// Inputs       : item - the stripe task
+// Outputs      : none
+
+static void run_stripe_work(CrudWorkItem *item) {
+
+	CrudStripeTask *task = (CrudStripeTask *)item;
+	CrudStripeBatch *batch = task->batch;
+
+	task->result = task->write ? write_stripe(task) : read_stripe(task);
+
+	pthread_mutex_lock(&batch->lock);
+	if( --batch->pending == 0 )
+		pthread_cond_signal(&batch->done);
+	pthread_mutex_unlock(&batch->lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : io_worker
+// Description  : Body of each thread of the I/O worker pool, running queued
+//                work until the process exits.  Every worker sends its
+//                requests on its own connection from the client's pool.
+//
+// Inputs       : arg - unused
+// Outputs      : never returns
+
+static void *io_worker(void *arg) {
+
+	CrudWorkItem *item;
+
+	for( ;; ) {
+
+		// Wait for work, taking stripes of operations in progress first
+		pthread_mutex_lock(&crud_queue_lock);
+		while( crud_stripe_head == NULL && crud_async_head == NULL )
+			pthread_cond_wait(&crud_queue_ready, &crud_queue_lock);
+		item = dequeue_work(&crud_stripe_head, &crud_stripe_tail);
+		if( item == NULL )
+			item = dequeue_work(&crud_async_head, &crud_async_tail);
+		pthread_mutex_unlock(&crud_queue_lock);
+
+		item->run(item);
+	}
+
+	return arg;
+}
+
+////////
+//
+// Function     : start_io_workers
+// Description  : Starts the I/O worker pool, run exactly once
+//
+// Inputs       : none
+// Outputs      : none
+
+static void start_io_workers(void) {
+
+	int i;
+	pthread_t thread;
+
+	for( i=0; i<CRUD_IO_WORKERS; i++ ) {
+		if( pthread_create(&thread, NULL, io_worker, NULL) == 0 ) {
+			pthread_detach(thread);
+			crud_io_workers++;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_stripe_tasks
+// Description  : Moves every stripe of one operation.  The calling thread
+//                moves the first stripe itself while the worker pool moves
+//                the others in parallel, then waits for all of them.
+//
+// Inputs       : tasks - the stripes to move
+//                ntasks - the number of stripes
+// Outputs      : 0 if every stripe was moved, -1 if any failed
+
+static int run_stripe_tasks(CrudStripeTask *tasks, int ntasks) {
+
+	int i, ret=0;
+	CrudStripeBatch batch;
+	CrudWorkItem *item;
+
+	pthread_once(&crud_workers_once, start_io_workers);
+
+	// Operations within a single stripe are not worth handing off
+	if( ntasks == 1 || crud_io_workers == 0 ) {
+		for( i=0; i<ntasks; i++ ) {
+			if( (tasks[i].write ? write_stripe(&tasks[i]) : read_stripe(&tasks[i])) )
+				return -1; // ERROR - the stripe could not be moved
+		}
+		return 0;
+	}
+
+	// Queue every stripe but the first for the workers
+	pthread_mutex_init(&batch.lock, NULL);
+	pthread_cond_init(&batch.done, NULL);
+	batch.pending = ntasks-1;
+
+	pthread_mutex_lock(&crud_queue_lock);
+	for( i=1; i<ntasks; i++ ) {
+		tasks[i].work.run = run_stripe_work;
+		tasks[i].batch = &batch;
+		enqueue_work(&crud_stripe_head, &crud_stripe_tail, &tasks[i].work);
+	}
+	pthread_cond_broadcast(&crud_queue_ready);
+	pthread_mutex_unlock(&crud_queue_lock);
+
+	tasks[0].result = tasks[0].write ? write_stripe(&tasks[0]) : read_stripe(&tasks[0]);
+
+	// Help with queued stripes rather than wait, since the workers may all be
+	// running asynchronous operations that are themselves waiting on stripes
+	for( ;; ) {
+		pthread_mutex_lock(&crud_queue_lock);
+		item = dequeue_work(&crud_stripe_head, &crud_stripe_tail);
+		pthread_mutex_unlock(&crud_queue_lock);
+		if( item == NULL )
+			break;
+		item->run(item);
+	}
+
+	// Wait for the workers to finish the rest
+	pthread_mutex_lock(&batch.lock);
+	while( batch.pending > 0 )
+		pthread_cond_wait(&batch.done, &batch.lock);
+	pthread_mutex_unlock(&batch.lock);
+	pthread_mutex_destroy(&batch.lock);
+	pthread_cond_destroy(&batch.done);
+
+	for( i=0; i<ntasks; i++ ) {
+		if( tasks[i].result )
+			ret = -1; // ERROR - the stripe could not be moved
+	}
+
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : move_stripes
+// Description  : Splits a read or write of a byte range of a file into one
+//                task per stripe it touches and moves them all
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                iov - the caller's buffers for the range
+//                iovcnt - the number of buffers in iov
+//                offset - the first byte of the range
+//                count - the number of bytes in the range
+//                newFileLength - the length of the file once the range is written
+//                write - nonzero to write the range, zero to read it
+// Outputs      : 0 if successful, -1 if failure
+
+static int move_stripes(int16_t file, const struct iovec *iov, int iovcnt, uint32_t offset,
+		uint32_t count, uint32_t newFileLength, uint8_t write) {
+
+	int i, ntasks;
+	uint32_t first, stripeStart, from, to, oldFileLength = striped_length(file);
+	CrudStripeTask tasks[CRUD_MAX_FILE_STRIPES];
+	CrudThreadArena *arena = thread_arena();
+	struct iovec *slices;
+
+	if( arena == NULL )
+		return -1; // ERROR - the thread has no staging buffers
+	slices = arena->slices;
+
+	first = offset / CRUD_STRIPE_SIZE;
+	ntasks = (offset + count - 1) / CRUD_STRIPE_SIZE - first + 1;
+
+	// Describe the part of the range that falls in each stripe
+	for( i=0; i<ntasks; i++ ) {
+		stripeStart = (first + i) * CRUD_STRIPE_SIZE;
+		from = (offset > stripeStart) ? offset : stripeStart;
+		to = (offset + count < stripeStart + CRUD_STRIPE_SIZE) ? offset + count : stripeStart + CRUD_STRIPE_SIZE;
+
+		tasks[i].file = file;
+		tasks[i].stripe = first + i;
+		tasks[i].start = from - stripeStart;
+		tasks[i].end = to - stripeStart;
+		tasks[i].oldLength = (oldFileLength <= stripeStart) ? 0 :
+			((oldFileLength - stripeStart < CRUD_STRIPE_SIZE) ? oldFileLength - stripeStart : CRUD_STRIPE_SIZE);
+		tasks[i].newLength = (newFileLength - stripeStart < CRUD_STRIPE_SIZE) ? newFileLength - stripeStart : CRUD_STRIPE_SIZE;
+		tasks[i].write = write;
+		tasks[i].iov = &slices[i*iovcnt];
+		tasks[i].iovcnt = slice_iovec(iov, iovcnt, from - offset, to - from, tasks[i].iov);
+		tasks[i].result = 0;
+	}
+
+	return run_stripe_tasks(tasks, ntasks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_segments
+// Description  : Reads part of the appended segments of a file straight into
+//                the caller's buffers, the parts of each segment outside the
+//                read landing in a scratch buffer
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                iov - the buffers for the range
+//                iovcnt - the number of buffers in iov
+//                offset - the first byte of the range, which lies in the segments
+//                count - the number of bytes in the range
+// Outputs      : 0 if successful, -1 if failure
+
+static int read_segments(int16_t file, const struct iovec *iov, int iovcnt, uint32_t offset, uint32_t count) {
+
+	CrudFileSegmentType *segments = &crud_segment_table[file];
+	CrudThreadArena *arena = thread_arena();
+	// Each segment is received as [bytes before the read][caller's buffers][bytes after the read]
+	struct iovec vec[CRUD_MAX_IOVECS+2];
+	uint32_t i, segmentStart = striped_length(file), from, to;
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
+	CrudRequest request;
+	CrudResponse response;
+	int n;
+
+	if( arena == NULL )
+		return -1; // ERROR - the thread has no staging buffers
+
+	for( i=0; i<segments->count && count > 0; segmentStart += segments->lengths[i++] ) {
+		if( offset >= segmentStart + segments->lengths[i] )
+			continue;
+		from = offset - segmentStart;
+		to = (segments->lengths[i] - from < count) ? segments->lengths[i] : from + count;
+
+		n = 0;
+		if( from > 0 ) {
+			vec[n].iov_base = arena->stripe;
+			vec[n++].iov_len = from;
+		}
+		n += slice_iovec(iov, iovcnt, 0, to - from, &vec[n]);
+		if( to < segments->lengths[i] ) {
+			vec[n].iov_base = arena->stripe;
+			vec[n++].iov_len = segments->lengths[i] - to;
+		}
+
+		request = create_crud_request(segments->objects[i], CRUD_READ, segments->lengths[i], 0, 0);
+		response = crud_client_operation_v(request, vec, n);
+
+		// Check for CRUD command success
+		extract_crud_response(response, &id, &req, &length, &flag, &result);
+		if( result || length != segments->lengths[i] )
+			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+
+		// Move the caller's buffers past the bytes read, slicing never overwrites an entry it has yet to read
+		iovcnt = slice_iovec(iov, iovcnt, to - from, count - (to - from), arena->slices);
+		iov = arena->slices;
+		offset += to - from;
+		count -= to - from;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : merge_segments
+// Description  : Moves the appended segments of a file into its stripes and
+//                retires them, called with the file's write lock held.  The
+//                stripes take the bytes before the segments are forgotten,
+//                so a failure leaves the file as it was.
+//
+// Inputs       : file - the index of the file in crud_file_table
+// Outputs      : 0 if successful, -1 if failure
+
+static int merge_segments(int16_t file) {
+
+	CrudFileSegmentType *segments = &crud_segment_table[file];
+	CrudOID objects[CRUD_MAX_SEGMENTS];
+	uint32_t i, count = segments->count, bytes = segments->bytes, start = striped_length(file);
+	struct iovec iov;
+
+	if( count == 0 )
+		return 0;
+
+	iov.iov_base = malloc(bytes);
+	iov.iov_len = bytes;
+	if( iov.iov_base == NULL )
+		return -1; // ERROR - no memory to gather the segments
+
+	if( read_segments(file, &iov, 1, start, bytes) ||
+			move_stripes(file, &iov, 1, start, bytes, crud_file_table[file].length, 1) ) {
+		free(iov.iov_base);
+		return -1; // ERROR - the segments could not be moved into the stripes
+	}
+	free(iov.iov_base);
+
+	memcpy(objects, segments->objects, sizeof(objects));
+	segments->count = 0;
+	segments->bytes = 0;
+
+	// A segment that could not be retired only wastes space, the file no longer refers to it
+	for( i=0; i<count; i++ )
+		retire_object(objects[i]);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_merge_work
+// Description  : Merges the segments of one file on a worker, as queued by
+//                queue_merge
+//
+// Inputs       : item - the file's entry in crud_merge_work
+// Outputs      : none
+
+static void run_merge_work(CrudWorkItem *item) {
+
+	int16_t file = item - crud_merge_work;
+
+	// Appends made from here on may queue another merge
+	pthread_mutex_lock(&crud_queue_lock);
+	crud_merge_queued[file] = 0;
+	pthread_mutex_unlock(&crud_queue_lock);
+
+	pthread_rwlock_wrlock(&crud_file_locks[file]);
+	merge_segments(file);
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	pthread_mutex_lock(&crud_queue_lock);
+	if( --crud_merges_pending == 0 )
+		pthread_cond_broadcast(&crud_merges_done);
+	pthread_mutex_unlock(&crud_queue_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : queue_merge
+// Description  : Queues a background merge of a file's segments unless one is
+//                already queued.  Without workers the segments are merged by
+//                the append that finds them full.
+//
+// Inputs       : file - the index of the file in crud_file_table
+// Outputs      : none
+
+static void queue_merge(int16_t file) {
+
+	pthread_once(&crud_workers_once, start_io_workers);
+	if( crud_io_workers == 0 )
+		return;
+
+	pthread_mutex_lock(&crud_queue_lock);
+	if( !crud_merge_queued[file] ) {
+		crud_merge_queued[file] = 1;
+		crud_merges_pending++;
+		crud_merge_work[file].run = run_merge_work;
+		enqueue_work(&crud_async_head, &crud_async_tail, &crud_merge_work[file]);
+		pthread_cond_signal(&crud_queue_ready);
+	}
+	pthread_mutex_unlock(&crud_queue_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : append_segment
+// Description  : Appends bytes to a file in append mode as a new segment,
+//                which costs one CREATE however long the file is
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                iov - the bytes to append
+//                iovcnt - the number of buffers in iov
+//                count - the number of bytes to append
+// Outputs      : 0 if successful, -1 if failure
+
+static int append_segment(int16_t file, const struct iovec *iov, int iovcnt, uint32_t count) {
+
+	CrudFileSegmentType *segments = &crud_segment_table[file];
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
+	CrudRequest request;
+	CrudResponse response;
+
+	// Make room if the background merge has fallen behind
+	if( segments->count == CRUD_MAX_SEGMENTS && merge_segments(file) )
+		return -1; // ERROR - the segments could not be merged
+
+	request = create_crud_request(0, CRUD_CREATE, count, 0, 0);
+	response = crud_client_operation_v(request, iov, iovcnt);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result )
+		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+
+	segments->objects[segments->count] = id;
+	segments->lengths[segments->count++] = count;
+	segments->bytes += count;
+	crud_file_table[file].length += count;
+
+	if( segments->count >= CRUD_SEGMENT_MERGE )
+		queue_merge(file);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fits_inline
+// Description  : Decides if a file can be kept in the tables at a length,
+//                which it can if it is kept there already or is empty
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                length - the length of the file
+// Outputs      : nonzero if it can
+
+static uint8_t fits_inline(int16_t file, uint32_t length) {
+
+	return length <= __atomic_load_n(&crud_inline_limit, __ATOMIC_RELAXED) &&
+		(crud_inline_table[file].inlined || crud_file_table[file].length == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : spill_inline
+// Description  : Moves a file kept in the tables into stripes of its own,
+//                called with the file's write lock held.  A file that is not
+//                kept in the tables is left as it is.
+//
+// Inputs       : file - the index of the file in crud_file_table
+// Outputs      : 0 if successful, -1 if failure
+
+static int spill_inline(int16_t file) {
+
+	CrudFileInlineType *tiny = &crud_inline_table[file];
+	uint32_t length = crud_file_table[file].length;
+	struct iovec iov;
+
+	if( !tiny->inlined )
+		return 0;
+
+	// Written from an empty file, the bytes land in a new first stripe
+	iov.iov_base = tiny->data;
+	iov.iov_len = length;
+	crud_file_table[file].length = 0;
+	if( length > 0 && move_stripes(file, &iov, 1, 0, length, length, 1) ) {
+		crud_file_table[file].length = length;
+		return -1; // ERROR - the file could not be moved to its stripes
+	}
+
+	memset(tiny, 0, sizeof(CrudFileInlineType));
+	crud_file_table[file].length = length;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : release_container
+// Description  : Lets go of the container a file is packed in, called with
+//                the file's write lock held.  The file is left empty, and the
+//                container is retired once no file is packed in it.
+//
+// Inputs       : file - the index of the file in crud_file_table
+// Outputs      : 0 if successful, -1 if failure
+
+static int release_container(int16_t file) {
+
+	CrudFilePackType *pack = &crud_pack_table[file];
+	CrudContainerType *container;
+	CrudOID oid = CRUD_NO_OBJECT;
+	int i;
+
+	pthread_mutex_lock(&crud_container_lock);
+	container = &crud_containers[crud_container_slot[file]];
+	container->live -= crud_file_table[file].length;
+	if( --container->files == 0 ) {
+		oid = container->object;
+		container->object = CRUD_NO_OBJECT;
+		for( i=0; i<CRUD_PACK_CACHE; i++ ) {
+			if( crud_container_cache[i].object == oid ) {
+				free(crud_container_cache[i].data);
+				crud_container_cache[i].data = NULL;
+				crud_container_cache[i].object = CRUD_NO_OBJECT;
+			}
+		}
+	}
+	pthread_mutex_unlock(&crud_container_lock);
+
+	pack->container = CRUD_NO_OBJECT;
+	pack->offset = pack->size = 0;
+	crud_file_table[file].length = 0;
+
+	if( oid != CRUD_NO_OBJECT && retire_object(oid) )
+		return -1; // ERROR - the container could not be released
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_packed_file
+// Description  : Reads part of a packed file from its container.  The whole
+//                container is read and kept in memory, as the files packed
+//                with the file are likely to be read next.
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                iov - the buffers for the range, holding at least count bytes
+//                iovcnt - the number of buffers in iov
+//                offset - the first byte of the range, which lies in the file
+//                count - the number of bytes in the range
+// Outputs      : 0 if successful, -1 if failure
+
+static int read_packed_file(int16_t file, const struct iovec *iov, int iovcnt, uint32_t offset, uint32_t count) {
+
+	CrudFilePackType *pack = &crud_pack_table[file];
+	CrudContainerCacheType *entry = NULL;
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
+	CrudRequest request;
+	CrudResponse response;
+	char *data;
+	int i;
+
+	pthread_mutex_lock(&crud_container_lock);
+	for( i=0; i<CRUD_PACK_CACHE && entry == NULL; i++ ) {
+		if( crud_container_cache[i].object == pack->container )
+			entry = &crud_container_cache[i];
+	}
+	pthread_mutex_unlock(&crud_container_lock);
+
+	if( entry == NULL ) {
+		if( (data = malloc(pack->size)) == NULL )
+			return -1; // ERROR - no memory for the container
+		request = create_crud_request(pack->container, CRUD_READ, pack->size, 0, 0);
+		response = crud_client_operation(request, data);
+
+		// Check for CRUD command success
+		extract_crud_response(response, &id, &req, &length, &flag, &result);
+		if( result || length != pack->size ) {
+			free(data);
+			return -1; // ERROR - the container could not be read
+		}
+
+		// Keep it in place of the one read from longest ago, unless another reader got there first
+		pthread_mutex_lock(&crud_container_lock);
+		for( i=0; i<CRUD_PACK_CACHE && entry == NULL; i++ ) {
+			if( crud_container_cache[i].object == pack->container )
+				entry = &crud_container_cache[i];
+		}
+		if( entry != NULL )
+			free(data);
+		else {
+			entry = &crud_container_cache[0];
+			for( i=1; i<CRUD_PACK_CACHE; i++ ) {
+				if( crud_container_cache[i].used < entry->used )
+					entry = &crud_container_cache[i];
+			}
+			free(entry->data);
+			entry->object = pack->container;
+			entry->data = data;
+		}
+	} else
+		pthread_mutex_lock(&crud_container_lock);
+
+	// The container cannot be let go of while the file is locked, but its copy can be replaced
+	entry->used = ++crud_container_ticks;
+	scatter_bytes(iov, iovcnt, &entry->data[pack->offset + offset], count);
+	pthread_mutex_unlock(&crud_container_lock);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unpack_file
+// Description  : Moves a packed file back into stripes of its own, called
+//                with the file's write lock held, so it can be written in
+//                place.  A file that is not packed is left as it is.
+//
+// Inputs       : file - the index of the file in crud_file_table
+// Outputs      : 0 if successful, -1 if failure
+
+static int unpack_file(int16_t file) {
+
+	uint32_t length = crud_file_table[file].length;
+	struct iovec iov;
+	char *bytes;
+
+	if( crud_pack_table[file].container == CRUD_NO_OBJECT )
+		return 0;
+	if( (bytes = malloc(length)) == NULL )
+		return -1; // ERROR - no memory for the file
+
+	// The file has no stripe objects, so the first stripe is a hole the bytes are written over
+	iov.iov_base = bytes;
+	iov.iov_len = length;
+	if( read_packed_file(file, &iov, 1, 0, length) || move_stripes(file, &iov, 1, 0, length, length, 1) ) {
+		free(bytes);
+		return -1; // ERROR - the file could not be moved to its stripes
+	}
+	free(bytes);
+
+	// Stored as a range of the container no more, the file keeps its length
+	release_container(file);
+	crud_file_table[file].length = length;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_file_atv
+// Description  : Reads from a file starting at "offset" into the buffer list
+//                "iov", without touching any handle position.  The objects
+//                are received straight into the caller's buffers, and reads
+//                spanning several stripes fetch them in parallel.  Bytes
+//                still in appended segments are read from the segments,
+//                those of a packed file from its container and those of a
+//                tiny file from the tables.
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                iov - the buffers to place the bytes into, filled in order
+//                iovcnt - the number of buffers in iov
+//                offset - the offset in the file to start reading at
+// Outputs      : the number of bytes read or -1 if failure
+
+static int32_t read_file_atv(int16_t file, const struct iovec *iov, int iovcnt, uint32_t offset) {
+
+	int32_t count, bytesRead=0;
+	uint32_t length = crud_file_table[file].length, striped = striped_length(file), fromStripes = 0;
+	CrudThreadArena *arena;
+
+	if( (count = iovec_length(iov, iovcnt, 0)) == -1 )
+		return -1; // ERROR - buffer list doesn't point to meaningful data
+	if( offset >= length )
+		return bytesRead; // No bytes to read at or past the end of the file so return 0
+	if( count < 1 )
+		return bytesRead; // If no bytes are to be read (count = 0), return 0
+
+	// Read no further than the end of the file
+	bytesRead = (length - offset < (uint32_t)count) ? length - offset : (uint32_t)count;
+
+	// A tiny file is read from the tables, and a packed file is a range of its container
+	if( crud_inline_table[file].inlined ) {
+		scatter_bytes(iov, iovcnt, &crud_inline_table[file].data[offset], bytesRead);
+		return bytesRead;
+	}
+	if( crud_pack_table[file].container != CRUD_NO_OBJECT )
+		return read_packed_file(file, iov, iovcnt, offset, bytesRead) ? -1 : bytesRead;
+
+	// The stripes hold the file up to its appended segments
+	if( offset < striped ) {
+		fromStripes = (striped - offset < (uint32_t)bytesRead) ? striped - offset : (uint32_t)bytesRead;
+		if( move_stripes(file, iov, iovcnt, offset, fromStripes, striped, 0) )
+			return -1; // ERROR - a stripe of the file could not be read
+	}
+	if( fromStripes < (uint32_t)bytesRead ) {
+		if( (arena = thread_arena()) == NULL )
+			return -1; // ERROR - the thread has no staging buffers
+		iovcnt = slice_iovec(iov, iovcnt, fromStripes, bytesRead - fromStripes, arena->slices);
+		if( read_segments(file, arena->slices, iovcnt, offset + fromStripes, bytesRead - fromStripes) )
+			return -1; // ERROR - a segment of the file could not be read
+	}
+
+	return bytesRead;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fill_last_stripe
+// Description  : Pads the stripe a file ends in with zeros to its full
+//                length, which stores the padding as holes
+//
+// Inputs       : file - the index of the file in crud_file_table
+// Outputs      : 0 if successful, -1 if failure
+
+static int fill_last_stripe(int16_t file) {
+
+	CrudStripeTask task;
+
+	task.file = file;
+	task.stripe = crud_file_table[file].length / CRUD_STRIPE_SIZE;
+	task.start = task.end = task.oldLength = crud_file_table[file].length % CRUD_STRIPE_SIZE;
+	task.newLength = CRUD_STRIPE_SIZE;
+	task.write = 1;
+	task.iov = NULL;
+	task.iovcnt = 0;
+	if( write_stripe(&task) )
+		return -1; // ERROR - the stripe could not be padded
+
+	crud_file_table[file].length += CRUD_STRIPE_SIZE - task.oldLength;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_file_atv
+// Description  : Writes the bytes of the buffer list "iov" to a file starting
+//                at "offset", without touching any handle position.  If the
+//                write goes past the end of the file, the file size increases,
+//                and a write starting past the end leaves a hole that is not
+//                stored.  A tiny file is kept in the tables.  Small appends
+//                to a file in append mode become segments.  The caller's
+//                buffers are sent as they are, never flattened, and writes
+//                spanning several stripes send them in parallel.
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                iov - the buffers to write, in order
+//                iovcnt - the number of buffers in iov
+//                offset - the offset in the file to start writing at
+// Outputs      : the number of bytes written or -1 if failure
+
+static int32_t write_file_atv(int16_t file, const struct iovec *iov, int iovcnt, uint32_t offset) {
+
+	int32_t count;
+	int i;
+	uint32_t at; // Offset in the file of each buffer kept in the tables
+	uint32_t newLength; // Length of the file after the write
+
+	if( (count = iovec_length(iov, iovcnt, 1)) == -1 )
+		return -1; // ERROR - buffer list doesn't point to meaningful data
+	if( count < 1 )
+		return 0; // No bytes are to be written from the buffer
+	if( (uint64_t)offset + count > CRUD_MAX_FILE_SIZE )
+		return -1; // ERROR - write would make the file too large
+
+	// A tiny file is kept in the tables, and leaves them once it outgrows them
+	newLength = (offset + count > crud_file_table[file].length) ? offset + count : crud_file_table[file].length;
+	if( fits_inline(file, newLength) ) {
+		for( i=0, at=offset; i<iovcnt; at+=iov[i].iov_len, i++ )
+			memcpy(&crud_inline_table[file].data[at], iov[i].iov_base, iov[i].iov_len);
+		crud_inline_table[file].inlined = 1;
+		crud_file_table[file].length = newLength;
+		return count;
+	}
+	if( spill_inline(file) )
+		return -1; // ERROR - the file could not leave the tables
+
+	// A packed file is written in stripes of its own
+	if( unpack_file(file) )
+		return -1; // ERROR - the file could not be unpacked
+
+	// A small append to a file in append mode is stored as a segment of its own
+	if( crud_segment_table[file].append && offset == crud_file_table[file].length && count <= CRUD_SEGMENT_LIMIT )
+		return append_segment(file, iov, iovcnt, count) ? -1 : count;
+
+	// Every other write goes to the stripes, which must first take in any segments
+	if( merge_segments(file) )
+		return -1; // ERROR - the segments could not be merged
+
+	// Stripes before the one written must be whole, so a hole past a partial last stripe pads it first
+	if( offset / CRUD_STRIPE_SIZE > crud_file_table[file].length / CRUD_STRIPE_SIZE &&
+			crud_file_table[file].length % CRUD_STRIPE_SIZE && fill_last_stripe(file) )
+		return -1; // ERROR - the last stripe could not be padded
+
+	newLength = (offset + count > crud_file_table[file].length) ? offset + count : crud_file_table[file].length;
+
+	if( move_stripes(file, iov, iovcnt, offset, count, newLength, 1) )
+		return -1; // ERROR - a stripe of the file could not be written
+
+	crud_file_table[file].length = newLength;
+	return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : clock_ns
+// Description  : Reads the monotonic clock
+//
+// Inputs       : none
+// Outputs      : the time in nanoseconds
+
+static uint64_t clock_ns(void) {
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : release_stripe
+// Description  : Lets go of the object of a stripe that is cut off the end
+//                of its file
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                stripe - the index of the stripe within the file
+// Outputs      : 0 if successful, -1 if failure
+
+static int release_stripe(int16_t file, uint32_t stripe) {
+
+	CrudFileCodecType *codec = &crud_codec_table[file];
+	CrudOID *slot = stripe_object(file, stripe), oid = *slot;
+	uint8_t bit = 1 << stripe, indexed = codec->indexed & bit;
+
+	*slot = CRUD_NO_OBJECT;
+	codec->stored[stripe] = 0;
+	codec->indexed &= ~bit;
+	crud_extent_table[file].holes[stripe] = 0;
+
+	if( oid != CRUD_NO_OBJECT && (indexed ? release_chunk(oid) : retire_object(oid)) )
+		return -1; // ERROR - the object could not be released
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pack_length
+// Description  : Finds the length a file is packed at, its bytes held in
+//                memory included, called with the file's write lock held
+//
+// Inputs       : file - the index of the file in crud_file_table
+// Outputs      : the length, 0 if the file is not to be packed
+
+static uint32_t pack_length(int16_t file) {
+
+	CrudFileDirtyType *dirty = &crud_dirty_table[file];
+	uint32_t length = crud_file_table[file].length;
+
+	if( dirty->dirty && dirty->end > length )
+		length = dirty->end;
+	if( !crud_pack_table[file].pack || crud_segment_table[file].count || length == 0 || length > CRUD_PACK_LIMIT )
+		return 0; // Only a small file in pack mode without segments is packed
+	return length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pack_files
+// Description  : Stores small files together in a new container with one
+//                CREATE, called with each file's write lock held.  The bytes
+//                of a file held in memory are laid over those it stored, and
+//                it then lets go of its stripes or old container.  If the
+//                container cannot be created the files are left as they were.
+//
+// Inputs       : files - the indexes of the files in crud_file_table
+//                nfiles - the number of files, whose pack_length add up to at most CRUD_PACK_SIZE
+// Outputs      : 0 if successful, -1 if failure
+
+static int pack_files(const int16_t *files, int nfiles) {
+
+	CrudFileDirtyType *dirty;
+	CrudFilePackType *pack;
+	CrudContainerType *container;
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
+	CrudRequest request;
+	CrudResponse response;
+	uint32_t size = 0, at, stored, packed, stripe;
+	struct iovec iov;
+	char *bytes;
+	int i;
+
+	for( i=0; i<nfiles; i++ )
+		size += pack_length(files[i]);
+	if( (bytes = calloc(1, size)) == NULL )
+		return -1; // ERROR - no memory for the container
+
+	// Gather each file, reading what it stored unless its run in memory covers it
+	for( i=0, at=0; i<nfiles; at+=pack_length(files[i]), i++ ) {
+		dirty = &crud_dirty_table[files[i]];
+		stored = crud_file_table[files[i]].length;
+		if( stored > 0 && (!dirty->dirty || dirty->start > 0 || dirty->end < stored) ) {
+			iov.iov_base = &bytes[at];
+			iov.iov_len = stored;
+			if( read_file_atv(files[i], &iov, 1, 0) != (int32_t)stored ) {
+				free(bytes);
+				return -1; // ERROR - the file could not be read
+			}
+		}
+		if( dirty->dirty )
+			memcpy(&bytes[at + dirty->start], dirty->data, dirty->end - dirty->start);
+	}
+
+	request = create_crud_request(0, CRUD_CREATE, size, 0, 0);
+	response = crud_client_operation(request, bytes);
+	free(bytes);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result )
+		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+
+	// Each file moves into the container, anything left unreleased only waiting for garbage collection
+	for( i=0, at=0; i<nfiles; at+=packed, i++ ) {
+		packed = pack_length(files[i]);
+		pack = &crud_pack_table[files[i]];
+		if( pack->container != CRUD_NO_OBJECT )
+			release_container(files[i]);
+		for( stripe=0; stripe<CRUD_MAX_FILE_STRIPES; stripe++ )
+			release_stripe(files[i], stripe);
+
+		pthread_mutex_lock(&crud_container_lock);
+		crud_container_slot[files[i]] = add_container(id, size);
+		container = &crud_containers[crud_container_slot[files[i]]];
+		container->files++;
+		container->live += packed;
+		pthread_mutex_unlock(&crud_container_lock);
+
+		pack->container = id;
+		pack->offset = at;
+		pack->size = size;
+		memset(&crud_inline_table[files[i]], 0, sizeof(CrudFileInlineType));
+		crud_file_table[files[i]].length = packed;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stored_run
+// Description  : Counts a file's run of bytes held in memory as stored and
+//                empties it, called with the file's write lock held
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                took - nanoseconds taken to store the run
+//                release - nonzero to free the buffer
+// Outputs      : none
+
+static void stored_run(int16_t file, uint64_t took, uint8_t release) {
+
+	CrudFileDirtyType *dirty = &crud_dirty_table[file];
+	uint32_t bytes = dirty->end - dirty->start;
+
+	if( dirty->dirty ) {
+		pthread_mutex_lock(&crud_writeback_lock);
+		crud_writeback_counters.dirty_bytes -= bytes;
+		crud_writeback_counters.flushes++;
+		crud_writeback_counters.flushed_bytes += bytes;
+		crud_writeback_counters.flush_ns += took;
+		if( took > crud_writeback_counters.max_flush_ns )
+			crud_writeback_counters.max_flush_ns = took;
+		pthread_mutex_unlock(&crud_writeback_lock);
+		__atomic_store_n(&dirty->dirty, 0, __ATOMIC_RELEASE);
+	}
+
+	if( release ) {
+		free(dirty->data);
+		dirty->data = NULL;
+		dirty->capacity = 0;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pack_batch
+// Description  : Packs a batch of files into one container, then unlocks
+//                them and empties the batch
+//
+// Inputs       : files - the indexes of the files, each write locked
+//                nfiles - the number of files, set to 0
+//                bytes - the bytes the files are packed at, set to 0
+//                release - nonzero to free the buffers emptied
+// Outputs      : 0 if successful, -1 if failure
+
+static int pack_batch(int16_t *files, int *nfiles, uint32_t *bytes, uint8_t release) {
+
+	uint64_t began = clock_ns(), took;
+	int i, ret;
+
+	ret = pack_files(files, *nfiles);
+	took = clock_ns() - began;
+	for( i=0; i<*nfiles; i++ ) {
+		if( ret == 0 )
+			stored_run(files[i], took, release);
+		pthread_rwlock_unlock(&crud_file_locks[files[i]]);
+	}
+
+	*nfiles = 0;
+	*bytes = 0;
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : flush_file
+// Description  : Stores the bytes of a file held in memory as one write,
+//                or packs the file if it is small, called with the file's
+//                write lock held.  If storing them fails they stay in
+//                memory, to be tried again.
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                release - nonzero to free the buffer once it is empty
+// Outputs      : 0 if successful, -1 if failure
+
+static int flush_file(int16_t file, uint8_t release) {
+
+	CrudFileDirtyType *dirty = &crud_dirty_table[file];
+	struct iovec iov;
+	uint64_t began, took = 0;
+
+	if( dirty->dirty ) {
+		iov.iov_base = dirty->data;
+		iov.iov_len = dirty->end - dirty->start;
+		began = clock_ns();
+
+		// A small file in pack mode goes to a container of its own, any other run to the file
+		if( pack_length(file) ? pack_files(&file, 1) : write_file_atv(file, &iov, 1, dirty->start) != (int32_t)iov.iov_len )
+			return -1; // ERROR - the run could not be stored
+		took = clock_ns() - began;
+	}
+
+	stored_run(file, took, release);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : flush_files
+// Description  : Stores the bytes of every file held in memory, one file at
+//                a time, except that small files in pack mode are packed
+//                together, as many to a container as fit.  The flusher
+//                passes only those that expired unless too many bytes are
+//                waiting.
+//
+// Inputs       : expire - age at which a file's bytes are stored, 0 for all
+//                release - nonzero to free the buffers emptied
+// Outputs      : 0 if successful, -1 if any file could not be stored
+
+static int flush_files(uint64_t expire, uint8_t release) {
+
+	int16_t file, batch[CRUD_MAX_TOTAL_FILES];
+	int nbatch = 0, ret = 0;
+	uint32_t bytes = 0, length;
+	uint8_t over;
+	CrudFileDirtyType *dirty;
+
+	for( file=0; file<CRUD_MAX_TOTAL_FILES; file++ ) {
+		dirty = &crud_dirty_table[file];
+		if( !__atomic_load_n(&dirty->dirty, __ATOMIC_ACQUIRE) )
+			continue;
+
+		pthread_mutex_lock(&crud_writeback_lock);
+		over = crud_writeback_counters.dirty_bytes > crud_writeback_tunables.dirty_background_bytes;
+		pthread_mutex_unlock(&crud_writeback_lock);
+
+		pthread_rwlock_wrlock(&crud_file_locks[file]);
+		if( dirty->dirty && (expire == 0 || over || clock_ns() - dirty->since >= expire) ) {
+
+			// A file to pack stays locked in the batch until its container is stored
+			if( (length = pack_length(file)) > 0 ) {
+				if( bytes + length > CRUD_PACK_SIZE && pack_batch(batch, &nbatch, &bytes, release) )
+					ret = -1; // ERROR - the files could not be packed
+				batch[nbatch++] = file;
+				bytes += length;
+				continue;
+			}
+			if( flush_file(file, release) )
+				ret = -1; // ERROR - the file's bytes could not be stored
+		}
+		pthread_rwlock_unlock(&crud_file_locks[file]);
+	}
+
+	if( nbatch > 0 && pack_batch(batch, &nbatch, &bytes, release) )
+		ret = -1; // ERROR - the files could not be packed
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : repack_containers
+// Description  : Packs the files of containers that are mostly bytes no file
+//                holds any more into new containers, which retires the old
+//                ones once they are empty
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int repack_containers(void) {
+
+	int16_t file, batch[CRUD_MAX_TOTAL_FILES];
+	int i, nsparse = 0, nbatch = 0, ret = 0;
+	uint32_t bytes = 0, length;
+	CrudOID sparse[CRUD_PACK_CACHE];
+	uint8_t found;
+
+	pthread_mutex_lock(&crud_container_lock);
+	for( i=0; i<CRUD_MAX_TOTAL_FILES && nsparse<CRUD_PACK_CACHE; i++ ) {
+		if( crud_containers[i].object != CRUD_NO_OBJECT && crud_containers[i].live * 2 < crud_containers[i].size )
+			sparse[nsparse++] = crud_containers[i].object;
+	}
+	pthread_mutex_unlock(&crud_container_lock);
+	if( nsparse == 0 )
+		return 0;
+
+	// The files are locked in order, as they are found in the sparse containers
+	pthread_once(&crud_tables_once, init_tables);
+	for( file=0; file<CRUD_MAX_TOTAL_FILES; file++ ) {
+		pthread_rwlock_wrlock(&crud_file_locks[file]);
+		for( i=0, found=0; i<nsparse && !found; i++ )
+			found = crud_pack_table[file].container == sparse[i];
+		if( found && (length = pack_length(file)) > 0 ) {
+			if( bytes + length > CRUD_PACK_SIZE && pack_batch(batch, &nbatch, &bytes, 0) )
+				ret = -1; // ERROR - the files could not be packed
+			batch[nbatch++] = file;
+			bytes += length;
+			continue;
+		}
+		pthread_rwlock_unlock(&crud_file_locks[file]);
+	}
+
+	if( nbatch > 0 && pack_batch(batch, &nbatch, &bytes, 0) )
+		ret = -1; // ERROR - the files could not be packed
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : list_objects
+// Description  : Lists every object on the store, a LIST at a time
+//
+// Inputs       : count - set to the number of objects
+// Outputs      : the ids of the objects, to be freed by the caller, NULL if failure
+
+static CrudOID *list_objects(uint32_t *count) {
+
+	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint32_t i, n = 0, size = CRUD_GC_LIST_SIZE/sizeof(CrudOID);
+	CrudOID cursor = 0, *page, *objects, *grown;
+	CrudRequest request;
+	CrudResponse response;
+
+	page = malloc(CRUD_GC_LIST_SIZE);
+	objects = malloc(CRUD_GC_LIST_SIZE);
+	if( page == NULL || objects == NULL )
+		goto failed; // ERROR - no memory for the ids
+
+	do {
+		request = create_crud_request(cursor, CRUD_LIST, CRUD_GC_LIST_SIZE, 0, 0);
+		response = crud_client_operation(request, page);
+
+		// Check for CRUD command success
+		extract_crud_response(response, &id, &req, &length, &flag, &result);
+		if( result || length % sizeof(CrudOID) || length > CRUD_GC_LIST_SIZE )
+			goto failed; // ERROR - result code is 1 meaning there was a failure in command execution
+
+		if( n + length/sizeof(CrudOID) > size ) {
+			size = (n + length/sizeof(CrudOID)) * 2;
+			if( (grown = realloc(objects, size * sizeof(CrudOID))) == NULL )
+				goto failed; // ERROR - no memory for the ids
+			objects = grown;
+		}
+		for( i=0; i<length/sizeof(CrudOID); i++ )
+			objects[n++] = ntohl(page[i]);
+		cursor = id;
+	} while( cursor != 0 );
+
+	free(page);
+	*count = n;
+	return objects;
+
+failed:
+	free(page);
+	free(objects);
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mark_objects
+// Description  : Finds every object the tables or the retired objects name.
+//                Each file is read once any write in progress on it finishes,
+//                so an object created before the call is named by the time
+//                its file is read, unless nothing will ever name it.
+//
+// Inputs       : count - set to the number of objects
+// Outputs      : the ids of the objects, to be freed by the caller, NULL if failure
+
+static CrudOID *mark_objects(uint32_t *count) {
+
+	int16_t file;
+	uint32_t i, n = 0;
+	uint64_t r;
+	CrudOID *marked = NULL, *grown;
+
+	// The directories' nodes may have to be read, so they are marked before the table lock is taken
+	pthread_once(&crud_tables_once, init_tables);
+	pthread_mutex_lock(&crud_directory_lock);
+	if( mark_directories(&marked, &n) ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		free(marked);
+		return NULL; // ERROR - the directories could not be read
+	}
+	pthread_mutex_unlock(&crud_directory_lock);
+	grown = realloc(marked, (n + CRUD_MAX_TOTAL_FILES*(CRUD_MAX_FILE_STRIPES+CRUD_MAX_SEGMENTS+1) + CRUD_MAX_CHUNKS) * sizeof(CrudOID));
+	if( grown == NULL ) {
+		free(marked);
+		return NULL; // ERROR - no memory for the ids
+	}
+	marked = grown;
+
+	pthread_mutex_lock(&crud_table_lock);
+	for( file=0; file<CRUD_MAX_TOTAL_FILES; file++ ) {
+		pthread_rwlock_rdlock(&crud_file_locks[file]);
+		for( i=0; i<CRUD_MAX_FILE_STRIPES; i++ ) {
+			if( *stripe_object(file, i) != CRUD_NO_OBJECT )
+				marked[n++] = *stripe_object(file, i);
+		}
+		for( i=0; i<crud_segment_table[file].count; i++ )
+			marked[n++] = crud_segment_table[file].objects[i];
+		if( crud_pack_table[file].container != CRUD_NO_OBJECT )
+			marked[n++] = crud_pack_table[file].container;
+		pthread_rwlock_unlock(&crud_file_locks[file]);
+	}
+	pthread_mutex_lock(&crud_chunk_lock);
+	for( i=0; i<CRUD_MAX_CHUNKS; i++ ) {
+		if( crud_chunk_table[i].refs > 0 )
+			marked[n++] = crud_chunk_table[i].object;
+	}
+	pthread_mutex_unlock(&crud_chunk_lock);
+
+	// A file retires an object before letting go of its lock, so any the files no longer name are
+	// here, and none was deleted since the store was listed
+	pthread_mutex_lock(&crud_reclaim_lock);
+	crud_gc_listing = 0;
+	if( (grown = realloc(marked, (n + crud_reclaim_tail - crud_reclaim_head + 1) * sizeof(CrudOID))) == NULL ) {
+		pthread_mutex_unlock(&crud_reclaim_lock);
+		pthread_mutex_unlock(&crud_table_lock);
+		free(marked);
+		return NULL; // ERROR - no memory for the ids
+	}
+	marked = grown;
+	for( r=crud_reclaim_head; r<crud_reclaim_tail; r++ )
+		marked[n++] = crud_reclaim_ring[r % crud_reclaim_size];
+	pthread_mutex_unlock(&crud_reclaim_lock);
+	pthread_mutex_unlock(&crud_table_lock);
+
+	*count = n;
+	return marked;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_objects
+// Description  : Orders object ids for qsort and bsearch
+//
+// Inputs       : a, b - the object ids
+// Outputs      : less than, equal to or greater than 0 as a is below, at or above b
+
+static int compare_objects(const void *a, const void *b) {
+
+	CrudOID x = *(const CrudOID *)a, y = *(const CrudOID *)b;
+
+	return (x > y) - (x < y);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_orphans
+// Description  : Runs the mark of a garbage collection pass, replacing the
+//                orphans waiting to be deleted by those it finds.  The store
+//                is listed before the tables are marked, so an object created
+//                while the pass runs is never taken for an orphan.  No pass
+//                runs unless the file system is mounted.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if not mounted or failure
+
+static int find_orphans(void) {
+
+	CrudOID *listed, *marked;
+	uint32_t nlisted, nmarked, i, n = 0;
+	uint64_t epoch;
+	uint8_t mounted;
+
+	pthread_mutex_lock(&crud_gc_pass_lock);
+
+	// Format and mount hold the table lock while they change the store or the tables
+	pthread_once(&crud_tables_once, init_tables);
+	pthread_mutex_lock(&crud_table_lock);
+	pthread_mutex_lock(&crud_gc_lock);
+	epoch = crud_gc_epoch;
+	mounted = crud_gc_mounted;
+	pthread_mutex_unlock(&crud_gc_lock);
+	pthread_mutex_unlock(&crud_table_lock);
+	if( !mounted ) {
+		pthread_mutex_unlock(&crud_gc_pass_lock);
+		return -1; // ERROR - the tables describe no store
+	}
+
+	// A retired object deleted after it was listed would look like an orphan until the mark
+	pthread_mutex_lock(&crud_reclaim_lock);
+	while( crud_reclaims_running > 0 )
+		pthread_cond_wait(&crud_reclaim_idle, &crud_reclaim_lock);
+	crud_gc_listing = 1;
+	pthread_mutex_unlock(&crud_reclaim_lock);
+
+	listed = list_objects(&nlisted);
+	marked = (listed != NULL) ? mark_objects(&nmarked) : NULL;
+	if( marked == NULL ) {
+		pthread_mutex_lock(&crud_reclaim_lock);
+		crud_gc_listing = 0;
+		pthread_mutex_unlock(&crud_reclaim_lock);
+		free(listed);
+		pthread_mutex_unlock(&crud_gc_pass_lock);
+		return -1; // ERROR - the store could not be listed or no memory for the marks
+	}
+
+	// Keep the listed objects that are not marked, never the id the tables are saved under
+	qsort(marked, nmarked, sizeof(CrudOID), compare_objects);
+	for( i=0; i<nlisted; i++ ) {
+		if( listed[i] != CRUD_NO_OBJECT && bsearch(&listed[i], marked, nmarked, sizeof(CrudOID), compare_objects) == NULL )
+			listed[n++] = listed[i];
+	}
+	free(marked);
+
+	pthread_mutex_lock(&crud_gc_lock);
+	if( epoch != crud_gc_epoch )
+		n = 0; // The store or the tables changed under the pass
+	free(crud_gc_orphans);
+	crud_gc_orphans = listed;
+	crud_gc_count = n;
+	crud_gc_next = 0;
+	crud_gc_last = clock_ns();
+	crud_gc_counters.passes++;
+	crud_gc_counters.listed += nlisted;
+	crud_gc_counters.orphans += n;
+	pthread_mutex_unlock(&crud_gc_lock);
+
+	pthread_mutex_unlock(&crud_gc_pass_lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sweep_orphans
+// Description  : Deletes orphans found by the last pass, in the order found.
+//                Nothing names an orphan, so none can come back to life, and
+//                no pass runs meanwhile, so none is listed after it is gone.
+//                Nothing is deleted unless the file system is mounted.
+//
+// Inputs       : limit - the most orphans to delete
+// Outputs      : the number of orphans deleted
+
+static uint32_t sweep_orphans(uint32_t limit) {
+
+	uint32_t deleted = 0;
+
+	pthread_mutex_lock(&crud_gc_pass_lock);
+	pthread_mutex_lock(&crud_gc_lock);
+	for( ; crud_gc_mounted && deleted < limit && crud_gc_next < crud_gc_count; crud_gc_next++ ) {
+
+		// An orphan that could not be deleted is found again by the next pass
+		if( delete_object(crud_gc_orphans[crud_gc_next]) == 0 )
+			deleted++;
+	}
+	crud_gc_counters.deleted += deleted;
+	pthread_mutex_unlock(&crud_gc_lock);
+	pthread_mutex_unlock(&crud_gc_pass_lock);
+
+	return deleted;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : collect_garbage
+// Description  : The flusher's share of garbage collection.  It deletes a
+//                batch of the orphans found, and once they are gone starts a
+//                pass every gc_interval_ms.
+//
+// Inputs       : none
+// Outputs      : none
+
+static void collect_garbage(void) {
+
+	uint64_t interval, now = clock_ns();
+	uint32_t batch;
+	uint8_t due;
+
+	pthread_mutex_lock(&crud_gc_lock);
+	interval = (uint64_t)crud_gc_tunables.gc_interval_ms * 1000000;
+	batch = crud_gc_tunables.gc_batch;
+	if( crud_gc_last == 0 )
+		crud_gc_last = now; // The first pass after a mount waits a full interval
+	due = crud_gc_mounted && interval && crud_gc_next >= crud_gc_count && now - crud_gc_last >= interval;
+	pthread_mutex_unlock(&crud_gc_lock);
+
+	if( due )
+		find_orphans();
+	sweep_orphans(batch);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : writeback_flusher
+// Description  : The background flusher.  Every writeback_interval_ms, or as
+//                soon as dirty_background_bytes or a batch of retired
+//                objects are waiting, it stores the files whose bytes have
+//                waited dirty_expire_ms, repacks sparse containers, deletes
+//                the retired objects and collects garbage, until unmount
+//                stops it.
+//
+// Inputs       : arg - unused
+// Outputs      : NULL once stopped
+
+static void *writeback_flusher(void *arg) {
+
+	struct timespec deadline;
+	uint64_t expire;
+
+	(void)arg;
+
+	for( ;; ) {
+		pthread_mutex_lock(&crud_writeback_lock);
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += crud_writeback_tunables.writeback_interval_ms / 1000;
+		deadline.tv_nsec += (long)(crud_writeback_tunables.writeback_interval_ms % 1000) * 1000000;
+		if( deadline.tv_nsec >= 1000000000 ) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		if( !crud_flusher_stopped && crud_writeback_counters.dirty_bytes <= crud_writeback_tunables.dirty_background_bytes )
+			pthread_cond_timedwait(&crud_writeback_wake, &crud_writeback_lock, &deadline);
+		if( crud_flusher_stopped ) {
+			pthread_mutex_unlock(&crud_writeback_lock);
+			break;
+		}
+		expire = (uint64_t)crud_writeback_tunables.dirty_expire_ms * 1000000;
+		pthread_mutex_unlock(&crud_writeback_lock);
+
+		flush_files(expire ? expire : 1, 1);
+		repack_containers();
+		reclaim_objects(1);
+		collect_garbage();
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : start_flusher
+// Description  : Starts the background flusher if it is not running and no
+//                unmount stopped it since the last format or mount
+//
+// Inputs       : none
+// Outputs      : none
+
+static void start_flusher(void) {
+
+	if( __atomic_load_n(&crud_flusher_started, __ATOMIC_ACQUIRE) )
+		return;
+
+	pthread_mutex_lock(&crud_writeback_lock);
+	if( !crud_flusher_started && !crud_flusher_stopped &&
+			pthread_create(&crud_flusher_thread, NULL, writeback_flusher, NULL) == 0 )
+		__atomic_store_n(&crud_flusher_started, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&crud_writeback_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_back
+// Description  : Writes a buffer list to a file, called with the file's
+//                write lock held.  A small write that joins the file's run
+//                of bytes held in memory is copied into it and stored later;
+//                any other write stores the run first and goes straight to
+//                the file.  A writer that takes the bytes waiting past
+//                dirty_bytes stores its own run before returning.
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                iov - the buffers to write, in order
+//                iovcnt - the number of buffers in iov
+//                offset - the offset in the file to start writing at
+// Outputs      : the number of bytes written or -1 if failure
+
+static int32_t write_back(int16_t file, const struct iovec *iov, int iovcnt, uint32_t offset) {
+
+	CrudFileDirtyType *dirty = &crud_dirty_table[file];
+	int32_t count;
+	uint32_t start, end, capacity, limit, at, i;
+	uint8_t throttle, wake;
+	char *data;
+
+	start_flusher();
+	pthread_mutex_lock(&crud_writeback_lock);
+	limit = crud_writeback_tunables.dirty_bytes;
+	pthread_mutex_unlock(&crud_writeback_lock);
+
+	if( (count = iovec_length(iov, iovcnt, 1)) < 1 || (uint64_t)offset + count > CRUD_MAX_FILE_SIZE )
+		return write_file_atv(file, iov, iovcnt, offset); // Leave the errors to the direct path
+
+	// The run takes writes that touch it while it fits its buffer, or starts with one not past the stored end
+	if( dirty->dirty ) {
+		start = (offset < dirty->start) ? offset : dirty->start;
+		end = (offset + count > dirty->end) ? offset + count : dirty->end;
+		if( offset > dirty->end || offset + count < dirty->start || end - start > CRUD_WRITEBACK_SIZE ) {
+			if( flush_file(file, 0) )
+				return -1; // ERROR - the run could not be stored
+			start = offset;
+			end = offset + count;
+		}
+	} else {
+		start = offset;
+		end = offset + count;
+	}
+
+	// Large writes, writes leaving a hole, writes kept in the tables and all writes without a flusher are stored at once
+	if( limit == 0 || count > CRUD_WRITEBACK_LIMIT || !__atomic_load_n(&crud_flusher_started, __ATOMIC_ACQUIRE) ||
+			(!dirty->dirty && offset > crud_file_table[file].length) ||
+			fits_inline(file, (offset + count > crud_file_table[file].length) ? offset + count : crud_file_table[file].length) ) {
+		if( flush_file(file, 0) )
+			return -1; // ERROR - the run could not be stored
+		return write_file_atv(file, iov, iovcnt, offset);
+	}
+
+	// Grow the buffer by doubling so it stays near the size of the run
+	if( end - start > dirty->capacity ) {
+		for( capacity = dirty->capacity ? dirty->capacity : CRUD_WRITEBACK_MIN; capacity < end - start; capacity *= 2 );
+		if( (data = realloc(dirty->data, capacity)) == NULL ) {
+			if( flush_file(file, 0) )
+				return -1; // ERROR - the run could not be stored
+			return write_file_atv(file, iov, iovcnt, offset);
+		}
+		dirty->data = data;
+		dirty->capacity = capacity;
+	}
+
+	// Copy the write into the run, moving the run up first if the write starts before it
+	if( dirty->dirty && start < dirty->start )
+		memmove(&dirty->data[dirty->start - start], dirty->data, dirty->end - dirty->start);
+	for( i=0, at=offset-start; i<(uint32_t)iovcnt; at+=iov[i].iov_len, i++ )
+		memcpy(&dirty->data[at], iov[i].iov_base, iov[i].iov_len);
+
+	pthread_mutex_lock(&crud_writeback_lock);
+	crud_writeback_counters.dirty_bytes += (end - start) - (dirty->dirty ? dirty->end - dirty->start : 0);
+	throttle = crud_writeback_counters.dirty_bytes > limit;
+	wake = crud_writeback_counters.dirty_bytes > crud_writeback_tunables.dirty_background_bytes;
+	if( throttle )
+		crud_writeback_counters.throttled++;
+	pthread_mutex_unlock(&crud_writeback_lock);
+
+	if( !dirty->dirty )
+		dirty->since = clock_ns();
+	dirty->start = start;
+	dirty->end = end;
+	__atomic_store_n(&dirty->dirty, 1, __ATOMIC_RELEASE);
+
+	if( wake )
+		pthread_cond_signal(&crud_writeback_wake);
+
+	// A failure leaves the run in memory, where the next sync reports it
+	if( throttle )
+		flush_file(file, 0);
+
+	return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_file_handle
+// Description  : Reads from an open file into a buffer list, either at an
+//                explicit offset or at the handle's position.  Reads at the
+//                position hold the handle's lock so that the position moves
+//                atomically; positional reads only take the file's read lock
+//                and so run in parallel with each other.
+//
+// Inputs       : fd - the file descriptor for the read
+//                iov - the buffers to place the bytes into
+//                iovcnt - the number of buffers in iov
+//                offset - offset in the file to read from, or CRUD_AT_POSITION
+// Outputs      : the number of bytes read or -1 if failure
+
+static int32_t read_file_handle(int16_t fd, const struct iovec *iov, int iovcnt, int64_t offset) {
+
+	int32_t bytesRead;
+	int flushed;
+	int16_t file;
+	CrudOpenFileType *handle;
+
+	if( offset == CRUD_AT_POSITION )
+		handle = lock_open_file(fd, &file);
+	else
+		handle = get_open_file(fd, &file);
+	if( handle == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+
+	// Bytes of the file held in memory are stored before it is read
+	pthread_rwlock_rdlock(&crud_file_locks[file]);
+	while( crud_dirty_table[file].dirty ) {
+		pthread_rwlock_unlock(&crud_file_locks[file]);
+		pthread_rwlock_wrlock(&crud_file_locks[file]);
+		flushed = flush_file(file, 0);
+		pthread_rwlock_unlock(&crud_file_locks[file]);
+		if( flushed ) {
+			if( offset == CRUD_AT_POSITION )
+				pthread_mutex_unlock(&handle->lock);
+			return -1; // ERROR - the bytes held in memory could not be stored
+		}
+		pthread_rwlock_rdlock(&crud_file_locks[file]);
+	}
+	bytesRead = read_file_atv(file, iov, iovcnt,
+		(offset == CRUD_AT_POSITION) ? handle->position : (uint32_t)offset);
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	// Move the position past the bytes read
+	if( offset == CRUD_AT_POSITION ) {
+		if( bytesRead > 0 )
+			handle->position += bytesRead;
+		pthread_mutex_unlock(&handle->lock);
+	}
+
+	return bytesRead;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_file_handle
+// Description  : Writes a buffer list to an open file, either at an explicit
+//                offset or at the handle's position, holding the file's write
+//                lock for the whole read-modify-write of the object
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                iov - the buffers to write
+//                iovcnt - the number of buffers in iov
+//                offset - offset in the file to write at, or CRUD_AT_POSITION
+// Outputs      : the number of bytes written or -1 if failure
+
+static int32_t write_file_handle(int16_t fd, const struct iovec *iov, int iovcnt, int64_t offset) {
+
+	int32_t bytesWritten;
+	int16_t file;
+	CrudOpenFileType *handle;
+
+	if( offset == CRUD_AT_POSITION )
+		handle = lock_open_file(fd, &file);
+	else
+		handle = get_open_file(fd, &file);
+	if( handle == NULL )
+		return -1; // ERROR - file handle is out of range or not open
+
+	pthread_rwlock_wrlock(&crud_file_locks[file]);
+	bytesWritten = write_back(file, iov, iovcnt,
+		(offset == CRUD_AT_POSITION) ? handle->position : (uint32_t)offset);
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	// Move the position to the end of the write
+	if( offset == CRUD_AT_POSITION ) {
+		if( bytesWritten > 0 )
+			handle->position += bytesWritten;
+		pthread_mutex_unlock(&handle->lock);
+	}
+
+	return bytesWritten;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_read
+// Description  : Reads up to "count" bytes from the file handle "fh" into the
+//                buffer  "buf".
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+// Outputs      : the number of bytes read or -1 if failures
+// 
+int32_t crud_read(int16_t fd, void *buf, int32_t count) {
+
+	struct iovec iov;
+
+	if( buf == NULL )
+		return -1; // ERROR - buffer doesn't point to meaningful data
+
+	iov.iov_base = buf;
+	iov.iov_len = (count > 0) ? count : 0;
+	return read_file_handle(fd, &iov, 1, CRUD_AT_POSITION);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_write
+// Description  : Writes "count" bytes to the file handle "fh" from the
+//                buffer  "buf"
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                buf - the buffer to write
+//                count - the number of bytes to write
+// Outputs      : the number of bytes written or -1 if failure
+// Write count bytes at the end of the current file position
+// If you write past end of the file, you increase the file size
+// 
+int32_t crud_write(int16_t fd, void *buf, int32_t count) {
+
+	struct iovec iov;
+
+	if( buf == NULL )
+		return -1; // ERROR - buffer doesn't point to meaningful data
+
+	iov.iov_base = buf;
+	iov.iov_len = (count > 0) ? count : 0;
+	return write_file_handle(fd, &iov, 1, CRUD_AT_POSITION);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pread
+// Description  : Reads up to "count" bytes from the file handle "fd" starting
+//                at "offset".  The position of the handle is left untouched.
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+//                offset - offset from beginning of file to read from
+// Outputs      : the number of bytes read or -1 if failure
+
+int32_t crud_pread(int16_t fd, void *buf, int32_t count, uint32_t offset) {
+
+	struct iovec iov;
+
+	if( buf == NULL )
+		return -1; // ERROR - buffer doesn't point to meaningful data
+
+	iov.iov_base = buf;
+	iov.iov_len = (count > 0) ? count : 0;
+	return read_file_handle(fd, &iov, 1, offset);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_pwrite
+// Description  : Writes "count" bytes to the file handle "fd" starting at
+//                "offset".  The position of the handle is left untouched.
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                buf - the buffer to write
+//                count - the number of bytes to write
+//                offset - offset from beginning of file to write at
+// Outputs      : the number of bytes written or -1 if failure
+
+int32_t crud_pwrite(int16_t fd, void *buf, int32_t count, uint32_t offset) {
+
+	struct iovec iov;
+
+	if( buf == NULL )
+		return -1; // ERROR - buffer doesn't point to meaningful data
+
+	iov.iov_base = buf;
+	iov.iov_len = (count > 0) ? count : 0;
+	return write_file_handle(fd, &iov, 1, offset);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_readv
+// Description  : Reads from the file handle "fd" into the buffers of "iov",
+//                filling each in order, as a single read of the file
+//
+// Inputs       : fd - the file descriptor for the read
+//                iov - the buffers to place the bytes into
+//                iovcnt - the number of buffers in iov
+// Outputs      : the number of bytes read or -1 if failure
+
+int32_t crud_readv(int16_t fd, const struct iovec *iov, int iovcnt) {
+
+	return read_file_handle(fd, iov, iovcnt, CRUD_AT_POSITION);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_writev
+// Description  : Writes the buffers of "iov", in order, to the file handle
+//                "fd" as a single write of the file
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                iov - the buffers to write
+//                iovcnt - the number of buffers in iov
+// Outputs      : the number of bytes written or -1 if failure
+
+int32_t crud_writev(int16_t fd, const struct iovec *iov, int iovcnt) {
+
+	return write_file_handle(fd, iov, iovcnt, CRUD_AT_POSITION);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_seek
+// Description  : Seek to specific point in the file, which may be past its
+//                end.  Reads there find nothing and writes leave a hole.
+//
+// Inputs       : fd - the file descriptor for the file to seek
+//                loc - offset from beginning of file to seek to
+// Outputs      : 0 if successful or -1 if failure
+// 
+int32_t crud_seek(int16_t fd, uint32_t loc) {
+	
+	int16_t file;
+	CrudOpenFileType *handle;
+
+	if( loc > CRUD_MAX_FILE_SIZE )
+		return -1; // ERROR - requested location is past the end of the largest file
+
+	handle = lock_open_file(fd, &file);
+	if( handle == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+	
+	handle->position = loc; // If both parameters are in range, change the current position of the handle to loc
+
+	pthread_mutex_unlock(&handle->lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_size
+// Description  : Finds the length of an open file, holes included
+//
+// Inputs       : fd - the file handle of the file
+// Outputs      : the length of the file or -1 if failure
+
+int32_t crud_size(int16_t fd) {
+
+	int32_t length;
+	int16_t file;
+
+	if( get_open_file(fd, &file) == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+
+	pthread_rwlock_rdlock(&crud_file_locks[file]);
+	length = crud_file_table[file].length;
+	if( crud_dirty_table[file].dirty && crud_dirty_table[file].end > (uint32_t)length )
+		length = crud_dirty_table[file].end;
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	return length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : allocate_stripe
+// Description  : Stores a raw stripe in full, its holes and any bytes it
+//                grows by included as zeros, so later writes to it update
+//                its object in place.  The object is created once at its
+//                new length.
+//
+// Inputs       : task - the stripe, growing from oldLength to newLength
+// Outputs      : 0 if successful, -1 if failure
+
+static int allocate_stripe(CrudStripeTask *task) {
+
+	CrudOID *slot = stripe_object(task->file, task->stripe);
+	uint32_t *holes = &crud_extent_table[task->file].holes[task->stripe];
+	CrudThreadArena *arena = thread_arena();
+	struct iovec vec;
+
+	if( arena == NULL )
+		return -1; // ERROR - the thread has no staging buffer
+
+	if( *slot == CRUD_NO_OBJECT )
+		memset(arena->stripe, 0, task->newLength);
+	else {
+		if( load_stripe(task, *slot, arena->stripe, arena->packed) )
+			return -1; // ERROR - the stripe could not be received
+		memset(&arena->stripe[task->oldLength], 0, task->newLength - task->oldLength);
+	}
+
+	vec.iov_base = arena->stripe;
+	vec.iov_len = task->newLength;
+	if( store_stripe(slot, &vec, 1, task->newLength, (*slot == CRUD_NO_OBJECT) ? 0 : stored_length(task->oldLength, *holes)) ) {
+		if( *slot == CRUD_NO_OBJECT )
+			*holes = 0;
+		return -1; // ERROR - the stripe could not be stored
+	}
+	*holes = 0;
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : resize_file
+// Description  : Changes the length of a file whose bytes are all in its
+//                stripes or the tables, called with the file's write lock
+//                held.  A tiny file is kept in the tables.  Stripes
+//                past the new end are released and the stripe it falls in
+//                is stored again at its new length, so each object is
+//                created at most once.  Bytes added read as zeros, stored
+//                as holes unless the file is being allocated.  The length
+//                follows each stripe as it lands, so a failure leaves the
+//                file consistent.
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                length - the new length of the file
+//                allocate - nonzero to store the stripes up to length in full
+// Outputs      : 0 if successful, -1 if failure
+
+static int resize_file(int16_t file, uint32_t length, uint8_t allocate) {
+
+	uint32_t stripe, stripes, oldFileLength = crud_file_table[file].length;
+	uint8_t packed;
+	CrudStripeTask task;
+
+	if( length > CRUD_MAX_FILE_SIZE )
+		return -1; // ERROR - no file can be this long
+
+	// A tiny file stays in the tables while it fits, cutting off bytes leaves zeros past the end
+	if( fits_inline(file, length) ) {
+		if( length < oldFileLength )
+			memset(&crud_inline_table[file].data[length], 0, oldFileLength - length);
+		crud_inline_table[file].inlined = 1;
+		crud_file_table[file].length = length;
+		return 0;
+	}
+	if( spill_inline(file) )
+		return -1; // ERROR - the file could not leave the tables
+
+	// Shrink the stripe the file now ends in, then cut off the ones after it
+	if( length < oldFileLength ) {
+		task.file = file;
+		task.stripe = length / CRUD_STRIPE_SIZE;
+		task.start = task.end = task.newLength = length % CRUD_STRIPE_SIZE;
+		task.oldLength = stripe_length(oldFileLength, task.stripe);
+		task.write = 1;
+		task.iov = NULL;
+		task.iovcnt = 0;
+		if( task.newLength > 0 && write_stripe(&task) )
+			return -1; // ERROR - the last stripe could not be shortened
+
+		crud_file_table[file].length = length;
+		stripes = (oldFileLength + CRUD_STRIPE_SIZE - 1) / CRUD_STRIPE_SIZE;
+		for( stripe = (length + CRUD_STRIPE_SIZE - 1) / CRUD_STRIPE_SIZE; stripe < stripes; stripe++ ) {
+			if( release_stripe(file, stripe) )
+				return -1; // ERROR - a stripe past the end could not be released
+		}
+		return 0;
+	}
+
+	// Grow or fill each stripe up to the new end in turn
+	stripes = (length + CRUD_STRIPE_SIZE - 1) / CRUD_STRIPE_SIZE;
+	for( stripe=0; stripe<stripes; stripe++ ) {
+		task.file = file;
+		task.stripe = stripe;
+		task.oldLength = stripe_length(crud_file_table[file].length, stripe);
+		task.newLength = stripe_length(length, stripe);
+		task.start = task.end = task.oldLength;
+		task.write = 1;
+		task.iov = NULL;
+		task.iovcnt = 0;
+
+		// Only raw stripes can be allocated, the others keep their zeros as holes
+		packed = crud_codec_table[file].codec != CRUD_CODEC_NONE || crud_codec_table[file].dedup ||
+			crud_codec_table[file].stored[stripe] || (crud_codec_table[file].indexed & (1 << stripe));
+		if( allocate && !packed && (*stripe_object(file, stripe) == CRUD_NO_OBJECT ||
+				crud_extent_table[file].holes[stripe] || task.newLength > task.oldLength) ) {
+			if( allocate_stripe(&task) )
+				return -1; // ERROR - the stripe could not be allocated
+		} else if( task.newLength > task.oldLength ) {
+			if( write_stripe(&task) )
+				return -1; // ERROR - the stripe could not be grown
+		}
+
+		if( task.newLength > task.oldLength )
+			crud_file_table[file].length = stripe * CRUD_STRIPE_SIZE + task.newLength;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_truncate
+// Description  : Sets the length of an open file.  A longer file reads as
+//                zeros past its old end, stored as holes; a shorter one
+//                gives up the objects past its new end.
+//
+// Inputs       : fd - the file handle of the file
+//                length - the new length of the file
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_truncate(int16_t fd, uint32_t length) {
+
+	int16_t file;
+	int ret;
+
+	if( get_open_file(fd, &file) == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+
+	// The bytes held in memory and the segments go into the stripes first
+	pthread_rwlock_wrlock(&crud_file_locks[file]);
+	ret = (flush_file(file, 0) || merge_segments(file) || unpack_file(file) || resize_file(file, length, 0)) ? -1 : 0;
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_fallocate
+// Description  : Stores an open file in full up to "length", growing it with
+//                zeros if it is shorter.  Every stripe up to there gets an
+//                object of its final length, created once, holes included,
+//                so a writer that fills the file afterwards updates each
+//                object in place instead of growing it write by write.
+//                Stripes of compressed or deduplicated files are stored
+//                packed anyway, so those files only grow.
+//
+// Inputs       : fd - the file handle of the file
+//                length - the length to store the file to
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_fallocate(int16_t fd, uint32_t length) {
+
+	int16_t file;
+	int ret;
+
+	if( get_open_file(fd, &file) == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+
+	// The bytes held in memory and the segments go into the stripes first
+	pthread_rwlock_wrlock(&crud_file_locks[file]);
+	ret = (flush_file(file, 0) || merge_segments(file) || unpack_file(file)) ? -1 : 0;
+	if( ret == 0 && resize_file(file, (length > crud_file_table[file].length) ? length : crud_file_table[file].length, 1) )
+		ret = -1; // ERROR - the file could not be allocated
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_fsync
+// Description  : Makes an open file durable.  Its bytes held in memory are
+//                stored, and then the table entry describing it is saved
+//                with the rest of the tables in the priority object.  Every
+//                write that returned before the call survives a later mount.
+//
+// Inputs       : fd - the file handle of the file
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_fsync(int16_t fd) {
+
+	int16_t file;
+	int ret;
+
+	if( get_open_file(fd, &file) == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+
+	pthread_rwlock_wrlock(&crud_file_locks[file]);
+	ret = flush_file(file, 0);
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+	if( ret )
+		return -1; // ERROR - the bytes held in memory could not be stored
+
+	if( sync_tables() )
+		return -1; // ERROR - the tables could not be saved
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_syncfs
+// Description  : Makes the whole file system durable, as crud_fsync does for
+//                one file
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_syncfs(void) {
+
+	pthread_once(&crud_tables_once, init_tables);
+	if( flush_files(0, 0) )
+		return -1; // ERROR - bytes held in memory could not be stored
+
+	if( sync_tables() )
+		return -1; // ERROR - the tables could not be saved
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_writeback
+// Description  : Replaces the write-back tunables.  A lower threshold takes
+//                effect at the flusher's next pass, which starts at once.
+//
+// Inputs       : tunables - the new tunables
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_set_writeback(const CrudWritebackTunables *tunables) {
+
+	if( tunables == NULL || tunables->writeback_interval_ms == 0 )
+		return -1; // ERROR - the flusher needs an interval between passes
+
+	pthread_mutex_lock(&crud_writeback_lock);
+	crud_writeback_tunables = *tunables;
+	pthread_cond_signal(&crud_writeback_wake);
+	pthread_mutex_unlock(&crud_writeback_lock);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_get_writeback
+// Description  : Reads the write-back tunables
+//
+// Inputs       : tunables - receives the tunables
+// Outputs      : none
+
+void crud_get_writeback(CrudWritebackTunables *tunables) {
+
+	pthread_mutex_lock(&crud_writeback_lock);
+	*tunables = crud_writeback_tunables;
+	pthread_mutex_unlock(&crud_writeback_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_writeback_stats
+// Description  : Reads the write-back counters
+//
+// Inputs       : stats - receives the counters
+// Outputs      : none
+
+void crud_writeback_stats(CrudWritebackStats *stats) {
+
+	pthread_mutex_lock(&crud_writeback_lock);
+	*stats = crud_writeback_counters;
+	pthread_mutex_unlock(&crud_writeback_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_collect_garbage
+// Description  : Runs a garbage collection pass and deletes every orphan it
+//                finds without waiting for the flusher
+//
+// Inputs       : none
+// Outputs      : the number of orphans deleted, -1 if not mounted or failure
+
+int32_t crud_collect_garbage(void) {
+
+	// Determine if the object store has been initialized yet
+	if( crud_initialize() )
+		return -1; // ERROR - the object store could not be initialized
+
+	if( find_orphans() )
+		return -1; // ERROR - the store could not be listed
+
+	return (int32_t)sweep_orphans(UINT32_MAX);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_gc
+// Description  : Replaces the garbage collection tunables, starting the
+//                flusher if it is not yet running
+//
+// Inputs       : tunables - the new tunables
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_set_gc(const CrudGcTunables *tunables) {
+
+	if( tunables == NULL )
+		return -1; // ERROR - there are no tunables
+
+	pthread_mutex_lock(&crud_gc_lock);
+	crud_gc_tunables = *tunables;
+	pthread_mutex_unlock(&crud_gc_lock);
+	start_flusher();
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_get_gc
+// Description  : Reads the garbage collection tunables
+//
+// Inputs       : tunables - receives the tunables
+// Outputs      : none
+
+void crud_get_gc(CrudGcTunables *tunables) {
+
+	pthread_mutex_lock(&crud_gc_lock);
+	*tunables = crud_gc_tunables;
+	pthread_mutex_unlock(&crud_gc_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_gc_stats
+// Description  : Reads the garbage collection counters, waiting for any
+//                batch of deletions in progress
+//
+// Inputs       : stats - receives the counters
+// Outputs      : none
+
+void crud_gc_stats(CrudGcStats *stats) {
+
+	pthread_mutex_lock(&crud_gc_lock);
+	*stats = crud_gc_counters;
+	pthread_mutex_unlock(&crud_gc_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_inline
+// Description  : Sets the length up to which files are kept in the file
+//                table instead of in objects.  Such a file is read and written
+//                without any request and saved with the tables.  Lowering
+//                the limit moves a longer file out of the table the next
+//                time it is written.
+//
+// Inputs       : limit - the longest file kept in the table, at most CRUD_INLINE_MAX
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_set_inline(uint32_t limit) {
+
+	if( limit > CRUD_INLINE_MAX )
+		return -1; // ERROR - the table has no room for files this long
+
+	__atomic_store_n(&crud_inline_limit, limit, __ATOMIC_RELAXED);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_get_inline
+// Description  : Reads the length up to which files are kept in the file table
+//
+// Inputs       : none
+// Outputs      : the limit
+
+uint32_t crud_get_inline(void) {
+
+	return __atomic_load_n(&crud_inline_limit, __ATOMIC_RELAXED);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_codec
+// Description  : Chooses how later writes store the stripes of an open file.
+//                Stripes already stored keep their form until rewritten.
+//
+// Inputs       : fd - the file handle of the file
+//                codec - CRUD_CODEC_NONE or CRUD_CODEC_LZ
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_set_codec(int16_t fd, uint8_t codec) {
+
+	int16_t file;
+	CrudOpenFileType *handle;
+
+	if( codec != CRUD_CODEC_NONE && codec != CRUD_CODEC_LZ )
+		return -1; // ERROR - unknown codec
+
+	handle = lock_open_file(fd, &file);
+	if( handle == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+
+	pthread_rwlock_wrlock(&crud_file_locks[file]);
+	crud_codec_table[file].codec = codec;
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	pthread_mutex_unlock(&handle->lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_dedup
+// Description  : Turns deduplication of later writes to an open file on or
+//                off.  Stripes already shared stay shared until rewritten.
+//
+// Inputs       : fd - the file handle of the file
+//                enable - nonzero to share stripes whose bytes are already stored
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_set_dedup(int16_t fd, uint8_t enable) {
+
+	int16_t file;
+	CrudOpenFileType *handle = lock_open_file(fd, &file);
+
+	if( handle == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+
+	pthread_rwlock_wrlock(&crud_file_locks[file]);
+	crud_codec_table[file].dedup = (enable != 0);
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	pthread_mutex_unlock(&handle->lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_append
+// Description  : Turns append mode on or off for an open file.  In append
+//                mode each small append is stored as a segment object of its
+//                own, so it costs one CREATE however long the file is, and
+//                the segments are merged into the file's stripes in the
+//                background.  Any other write merges them first.
+//
+// Inputs       : fd - the file handle of the file
+//                enable - nonzero to store small appends as segments
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_set_append(int16_t fd, uint8_t enable) {
+
+	int16_t file;
+	CrudOpenFileType *handle = lock_open_file(fd, &file);
+
+	if( handle == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+
+	pthread_rwlock_wrlock(&crud_file_locks[file]);
+	crud_segment_table[file].append = (enable != 0);
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	pthread_mutex_unlock(&handle->lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_set_pack
+// Description  : Turns pack mode on or off for an open file.  In pack mode a
+//                file of at most CRUD_PACK_LIMIT bytes is stored as a range of
+//                a container object shared with other small files whenever
+//                its bytes held in memory are stored, and the flusher packs
+//                files written together into one container, so they cost one
+//                CREATE between them and can be read back with one READ.  A
+//                packed file moves back into stripes of its own when it is
+//                written; turning pack mode off leaves it packed until then.
+//
+// Inputs       : fd - the file handle of the file
+//                enable - nonzero to pack the file while it is small
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_set_pack(int16_t fd, uint8_t enable) {
+
+	int16_t file;
+	CrudOpenFileType *handle = lock_open_file(fd, &file);
+
+	if( handle == NULL )
+		return -1; // ERROR - requested file handle is out of range or not open
+
+	pthread_rwlock_wrlock(&crud_file_locks[file]);
+	crud_pack_table[file].pack = (enable != 0);
+	pthread_rwlock_unlock(&crud_file_locks[file]);
+
+	pthread_mutex_unlock(&handle->lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_clone
+// Description  : Makes a new file "dst" holding the same bytes as "src"
+//                without moving them.  Every stripe object of the source is
+//                shared through the chunk index, so the clone costs no
+//                device requests, and a later write to either file copies
+//                only the stripes it touches.  Objects that were not shared
+//                yet are indexed under a fingerprint made from their object
+//                id, which no stripe's digest will match in practice.  A
+//                packed source shares its container instead.  If the
+//                source's bytes cannot be stored first, "dst" is left as an
+//                empty file.
+//
+// Inputs       : src - the path of the file to clone
+//                dst - the path of the new file, which must not exist
+// Outputs      : 0 if successful, -1 if failure
+
+int16_t crud_clone(char *src, char *dst) {
+
+	int16_t from, to;
+	uint32_t i, stripe, stripes;
+	uint8_t fingerprint[CRUD_CHUNK_FINGERPRINT], indexed;
+	CrudOID oid;
+
+	// Determine if the object store has been initialized yet
+	if( crud_initialize() )
+		return -1; // ERROR - the object store could not be initialized
+
+	if( !valid_path(src) || !valid_path(dst) )
+		return -1; // ERROR - path is not a valid file name
+
+	// Opens wait until the clone is made, and writes to the source until its objects are shared
+	pthread_mutex_lock(&crud_directory_lock);
+	if( (from = find_file(src)) < 0 || find_file(dst) >= 0 ) {
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - the source does not exist or the destination does
+	}
+
+	// Hold room in the chunk index for every stripe a file can have, so the clone cannot run out of it once made
+	pthread_mutex_lock(&crud_chunk_lock);
+	if( crud_chunks_used + crud_chunks_reserved + CRUD_MAX_FILE_STRIPES > CRUD_CHUNK_FILL ) {
+		pthread_mutex_unlock(&crud_chunk_lock);
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - the chunk index is full
+	}
+	crud_chunks_reserved += CRUD_MAX_FILE_STRIPES;
+	pthread_mutex_unlock(&crud_chunk_lock);
+
+	// The clone is made before the source or the chunk index is locked, as making it may read directory nodes
+	if( (to = create_file(dst)) < 0 ) {
+		pthread_mutex_lock(&crud_chunk_lock);
+		crud_chunks_reserved -= CRUD_MAX_FILE_STRIPES;
+		pthread_mutex_unlock(&crud_chunk_lock);
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - the file table or directory is full
+	}
+	pthread_rwlock_wrlock(&crud_file_locks[from]);
+
+	// Only stripes are shared, so the source's bytes held in memory and segments go into them first
+	if( flush_file(from, 0) || merge_segments(from) ) {
+		pthread_rwlock_unlock(&crud_file_locks[from]);
+		pthread_mutex_lock(&crud_chunk_lock);
+		crud_chunks_reserved -= CRUD_MAX_FILE_STRIPES;
+		pthread_mutex_unlock(&crud_chunk_lock);
+		pthread_mutex_unlock(&crud_directory_lock);
+		return -1; // ERROR - the bytes could not be stored or the segments merged
+	}
+	pthread_mutex_lock(&crud_chunk_lock);
+	crud_chunks_reserved -= CRUD_MAX_FILE_STRIPES;
+
+	// Take a reference for the clone on each stripe object, indexing those the source had alone
+	indexed = crud_codec_table[from].indexed;
+	stripes = (crud_file_table[from].length + CRUD_STRIPE_SIZE - 1) / CRUD_STRIPE_SIZE;
+	for( stripe=0; stripe<stripes; stripe++ ) {
+		oid = *stripe_object(from, stripe);
+		if( oid == CRUD_NO_OBJECT )
+			continue;
+		if( indexed & (1 << stripe) ) {
+			crud_chunk_table[chunk_of(oid)].refs++;
+			continue;
+		}
+		memset(fingerprint, 0xff, CRUD_CHUNK_FINGERPRINT);
+		memcpy(fingerprint, &oid, sizeof(oid));
+		i = find_chunk(fingerprint);
+		memcpy(crud_chunk_table[i].fingerprint, fingerprint, CRUD_CHUNK_FINGERPRINT);
+		crud_chunk_table[i].object = oid;
+		crud_chunk_table[i].stored = crud_codec_table[from].stored[stripe];
+		crud_chunk_table[i].refs = 2;
+		crud_chunks_used++;
+		indexed |= 1 << stripe;
+	}
+	crud_codec_table[from].indexed = indexed;
+	pthread_mutex_unlock(&crud_chunk_lock);
+
+	// The clone starts with the source's objects, length and storage settings.  Nothing
+	// has it open yet, so its lock only waits for readers of the tables.
+	pthread_rwlock_wrlock(&crud_file_locks[to]);
+	crud_file_table[to].object_id = crud_file_table[from].object_id;
+	crud_file_table[to].length = crud_file_table[from].length;
+	crud_layout_table[to] = crud_layout_table[from];
+	crud_codec_table[to] = crud_codec_table[from];
+	crud_extent_table[to] = crud_extent_table[from];
+	crud_segment_table[to] = crud_segment_table[from];
+	crud_pack_table[to] = crud_pack_table[from];
+	crud_inline_table[to] = crud_inline_table[from];
+	if( crud_pack_table[from].container != CRUD_NO_OBJECT ) {
+		pthread_mutex_lock(&crud_container_lock);
+		crud_container_slot[to] = crud_container_slot[from];
+		crud_containers[crud_container_slot[to]].files++;
+		crud_containers[crud_container_slot[to]].live += crud_file_table[to].length;
+		pthread_mutex_unlock(&crud_container_lock);
+	}
+	pthread_rwlock_unlock(&crud_file_locks[to]);
+	pthread_rwlock_unlock(&crud_file_locks[from]);
+	pthread_mutex_unlock(&crud_directory_lock);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : set_range
+// Description  : Fills in one range of a COPY or CONCAT payload
+//
+// Inputs       : range - the range, filled in network byte order
+//                object - the object holding the bytes
+//                offset - the first byte of the range in the object
+//                length - the number of bytes in the range
+// Outputs      : none
+
+static void set_range(CrudObjectRange *range, CrudOID object, uint32_t offset, uint32_t length) {
+
+	range->object = htonl(object);
+	range->offset = htonl(offset);
+	range->length = htonl(length);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : source_ranges
+// Description  : Finds the object ranges holding a byte range of a file that
+//                is no longer than a stripe, so it lies in at most two
+//
+// Inputs       : file - the index of the file in crud_file_table
+//                offset - the first byte of the range in the file
+//                count - the number of bytes in the range
+//                ranges - receives the ranges, in network byte order
+// Outputs      : the number of ranges or -1 if a stripe has no object
+
+static int source_ranges(int16_t file, uint32_t offset, uint32_t count, CrudObjectRange *ranges) {
+
+	int n = 0;
+	uint32_t at, take;
+	CrudOID oid;
+
+	while( count > 0 ) {
+		oid = *stripe_object(file, offset / CRUD_STRIPE_SIZE);
+		if( oid == CRUD_NO_OBJECT )
+			return -1; // ERROR - the bytes are not stored anywhere
+		at = offset % CRUD_STRIPE_SIZE;
+		take = (count < CRUD_STRIPE_SIZE - at) ? count : CRUD_STRIPE_SIZE - at;
+		set_range(&ranges[n++], oid, at, take);
+		offset += take;
+		count -= take;
+	}
+
+	return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : copy_stripe_remote
+// Description  : Copies bytes of one file over part of a stripe of another
+//                on the server.  A private stripe that keeps its length takes
+//                the bytes with a COPY per source object, otherwise the
+//                stripe is rebuilt as a CONCAT of its kept bytes and the
+//                source's and the old object is let go.
+//
+// Inputs       : task - the destination stripe and range to write
+//                src - the index of the source file in crud_file_table
+//                srcOffset - the first byte to copy from the source file
+// Outputs      : 0 if successful, -1 if failure
+
+static int copy_stripe_remote(CrudStripeTask *task, int16_t src, uint32_t srcOffset) {
+
+	CrudOID *slot = stripe_object(task->file, task->stripe), oldOid = *slot;
+	uint8_t bit = 1 << task->stripe, oldIndexed = crud_codec_table[task->file].indexed & bit;
+	// A CONCAT is [kept bytes before start][source ranges][kept bytes after end]
+	CrudObjectRange ranges[4];
+	struct {
+		CrudObjectRange source; // The bytes to copy
+		uint32_t        offset; // Where the bytes go in the request's object
+	} copy;
+	struct iovec vec;
+	int i, n=0, pieces;
+	uint32_t at = task->start;
+	uint32_t id, length; // variables needed for extract_crud_response function
+	uint8_t req, result=1, flag=0;
+	CrudRequest request;
+	CrudResponse response;
+
+	if( oldOid == CRUD_NO_OBJECT && (task->start > 0 || task->end < task->newLength) )
+		return -1; // ERROR - the bytes to keep are in a hole
+	if( task->start > 0 )
+		set_range(&ranges[n++], oldOid, 0, task->start);
+	if( (pieces = source_ranges(src, srcOffset, task->end - task->start, &ranges[n])) == -1 )
+		return -1; // ERROR - the source bytes are not stored anywhere
+
+	// CASE 1: The stripe is private and keeps its length, so copy into it in place
+	if( oldOid != CRUD_NO_OBJECT && task->newLength == task->oldLength && !oldIndexed ) {
+		for( i=n; i<n+pieces; i++ ) {
+			copy.source = ranges[i];
+			copy.offset = htonl(at);
+			at += ntohl(ranges[i].length);
+
+			vec.iov_base = &copy;
+			vec.iov_len = sizeof(copy);
+			request = create_crud_request(oldOid, CRUD_COPY, sizeof(copy), 0, 0);
+			response = crud_client_operation_v(request, &vec, 1);
+
+			// Check for CRUD command success
+			extract_crud_response(response, &id, &req, &length, &flag, &result);
+			if( result )
+				return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+		}
+		return 0;
+	}
+
+	// CASE 2: Build the stripe's new object from its kept bytes and the source's
+	n += pieces;
+	if( task->end < task->newLength )
+		set_range(&ranges[n++], oldOid, task->end, task->newLength - task->end);
+
+	vec.iov_base = ranges;
+	vec.iov_len = n*sizeof(CrudObjectRange);
+	request = create_crud_request(0, CRUD_CONCAT, vec.iov_len, 0, 0);
+	response = crud_client_operation_v(request, &vec, 1);
+
+	// Check for CRUD command success
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if( result )
+		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+	if( length != task->newLength ) {
+		retire_object(id);
+		return -1; // ERROR - the server built an object of the wrong length
+	}
+
+	// Point the stripe at its new object and let go of the old one
+	*slot = id;
+	if( oldIndexed )
+		crud_codec_table[task->file].indexed &= ~bit;
+	if( oldOid != CRUD_NO_OBJECT && (oldIndexed ? release_chunk(oldOid) : retire_object(oldOid)) )
+		return -1; // ERROR - the old object could not be released
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : copy_range_remote
+// Description  : Copies a byte range between files without the bytes leaving
+//                the server, one destination stripe at a time.  Only raw
+//                stripes without holes can be cut into ranges, copies past
+//                the end of the destination leave a hole, and overlapping
+//                ranges of one file would read bytes already overwritten, so
+//                those are left to copy_range_local.
+//
+// Inputs       : src - the index of the source file in crud_file_table
+//                srcOffset - the first byte to copy from the source file
+//                dst - the index of the destination file in crud_file_table
+//                dstOffset - the first byte to copy to in the destination file
+//                count - the number of bytes to copy
+// Outputs      : the number of bytes copied or -1 if failure
+
+static int32_t copy_range_remote(int16_t src, uint32_t srcOffset, int16_t dst, uint32_t dstOffset, uint32_t count) {
+
+	uint32_t stripe, stripeStart, from, to, oldFileLength, newFileLength;
+	CrudStripeTask task;
+
+	if( crud_codec_table[dst].codec != CRUD_CODEC_NONE || crud_codec_table[dst].dedup )
+		return -1; // ERROR - the destination's stripes must go through the staging buffer
+	if( src == dst && srcOffset < dstOffset + count && dstOffset < srcOffset + count )
+		return -1; // ERROR - the ranges overlap
+	if( dstOffset > crud_file_table[dst].length )
+		return -1; // ERROR - the copy leaves a hole
+	if( srcOffset + count > striped_length(src) || crud_segment_table[dst].count )
+		return -1; // ERROR - the source range or the destination has bytes in segments
+	if( crud_pack_table[src].container != CRUD_NO_OBJECT || crud_pack_table[dst].container != CRUD_NO_OBJECT ||
+			crud_inline_table[src].inlined || crud_inline_table[dst].inlined )
+		return -1; // ERROR - a packed or inline file has no stripes to copy between
+	for( stripe = srcOffset / CRUD_STRIPE_SIZE; stripe <= (srcOffset + count - 1) / CRUD_STRIPE_SIZE; stripe++ ) {
+		if( crud_codec_table[src].stored[stripe] || crud_extent_table[src].holes[stripe] )
+			return -1; // ERROR - a source stripe is stored compressed or with holes
+	}
+	for( stripe = dstOffset / CRUD_STRIPE_SIZE; stripe <= (dstOffset + count - 1) / CRUD_STRIPE_SIZE; stripe++ ) {
+		if( crud_codec_table[dst].stored[stripe] || crud_extent_table[dst].holes[stripe] )
+			return -1; // ERROR - a destination stripe is stored compressed or with holes
+	}
+
+	oldFileLength = crud_file_table[dst].length;
+	newFileLength = (dstOffset + count > oldFileLength) ? dstOffset + count : oldFileLength;
+
+	// Copy the part of the range that falls in each destination stripe
+	for( stripe = dstOffset / CRUD_STRIPE_SIZE; stripe <= (dstOffset + count - 1) / CRUD_STRIPE_SIZE; stripe++ ) {
+		stripeStart = stripe * CRUD_STRIPE_SIZE;
+		from = (dstOffset > stripeStart) ? dstOffset : stripeStart;
+		to = (dstOffset + count < stripeStart + CRUD_STRIPE_SIZE) ? dstOffset + count : stripeStart + CRUD_STRIPE_SIZE;
+
+		task.file = dst;
+		task.stripe = stripe;
+		task.start = from - stripeStart;
+		task.end = to - stripeStart;
+		task.oldLength = (oldFileLength <= stripeStart) ? 0 :
+			((oldFileLength - stripeStart < CRUD_STRIPE_SIZE) ? oldFileLength - stripeStart : CRUD_STRIPE_SIZE);
+		task.newLength = (newFileLength - stripeStart < CRUD_STRIPE_SIZE) ? newFileLength - stripeStart : CRUD_STRIPE_SIZE;
+		if( copy_stripe_remote(&task, src, srcOffset + (from - dstOffset)) )
+			return -1; // ERROR - the stripe could not be copied
+
+		// Grow the file as each stripe lands, so it never has a gap
+		if( stripeStart + task.newLength > crud_file_table[dst].length )
+			crud_file_table[dst].length = stripeStart + task.newLength;
+	}
+
+	return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : copy_range_local
+// Description  : Copies a byte range between files through the client, for
+//                ranges the server cannot copy, a stripe's worth at a time
+//                through the thread's staging arena.  A range of one file
+//                copied to a later offset goes from its end, so overlapping
+//                ranges copy as if through a separate buffer.
+//
+// Inputs       : src - the index of the source file in crud_file_table
+//                srcOffset - the first byte to copy from the source file
+//                dst - the index of the destination file in crud_file_table
+//                dstOffset - the first byte to copy to in the destination file
+//                count - the number of bytes to copy
+// Outputs      : the number of bytes copied or -1 if failure
+
+static int32_t copy_range_local(int16_t src, uint32_t srcOffset, int16_t dst, uint32_t dstOffset, uint32_t count) {
+
+	CrudThreadArena *arena = thread_arena();
+	uint8_t backward = (src == dst && dstOffset > srcOffset);
+	uint32_t done, at, take;
+	struct iovec iov;
+
+	if( arena == NULL )
+		return -1; // ERROR - the thread has no staging buffer
+
+	// Each piece is read before any byte it overlaps is written, whichever way the copy goes
+	for( done=0; done<count; done+=take ) {
+		take = (count - done < CRUD_STRIPE_SIZE) ? count - done : CRUD_STRIPE_SIZE;
+		at = backward ? count - done - take : done;
+		iov.iov_base = arena->copy;
+		iov.iov_len = take;
+		if( read_file_atv(src, &iov, 1, srcOffset + at) != (int32_t)take ||
+				write_file_atv(dst, &iov, 1, dstOffset + at) != (int32_t)take )
+			return -1; // ERROR - a piece of the range could not be read or written
+	}
+
+	return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_copy_range
+// Description  : Copies up to "count" bytes from one open file to another, or
+//                within one file, without moving either file position.  The
+//                bytes are copied on the server with COPY and CONCAT requests
+//                when both ranges are stored raw, and through the client
+//                otherwise or if the server does not take those requests.
+//
+// Inputs       : src_fd - the file handle to copy from
+//                src_offset - the first byte to copy from
+//                dst_fd - the file handle to copy to
+//                dst_offset - the first byte to copy to
+//                count - the most bytes to copy
+// Outputs      : the number of bytes copied or -1 if failure
+
+int32_t crud_copy_range(int16_t src_fd, uint32_t src_offset, int16_t dst_fd, uint32_t dst_offset, int32_t count) {
+
+	int32_t copied = 0;
+	int16_t src, dst;
+
+	if( get_open_file(src_fd, &src) == NULL || get_open_file(dst_fd, &dst) == NULL )
+		return -1; // ERROR - a file handle is out of range or not open
+	if( count < 0 )
+		return -1; // ERROR - negative number of bytes
+
+	// Lock the files in index order, so copies running the other way cannot deadlock.  Bytes
+	// of either file held in memory are stored first, the source's without its lock held.
+	for( ;; ) {
+		if( src == dst )
+			pthread_rwlock_wrlock(&crud_file_locks[dst]);
+		else if( src < dst ) {
+			pthread_rwlock_rdlock(&crud_file_locks[src]);
+			pthread_rwlock_wrlock(&crud_file_locks[dst]);
+		} else {
+			pthread_rwlock_wrlock(&crud_file_locks[dst]);
+			pthread_rwlock_rdlock(&crud_file_locks[src]);
+		}
+		if( src == dst || !crud_dirty_table[src].dirty )
+			break;
+
+		pthread_rwlock_unlock(&crud_file_locks[dst]);
+		pthread_rwlock_unlock(&crud_file_locks[src]);
+		pthread_rwlock_wrlock(&crud_file_locks[src]);
+		copied = flush_file(src, 0);
+		pthread_rwlock_unlock(&crud_file_locks[src]);
+		if( copied )
+			return -1; // ERROR - the source's bytes held in memory could not be stored
+	}
+	if( flush_file(dst, 0) )
+		copied = -1; // ERROR - the destination's bytes held in memory could not be stored
+
+	// Copy no further than the end of the source
+	else if( src_offset < crud_file_table[src].length && count > 0 ) {
+		if( crud_file_table[src].length - src_offset < (uint32_t)count )
+			count = crud_file_table[src].length - src_offset;
+		if( (uint64_t)dst_offset + count > CRUD_MAX_FILE_SIZE )
+			copied = -1; // ERROR - copy would make the destination too large
+		else if( (copied = copy_range_remote(src, src_offset, dst, dst_offset, count)) == -1 )
+			copied = copy_range_local(src, src_offset, dst, dst_offset, count);
+	}
+
+	pthread_rwlock_unlock(&crud_file_locks[dst]);
+	if( src != dst )
+		pthread_rwlock_unlock(&crud_file_locks[src]);
+	return copied;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : release_completion
+// Description  : Drops one reference to a completion, freeing it with the last
+//
+// Inputs       : completion - the completion
+// Outputs      : none
+
+static void release_completion(CrudCompletion *completion) {
+
+	int refs;
+
+	pthread_mutex_lock(&completion->lock);
+	refs = --completion->refs;
+	pthread_mutex_unlock(&completion->lock);
+
+	if( refs == 0 ) {
+
+		// Keep a few completions around so steady asynchronous I/O does not allocate
+		pthread_mutex_lock(&crud_queue_lock);
+		if( crud_pooled_completions < CRUD_COMPLETION_POOL ) {
+			completion->work.next = crud_completion_pool;
+			crud_completion_pool = &completion->work;
+			crud_pooled_completions++;
+			completion = NULL;
+		}
+		pthread_mutex_unlock(&crud_queue_lock);
+
+		if( completion != NULL ) {
+			pthread_mutex_destroy(&completion->lock);
+			pthread_cond_destroy(&completion->finished);
+			free(completion);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_async_work
+// Description  : Runs a queued asynchronous operation on a worker, calls its
+//                callback and then marks it done
+//
+// Inputs       : item - the completion of the operation
+// Outputs      : none
+
+static void run_async_work(CrudWorkItem *item) {
+
+	CrudCompletion *completion = (CrudCompletion *)item;
+
+	switch( completion->type ) {
+	case CRUD_ASYNC_OPEN:
+		completion->result = crud_open(completion->path);
+		break;
+	case CRUD_ASYNC_READ:
+		completion->result = crud_read(completion->fd, completion->buf, completion->count);
+		break;
+	case CRUD_ASYNC_WRITE:
+		completion->result = crud_write(completion->fd, completion->buf, completion->count);
+		break;
+	}
+
+	if( completion->callback != NULL )
+		completion->callback(completion, completion->result, completion->arg);
+
+	pthread_mutex_lock(&completion->lock);
+	completion->done = 1;
+	pthread_cond_broadcast(&completion->finished);
+	pthread_mutex_unlock(&completion->lock);
+
+	release_completion(completion);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : submit_async
+// Description  : Creates the completion for an asynchronous operation and
+//                queues the operation for the worker pool
+//
+// Inputs       : type - the operation to run
+//                fd, buf, count - the arguments of a read or write
+//                path - the argument of an open
+//                callback - called on a worker once the operation finishes, or NULL
+//                arg - passed to the callback
+// Outputs      : the completion, NULL if failure
+
+static CrudCompletion *submit_async(CRUD_ASYNC_TYPE type, int16_t fd, void *buf, int32_t count,
+		char *path, CrudCompletionCallback callback, void *arg) {
+
+	CrudCompletion *completion;
+
+	pthread_once(&crud_workers_once, start_io_workers);
+	if( crud_io_workers == 0 )
+		return NULL; // ERROR - there are no workers to run the operation
+
+	// Reuse a pooled completion if there is one
+	pthread_mutex_lock(&crud_queue_lock);
+	completion = (CrudCompletion *)crud_completion_pool;
+	if( completion != NULL ) {
+		crud_completion_pool = completion->work.next;
+		crud_pooled_completions--;
+	}
+	pthread_mutex_unlock(&crud_queue_lock);
+
+	if( completion == NULL ) {
+		completion = malloc(sizeof(CrudCompletion));
+		if( completion == NULL )
+			return NULL; // ERROR - malloc returned a NULL pointer
+		pthread_mutex_init(&completion->lock, NULL);
+		pthread_cond_init(&completion->finished, NULL);
+	}
+
+	completion->work.run = run_async_work;
+	completion->type = type;
+	completion->fd = fd;
+	completion->buf = buf;
+	completion->count = count;
+	completion->path[0] = '\0';
+	if( path != NULL ) {
+		strncpy(completion->path, path, CRUD_MAX_PATH_LENGTH-1);
+		completion->path[CRUD_MAX_PATH_LENGTH-1] = '\0';
+	}
+	completion->callback = callback;
+	completion->arg = arg;
+	completion->result = -1;
+	completion->done = 0;
+	completion->refs = 2; // One for the caller, one for the worker pool
+
+	pthread_mutex_lock(&crud_queue_lock);
+	enqueue_work(&crud_async_head, &crud_async_tail, &completion->work);
+	pthread_cond_signal(&crud_queue_ready);
+	pthread_mutex_unlock(&crud_queue_lock);
+
+	return completion;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_open_async
+// Description  : Starts a crud_open of "path" without waiting for it
+//
+// Inputs       : path - the path "in the storage array"
+//                callback - called on a worker once the open finishes, or NULL
+//                arg - passed to the callback
+// Outputs      : the completion of the open, NULL if failure
+
+CrudCompletion *crud_open_async(char *path, CrudCompletionCallback callback, void *arg) {
+
+	if( path == NULL || strlen(path) > CRUD_MAX_PATH_LENGTH-1 )
+		return NULL; // ERROR - path is not a valid file name
+
+	return submit_async(CRUD_ASYNC_OPEN, -1, NULL, 0, path, callback, arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_read_async
+// Description  : Starts a crud_read without waiting for it.  "buf" must stay
+//                valid until the read completes.
+//
+// Inputs       : fd - the file descriptor for the read
+//                buf - the buffer to place the bytes into
+//                count - the number of bytes to read
+//                callback - called on a worker once the read finishes, or NULL
+//                arg - passed to the callback
+// Outputs      : the completion of the read, NULL if failure
+
+CrudCompletion *crud_read_async(int16_t fd, void *buf, int32_t count, CrudCompletionCallback callback, void *arg) {
+
+	return submit_async(CRUD_ASYNC_READ, fd, buf, count, NULL, callback, arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_write_async
+// Description  : Starts a crud_write without waiting for it.  "buf" must stay
+//                valid until the write completes.
+//
+// Inputs       : fd - the file descriptor for the file to write to
+//                buf - the buffer to write
+//                count - the number of bytes to write
+//                callback - called on a worker once the write finishes, or NULL
+//                arg - passed to the callback
+// Outputs      : the completion of the write, NULL if failure
+
+CrudCompletion *crud_write_async(int16_t fd, void *buf, int32_t count, CrudCompletionCallback callback, void *arg) {
+
+	return submit_async(CRUD_ASYNC_WRITE, fd, buf, count, NULL, callback, arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_async_poll
+// Description  : Checks whether an asynchronous operation has finished
+//
+// Inputs       : completion - the completion of the operation
+//                result - set to the return value of the operation once done
+// Outputs      : 1 if the operation and its callback have finished, 0 if not
+
+int crud_async_poll(CrudCompletion *completion, int32_t *result) {
+
+	int done;
+
+	pthread_mutex_lock(&completion->lock);
+	done = completion->done;
+	if( done && result != NULL )
+		*result = completion->result;
+	pthread_mutex_unlock(&completion->lock);
+
+	return done;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_async_wait
+// Description  : Waits for an asynchronous operation and its callback to
+//                finish, then releases the completion
+//
+// Inputs       : completion - the completion of the operation
+// Outputs      : the return value of the operation
+
+int32_t crud_async_wait(CrudCompletion *completion) {
+
+	int32_t result;
+
+	pthread_mutex_lock(&completion->lock);
+	while( !completion->done )
+		pthread_cond_wait(&completion->finished, &completion->lock);
+	result = completion->result;
+	pthread_mutex_unlock(&completion->lock);
+
+	release_completion(completion);
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crud_async_release
+// Description  : Releases a completion without waiting for its operation,
+//                which still runs and calls its callback
+//
+// Inputs       : completion - the completion of the operation
+// Outputs      : none
+
+void crud_async_release(CrudCompletion *completion) {
+
+	release_completion(completion);
+}
+
+// Module local methods
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudCheckUnitFile
+// Description  : Checks that a file reads back as expected, for the unit tests
+//
+// Inputs       : path - the path of the file
+//                expected - the bytes the file should hold
+//                length - the length the file should have
+// Outputs      : 0 if the file matches, -1 if not
+
+static int crudCheckUnitFile(char *path, const char *expected, int32_t length) {
+
+	int16_t fh;
+	int32_t bytes;
+	char *tbuf;
+
+	if ((tbuf = malloc(CRUD_MAX_FILE_SIZE)) == NULL) {
+		return(-1);
+	}
+	fh = crud_open(path);
+	bytes = (fh == -1) ? -1 : crud_pread(fh, tbuf, CRUD_MAX_FILE_SIZE, 0);
+	if ((fh != -1 && crud_close(fh)) || bytes != length || memcmp(tbuf, expected, length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : file %s does not read back [%d!=%d].", path, bytes, length);
+		free(tbuf);
+		return(-1);
+	}
+
+	free(tbuf);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudGcUnitTest
+// Description  : Tests garbage collection.  An object left behind by a write
+//                that failed before any table named it must be deleted, and
+//                a pass over files stored every way the tables allow must
+//                leave each of them as it was, across a remount.
+//
+// Inputs       : None
+// Outputs      : 0 if successful or -1 if failure
+
+static int crudGcUnitTest(void) {
+
+	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
+	uint32_t id, length; // variables needed for extract_crud_response function
+	char *names[7] = { "gc/dedup1", "gc/dedup2", "gc/clone", "gc/append", "gc/packed", "gc/inline", "gc/sub/deep" };
+	int32_t lengths[7];
+	char *contents[7], leaked[64];
+	int16_t fh, i, pass;
+	int32_t deleted, at;
+	CrudResponse response;
+
+	if (crud_format() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on format or mount operation.");
+		return(-1);
+	}
+
+	// A write that fails after creating its object leaves an object no table names
+	memset(leaked, 0xa5, sizeof(leaked));
+	response = crud_client_operation(create_crud_request(0, CRUD_CREATE, sizeof(leaked), 0, 0), leaked);
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if (result) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure creating leaked object.");
+		return(-1);
+	}
+	if ((deleted = crud_collect_garbage()) != 1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : collector deleted %d objects, not the leaked one.", deleted);
+		return(-1);
+	}
+	response = crud_client_operation(create_crud_request(id, CRUD_READ, sizeof(leaked), 0, 0), leaked);
+	extract_crud_response(response, &id, &req, &length, &flag, &result);
+	if (!result) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : leaked object survived collection.");
+		return(-1);
+	}
+
+	// Store files as shared stripes, a clone, segments, a container, the tables and a nested directory
+	for (i=0; i<7; i++) {
+		lengths[i] = (i < 3) ? 3*CRUD_STRIPE_SIZE/2 : (i == 3) ? 4*CIO_UNIT_TEST_MAX_WRITE_SIZE : (i == 4) ? 3000 : (i == 5) ? 20 : 5000;
+		contents[i] = malloc(lengths[i]);
+		memset(contents[i], 'a' + i, lengths[i]);
+	}
+	memcpy(contents[1], contents[0], lengths[0]);
+	for (i=0; i<7; i++) {
+		if (i == 2) {
+			memcpy(contents[2], contents[0], lengths[0]);
+			memcpy(&contents[2][100], "cloned", 6);
+			fh = crud_clone(names[0], names[2]) ? -1 : crud_open(names[2]);
+			if (fh == -1 || crud_pwrite(fh, "cloned", 6, 100) != 6) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure cloning %s.", names[0]);
+				return(-1);
+			}
+			crud_close(fh);
+			continue;
+		}
+		fh = crud_open(names[i]);
+		if (fh == -1 || (i < 2 && crud_set_dedup(fh, 1)) || (i == 3 && crud_set_append(fh, 1)) || (i == 4 && crud_set_pack(fh, 1))) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure setting up %s.", names[i]);
+			return(-1);
+		}
+		if (i == 3) {
+			for (at=0; at<lengths[i]; at+=CIO_UNIT_TEST_MAX_WRITE_SIZE) {
+				if (crud_write(fh, &contents[i][at], CIO_UNIT_TEST_MAX_WRITE_SIZE) != CIO_UNIT_TEST_MAX_WRITE_SIZE) {
+					logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : append to %s failed.", names[i]);
+					return(-1);
+				}
+			}
+		} else if (crud_write(fh, contents[i], lengths[i]) != lengths[i]) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : write to %s failed.", names[i]);
+			return(-1);
+		}
+		crud_close(fh);
+	}
+
+	// Collect with everything stored, then again once the tables were reloaded
+	for (pass=0; pass<2; pass++) {
+		if (crud_syncfs() || crud_collect_garbage() == -1) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure collecting garbage.");
+			return(-1);
+		}
+		for (i=0; i<7; i++) {
+			if (crudCheckUnitFile(names[i], contents[i], lengths[i])) {
+				return(-1);
+			}
+		}
+		if (crud_unmount() || crud_mount()) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount or mount operation.");
+			return(-1);
+		}
+		for (i=0; i<7; i++) {
+			if (crudCheckUnitFile(names[i], contents[i], lengths[i])) {
+				return(-1);
+			}
+		}
+	}
+
+	for (i=0; i<7; i++) {
+		free(contents[i]);
+	}
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount operation.");
+		return(-1);
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudResizeUnitTest
+// Description  : Tests crud_truncate and crud_fallocate.  A file shrunk
+//                across a stripe keeps only its start, grown again it reads
+//                zeros past the cut instead of its old bytes, a file kept in
+//                the tables resizes the same way, and a file allocated ahead
+//                reads zeros until overwritten in place, across a remount.
+//
+// Inputs       : None
+// Outputs      : 0 if successful or -1 if failure
+
+static int crudResizeUnitTest(void) {
+
+	char *names[3] = { "resize/shrunk", "resize/tiny", "resize/allocated" };
+	int32_t lengths[3], size = 2*CRUD_STRIPE_SIZE + 300, at;
+	char *contents[3];
+	int16_t fh[3], i;
+
+	if (crud_format() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on format or mount operation.");
+		return(-1);
+	}
+	for (i=0; i<3; i++) {
+		contents[i] = calloc(1, size);
+		if ((fh[i] = crud_open(names[i])) == -1) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure creating %s.", names[i]);
+			return(-1);
+		}
+	}
+
+	// Shrink a file of two stripes into its first, then grow it past where it ended
+	memset(contents[0], 'r', 3*CRUD_STRIPE_SIZE/2);
+	if (crud_write(fh[0], contents[0], 3*CRUD_STRIPE_SIZE/2) != 3*CRUD_STRIPE_SIZE/2 ||
+			crud_truncate(fh[0], CRUD_STRIPE_SIZE/2 + 10) || crud_size(fh[0]) != CRUD_STRIPE_SIZE/2 + 10) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure shrinking %s.", names[0]);
+		return(-1);
+	}
+	memset(&contents[0][CRUD_STRIPE_SIZE/2 + 10], 0, size - (CRUD_STRIPE_SIZE/2 + 10));
+	if (crudCheckUnitFile(names[0], contents[0], CRUD_STRIPE_SIZE/2 + 10) || crud_truncate(fh[0], size) ||
+			crud_size(fh[0]) != size || crudCheckUnitFile(names[0], contents[0], size)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : %s does not read zeros past its cut.", names[0]);
+		return(-1);
+	}
+	lengths[0] = size;
+
+	// A file kept in the tables is cut and grown the same way
+	memset(contents[1], 't', 20);
+	if (crud_write(fh[1], contents[1], 20) != 20 || crud_truncate(fh[1], 5) || crud_truncate(fh[1], 40)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure resizing %s.", names[1]);
+		return(-1);
+	}
+	memset(&contents[1][5], 0, 15);
+	lengths[1] = 40;
+
+	// An allocated file reads zeros, never shrinks, and keeps its length as it is overwritten
+	if (crud_fallocate(fh[2], size) || crud_size(fh[2]) != size || crudCheckUnitFile(names[2], contents[2], size) ||
+			crud_fallocate(fh[2], 10) || crud_size(fh[2]) != size) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure allocating %s.", names[2]);
+		return(-1);
+	}
+	for (at=0; at<size; at+=CRUD_STRIPE_SIZE/3) {
+		memset(&contents[2][at], 'a' + at%26, 100);
+		if (crud_pwrite(fh[2], &contents[2][at], 100, at) != 100) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : overwrite of %s failed.", names[2]);
+			return(-1);
+		}
+	}
+	if (crud_size(fh[2]) != size) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : overwrite grew %s.", names[2]);
+		return(-1);
+	}
+	lengths[2] = size;
+
+	// Every file reads back the same before and after a remount
+	for (i=0; i<3; i++) {
+		if (crud_close(fh[i]) || crudCheckUnitFile(names[i], contents[i], lengths[i])) {
+			return(-1);
+		}
+	}
+	if (crud_unmount() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount or mount operation.");
+		return(-1);
+	}
+	for (i=0; i<3; i++) {
+		if (crudCheckUnitFile(names[i], contents[i], lengths[i])) {
+			return(-1);
+		}
+		free(contents[i]);
+	}
+
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount operation.");
+		return(-1);
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudRemoteUnitCopy
+// Description  : Copies a range between open files on the server only, with
+//                no fallback, for the unit tests to tell which ranges the
+//                server takes
+//
+// Inputs       : srcFh, srcOffset - the file handle and first byte to copy from
+//                dstFh, dstOffset - the file handle and first byte to copy to
+//                count - the number of bytes to copy
+// Outputs      : the number of bytes copied or -1 if the server was not asked
+
+static int32_t crudRemoteUnitCopy(int16_t srcFh, uint32_t srcOffset, int16_t dstFh, uint32_t dstOffset, uint32_t count) {
+
+	int16_t src = crud_open_table[srcFh].file, dst = crud_open_table[dstFh].file;
+	int32_t copied;
+
+	if (crud_fsync(srcFh) || crud_fsync(dstFh)) {
+		return(-1);
+	}
+	pthread_rwlock_wrlock(&crud_file_locks[(src < dst) ? src : dst]);
+	if (src != dst) {
+		pthread_rwlock_wrlock(&crud_file_locks[(src < dst) ? dst : src]);
+	}
+	copied = copy_range_remote(src, srcOffset, dst, dstOffset, count);
+	pthread_rwlock_unlock(&crud_file_locks[dst]);
+	if (src != dst) {
+		pthread_rwlock_unlock(&crud_file_locks[src]);
+	}
+
+	return(copied);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudCopyRangeUnitTest
+// Description  : Tests crud_copy_range.  Raw ranges across stripes are copied
+//                on the server, while overlapping ranges of one file, source
+//                stripes with holes, copies past the end of the destination
+//                and compressed stripes are refused by the server and copied
+//                through the client instead, all reading back across a
+//                remount.
+//
+// Inputs       : None
+// Outputs      : 0 if successful or -1 if failure
+
+static int crudCopyRangeUnitTest(void) {
+
+	char *names[4] = { "copy/src", "copy/dst", "copy/holes", "copy/lz" };
+	int32_t lengths[4] = { 2*CRUD_STRIPE_SIZE + 1000, CRUD_STRIPE_SIZE, CRUD_STRIPE_SIZE, CRUD_STRIPE_SIZE + 500 };
+	char *contents[4];
+	int16_t fh[4], i;
+	int32_t at;
+
+	if (crud_format() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on format or mount operation.");
+		return(-1);
+	}
+
+	// A raw source with no zero pages, a raw destination, a source whose first pages are holes and a compressed file
+	for (i=0; i<4; i++) {
+		contents[i] = calloc(1, 3*CRUD_STRIPE_SIZE);
+		for (at=0; at<lengths[i]; at++) {
+			contents[i][at] = (i == 0) ? 1 + at%251 : (i == 1) ? 'd' : (i == 2) ? ((at < 2*CRUD_SPARSE_PAGE) ? 0 : 'h') : 'a' + (at/64)%4;
+		}
+		if ((fh[i] = crud_open(names[i])) == -1 || (i == 3 && crud_set_codec(fh[i], CRUD_CODEC_LZ)) ||
+				crud_write(fh[i], contents[i], lengths[i]) != lengths[i] || crud_fsync(fh[i])) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure creating %s.", names[i]);
+			return(-1);
+		}
+	}
+	if (!crud_extent_table[crud_open_table[fh[2]].file].holes[0] || !crud_codec_table[crud_open_table[fh[3]].file].stored[0]) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : %s was not stored with holes or %s compressed.", names[2], names[3]);
+		return(-1);
+	}
+
+	// The server copies a range across a stripe boundary that grows the destination, and one in place
+	if (crudRemoteUnitCopy(fh[0], 1000, fh[1], 500, CRUD_STRIPE_SIZE + 200) != CRUD_STRIPE_SIZE + 200 ||
+			crud_copy_range(fh[0], 7, fh[1], 20, 300) != 300) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure copying %s to %s on the server.", names[0], names[1]);
+		return(-1);
+	}
+	memcpy(&contents[1][500], &contents[0][1000], CRUD_STRIPE_SIZE + 200);
+	memcpy(&contents[1][20], &contents[0][7], 300);
+	lengths[1] = CRUD_STRIPE_SIZE + 700;
+
+	// Overlapping ranges of one file are refused and copy as if through a separate buffer, either way
+	if (crudRemoteUnitCopy(fh[0], 100, fh[0], 300, 5000) != -1 || crud_copy_range(fh[0], 100, fh[0], 300, 5000) != 5000 ||
+			crud_copy_range(fh[0], CRUD_STRIPE_SIZE + 50, fh[0], CRUD_STRIPE_SIZE - 40, 3000) != 3000) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure copying overlapping ranges of %s.", names[0]);
+		return(-1);
+	}
+	memmove(&contents[0][300], &contents[0][100], 5000);
+	memmove(&contents[0][CRUD_STRIPE_SIZE - 40], &contents[0][CRUD_STRIPE_SIZE + 50], 3000);
+
+	// Overlapping ranges longer than the stripe copied through the client at a time, either way
+	if (crud_copy_range(fh[0], 0, fh[0], 1000, CRUD_STRIPE_SIZE + 500) != CRUD_STRIPE_SIZE + 500 ||
+			crud_copy_range(fh[0], 2000, fh[0], 700, CRUD_STRIPE_SIZE + 300) != CRUD_STRIPE_SIZE + 300) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure copying long overlapping ranges of %s.", names[0]);
+		return(-1);
+	}
+	memmove(&contents[0][1000], contents[0], CRUD_STRIPE_SIZE + 500);
+	memmove(&contents[0][700], &contents[0][2000], CRUD_STRIPE_SIZE + 300);
+
+	// Holes in the source, or left in the destination by copying past its end, are refused
+	if (crudRemoteUnitCopy(fh[2], 0, fh[1], 0, 3*CRUD_SPARSE_PAGE) != -1 || crud_copy_range(fh[2], 0, fh[1], 0, 3*CRUD_SPARSE_PAGE) != 3*CRUD_SPARSE_PAGE ||
+			crudRemoteUnitCopy(fh[0], 0, fh[1], lengths[1] + 100, 200) != -1 || crud_copy_range(fh[0], 0, fh[1], lengths[1] + 100, 200) != 200) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure copying holes to %s.", names[1]);
+		return(-1);
+	}
+	memcpy(contents[1], contents[2], 3*CRUD_SPARSE_PAGE);
+	memcpy(&contents[1][lengths[1] + 100], contents[0], 200);
+	lengths[1] += 300;
+
+	// Compressed stripes are refused as the source and as the destination
+	if (crudRemoteUnitCopy(fh[3], 10, fh[1], 0, 1000) != -1 || crud_copy_range(fh[3], 10, fh[1], 0, 1000) != 1000 ||
+			crudRemoteUnitCopy(fh[0], 0, fh[3], 5, 1000) != -1 || crud_copy_range(fh[0], 0, fh[3], 5, 1000) != 1000) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure copying to or from %s.", names[3]);
+		return(-1);
+	}
+	memcpy(contents[1], &contents[3][10], 1000);
+	memcpy(&contents[3][5], contents[0], 1000);
+
+	// Every file reads back the same before and after a remount
+	for (i=0; i<4; i++) {
+		if (crud_close(fh[i]) || crudCheckUnitFile(names[i], contents[i], lengths[i])) {
+			return(-1);
+		}
+	}
+	if (crud_unmount() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount or mount operation.");
+		return(-1);
+	}
+	for (i=0; i<4; i++) {
+		if (crudCheckUnitFile(names[i], contents[i], lengths[i])) {
+			return(-1);
+		}
+		free(contents[i]);
+	}
+
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount operation.");
+		return(-1);
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudHoleUnitTest
+// Description  : Tests sparse files.  Seeking past the end of a file and
+//                writing leaves a hole that reads as zeros, whole stripes of
+//                it with no object and zero pages left out of the stripes
+//                that have one, until a write lands in it, across a remount.
+//
+// Inputs       : None
+// Outputs      : 0 if successful or -1 if failure
+
+static int crudHoleUnitTest(void) {
+
+	char *names[2] = { "holes/far", "holes/near" };
+	int32_t lengths[2] = { 3*CRUD_STRIPE_SIZE + 700, 5*CRUD_SPARSE_PAGE + 7 };
+	char *contents[2], tbuf[16];
+	int16_t fh[2], file, i;
+
+	if (crud_format() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on format or mount operation.");
+		return(-1);
+	}
+	for (i=0; i<2; i++) {
+		contents[i] = calloc(1, lengths[i]);
+		if ((fh[i] = crud_open(names[i])) == -1) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure creating %s.", names[i]);
+			return(-1);
+		}
+	}
+
+	// Write the start of a file, then seek two stripes past its end and write again
+	memset(contents[0], 'a', 100);
+	memset(&contents[0][3*CRUD_STRIPE_SIZE + 500], 'b', 200);
+	if (crud_write(fh[0], contents[0], 100) != 100 || crud_seek(fh[0], 3*CRUD_STRIPE_SIZE + 500) ||
+			crud_write(fh[0], &contents[0][3*CRUD_STRIPE_SIZE + 500], 200) != 200 ||
+			crud_size(fh[0]) != lengths[0] || crud_fsync(fh[0])) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure writing past the end of %s.", names[0]);
+		return(-1);
+	}
+	file = crud_open_table[fh[0]].file;
+	if (*stripe_object(file, 1) != CRUD_NO_OBJECT || *stripe_object(file, 2) != CRUD_NO_OBJECT ||
+			crud_extent_table[file].holes[0] != ~(uint32_t)1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : the hole in %s was stored.", names[0]);
+		return(-1);
+	}
+
+	// Reads past the end find nothing, and a seek past the largest file fails
+	if (crud_seek(fh[0], lengths[0] + 10) || crud_read(fh[0], tbuf, sizeof(tbuf)) != 0 ||
+			crud_seek(fh[0], CRUD_MAX_FILE_SIZE + 1) == 0) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure reading past the end of %s.", names[0]);
+		return(-1);
+	}
+
+	// A write into the hole gives its stripe an object again
+	memset(&contents[0][2*CRUD_STRIPE_SIZE + 40], 'c', 10);
+	if (crud_pwrite(fh[0], &contents[0][2*CRUD_STRIPE_SIZE + 40], 10, 2*CRUD_STRIPE_SIZE + 40) != 10 || crud_fsync(fh[0]) ||
+			*stripe_object(file, 2) == CRUD_NO_OBJECT || *stripe_object(file, 1) != CRUD_NO_OBJECT) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure writing into the hole of %s.", names[0]);
+		return(-1);
+	}
+
+	// A seek past the end within the last stripe leaves a hole of a few pages
+	memset(contents[1], 'n', 10);
+	memset(&contents[1][5*CRUD_SPARSE_PAGE + 3], 'm', 4);
+	if (crud_write(fh[1], contents[1], 10) != 10 || crud_seek(fh[1], 5*CRUD_SPARSE_PAGE + 3) ||
+			crud_write(fh[1], &contents[1][5*CRUD_SPARSE_PAGE + 3], 4) != 4 || crud_size(fh[1]) != lengths[1]) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure writing past the end of %s.", names[1]);
+		return(-1);
+	}
+
+	// Every file reads back the same before and after a remount
+	for (i=0; i<2; i++) {
+		if (crud_close(fh[i]) || crudCheckUnitFile(names[i], contents[i], lengths[i])) {
+			return(-1);
+		}
+	}
+	if (crud_unmount() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount or mount operation.");
+		return(-1);
+	}
+	for (i=0; i<2; i++) {
+		if (crudCheckUnitFile(names[i], contents[i], lengths[i])) {
+			return(-1);
+		}
+		free(contents[i]);
+	}
+
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount operation.");
+		return(-1);
+	}
+
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudCodecUnitTest
+// Description  : Tests files stored with CRUD_CODEC_LZ.  Stripes of text are
+//                stored compressed and one of random bytes raw, a write into
+//                a compressed stripe reads back, and turning the codec off
+//                stores only stripes rewritten since raw, across a remount.
+//
+// Inputs       : None
+// Outputs      : 0 if successful or -1 if failure
+
+static int crudCodecUnitTest(void) {
+
+	char *path = "lz/mixed", *contents;
+	const char line[] = "INFO request ok path=/api/v1/items\n";
+	int32_t length = 3*CRUD_STRIPE_SIZE, at;
+	uint32_t state = 12345;
+	int16_t fh, file;
+
+	if (crud_format() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on format or mount operation.");
+		return(-1);
+	}
+
+	// The first and last stripes are log lines, the middle one random bytes
+	contents = malloc(length);
+	for (at=0; at<length; at++) {
+		state = state*1103515245 + 12345;
+		contents[at] = (at/CRUD_STRIPE_SIZE == 1) ? (char)(state >> 16) : line[at % (sizeof(line)-1)];
+	}
+	if ((fh = crud_open(path)) == -1 || crud_set_codec(fh, CRUD_CODEC_LZ) ||
+			crud_write(fh, contents, length) != length || crud_fsync(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure writing %s.", path);
+		return(-1);
+	}
+	file = crud_open_table[fh].file;
+	if (!crud_codec_table[file].stored[0] || crud_codec_table[file].stored[1] || !crud_codec_table[file].stored[2] ||
+			crudCheckUnitFile(path, contents, length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : %s was not stored compressed where it shrinks.", path);
+		return(-1);
+	}
+
+	// A write inside a compressed stripe expands, changes and compresses it again
+	memset(&contents[5000], 'Z', 100);
+	if (crud_pwrite(fh, &contents[5000], 100, 5000) != 100 || crud_fsync(fh) ||
+			!crud_codec_table[file].stored[0] || crudCheckUnitFile(path, contents, length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure rewriting a compressed stripe of %s.", path);
+		return(-1);
+	}
+
+	// With the codec off a rewritten stripe is stored raw, the others stay compressed
+	memset(&contents[2*CRUD_STRIPE_SIZE + 10], 'Y', 10);
+	if (crud_set_codec(fh, CRUD_CODEC_NONE) || crud_pwrite(fh, &contents[2*CRUD_STRIPE_SIZE + 10], 10, 2*CRUD_STRIPE_SIZE + 10) != 10 ||
+			crud_fsync(fh) || !crud_codec_table[file].stored[0] || crud_codec_table[file].stored[2]) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure turning the codec of %s off.", path);
+		return(-1);
 	}
 
-	// CASE 2: File specified by 'path' does not exist
-	// If the file described by 'path' does not exist, create a new one
-	else {
-		for( i=0; i<CRUD_MAX_TOTAL_FILES; i++ ) {
-
-			// Find unopen file that does not already exist
-			if( !crud_file_table[i].open && strcmp(crud_file_table[i].filename,"")==0 ) {
-				
-				// Show that the file has been opened
-				crud_file_table[i].open = 1;
-
-				// Give initial values to other file variables
-				strcpy( crud_file_table[i].filename, path); // make filename the parameter path
-				crud_file_table[i].object_id = CRUD_NO_OBJECT;
-				crud_file_table[i].length = 0;
-				crud_file_table[i].position = 0;
-
-				// Return the new file handle for the file that has been opened
-				return i;
-			}
-		}
+	if (crud_close(fh) || crudCheckUnitFile(path, contents, length) || crud_unmount() || crud_mount() ||
+			crudCheckUnitFile(path, contents, length)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : %s does not read back across a remount.", path);
+		return(-1);
+	}
+	free(contents);
 
-		return -1; // ERROR - End of for loop reached without finding a unopen file
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount operation.");
+		return(-1);
 	}
+
+	return(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_close
-// Description  : This function closes the file
+// Function     : crudAsyncUnitCallback
+// Description  : Records that an asynchronous operation of the unit test
+//                finished, and with what result
 //
-// Inputs       : fd - the file handle of the object to close
-// Outputs      : 0 if successful, -1 if failure
-
-int16_t crud_close(int16_t fd) {
-	
-	if( fd < 0 || fd > CRUD_MAX_TOTAL_FILES-1 )
-		return -1; // ERROR - requested file handle out of range
+// Inputs       : completion - the completion of the operation
+//                result - the return value of the operation
+//                arg - two int32_t, set to the result and counted up
+// Outputs      : none
 
-	if( !crud_file_table[fd].open )
-		return -1; // ERROR - requested file has not yet been opened
+static void crudAsyncUnitCallback(CrudCompletion *completion, int32_t result, void *arg) {
 
-	// Set the file to closed
-	crud_file_table[fd].open = 0;
+	int32_t *seen = arg;
 
-	return 0;
+	(void)completion;
+	__atomic_store_n(&seen[0], result, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&seen[1], 1, __ATOMIC_RELEASE);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_read
-// Description  : Reads up to "count" bytes from the file handle "fh" into the
-//                buffer  "buf".
+// Function     : crudAsyncUnitTest
+// Description  : Tests the asynchronous interface.  Files are opened,
+//                written and read back by operations all in flight at once,
+//                each calling its callback once with the result it returns,
+//                whether waited for, polled or released unwaited, and a bad
+//                handle fails through its completion.
 //
-// Inputs       : fd - the file descriptor for the read
-//                buf - the buffer to place the bytes into
-//                count - the number of bytes to read
-// Outputs      : the number of bytes read or -1 if failures
-// 
-int32_t crud_read(int16_t fd, void *buf, int32_t count) {
-
-	// Temporary buffer used to read the entire object associated with the file
-	char *tempBuf;
-	// Temporary buffer used to hold only what needs to be read
-	char *tempBuf2;
-
-	int32_t i, bytesRead=0;
-	uint8_t req, result=1, flag=0;
-	CrudRequest request;
-	CrudResponse response;
-	
-	if( fd < 0 || fd > CRUD_MAX_TOTAL_FILES-1 )
-		return -1; // ERROR - requested file handle out of range
+// Inputs       : None
+// Outputs      : 0 if successful or -1 if failure
 
-	if( !crud_file_table[fd].open )
-		return -1; // ERROR - requested file has not yet been opened
-	if( buf == NULL )
-		return -1; // ERROR - buffer doesn't point to meaningful data
-	if( crud_file_table[fd].length == 0 )
-		return bytesRead; // No bytes to read (length = 0) so return 0
-	if( count < 1 )
-		return bytesRead; // If no bytes are to be read (count = 0), return 0
+static int crudAsyncUnitTest(void) {
 
-	// Allocate enough memory to store the bytes of the current file
-	tempBuf = malloc(CRUD_MAX_OBJECT_SIZE);
-	// Allocate enough memory to store the bytes that will be read
-	tempBuf2 = malloc(count);
+	char path[CRUD_MAX_PATH_LENGTH], contents[8][CIO_UNIT_TEST_MAX_WRITE_SIZE], tbuf[8][CIO_UNIT_TEST_MAX_WRITE_SIZE];
+	CrudCompletion *ops[8];
+	int32_t seen[8][2], result;
+	int16_t fh[8], i, step, tries;
+	struct timespec pause = { 0, 1000000 };
 
-	// Read the contents of the requested file into temporary buffer tempBuf
-	request = create_crud_request(crud_file_table[fd].object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, 0, 0);
-	response = crud_client_operation(request, tempBuf);
+	if (crud_format() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on format or mount operation.");
+		return(-1);
+	}
 
-	extract_crud_response(response, &crud_file_table[fd].object_id, &req, &crud_file_table[fd].length, 
-		&flag, &result);
-	if( result )
-		return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+	// Open, write and read back each file, every step started for all files before any is waited for
+	for (step=0; step<3; step++) {
+		memset(seen, 0, sizeof(seen));
+		for (i=0; i<8; i++) {
+			sprintf(path, "async/f%d", i);
+			memset(contents[i], 'a' + i, sizeof(contents[i]));
+			ops[i] = (step == 0) ? crud_open_async(path, crudAsyncUnitCallback, seen[i]) :
+				crud_seek(fh[i], 0) ? NULL :
+				(step == 1) ? crud_write_async(fh[i], contents[i], sizeof(contents[i]), crudAsyncUnitCallback, seen[i]) :
+				crud_read_async(fh[i], tbuf[i], sizeof(tbuf[i]), crudAsyncUnitCallback, seen[i]);
+			if (ops[i] == NULL) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure starting step %d on %s.", step, path);
+				return(-1);
+			}
+		}
 
-	// While the position in the current file does not exceed its length AND "count" bytes have not been read..
-	for( i=0; crud_file_table[fd].position < crud_file_table[fd].length && i<count; i++ ) {
-		// Copy the bytes one at a time from one buffer to the other starting at the position in the file
-		tempBuf2[i] = tempBuf[crud_file_table[fd].position];
-		crud_file_table[fd].position++; // Increment the file's position as each byte is read
-		bytesRead++; // Increment the number of bytes read
+		// The first file is polled to completion, the rest waited for
+		for (i=0; i<8; i++) {
+			if (i == 0) {
+				for (tries=0; !crud_async_poll(ops[i], &result) && tries<10000; tries++) {
+					nanosleep(&pause, NULL);
+				}
+				crud_async_release(ops[i]);
+			} else {
+				result = crud_async_wait(ops[i]);
+			}
+			if (step == 0) {
+				fh[i] = result;
+			}
+			if (result < 0 || (step > 0 && result != CIO_UNIT_TEST_MAX_WRITE_SIZE) ||
+					__atomic_load_n(&seen[i][1], __ATOMIC_ACQUIRE) != 1 || seen[i][0] != result) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : step %d on file %d returned %d, its callback %d.", step, i, result, seen[i][0]);
+				return(-1);
+			}
+		}
+	}
+	for (i=0; i<8; i++) {
+		if (memcmp(contents[i], tbuf[i], sizeof(contents[i]))) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : asynchronous read of file %d does not match.", i);
+			return(-1);
+		}
 	}
 
-	// Copy what needed to be read into the parameter buffer
-	memcpy(buf,tempBuf2,bytesRead);
+	// A write released unwaited still runs and calls back, and a bad handle fails through its completion
+	memset(seen, 0, sizeof(seen));
+	memset(contents[0], 'z', 100);
+	if (crud_seek(fh[0], 0) || (ops[0] = crud_write_async(fh[0], contents[0], 100, crudAsyncUnitCallback, seen[0])) == NULL) {
+		return(-1);
+	}
+	crud_async_release(ops[0]);
+	for (tries=0; __atomic_load_n(&seen[0][1], __ATOMIC_ACQUIRE) == 0 && tries<10000; tries++) {
+		nanosleep(&pause, NULL);
+	}
+	if (seen[0][0] != 100 || (ops[1] = crud_read_async(-1, tbuf[1], 10, NULL, NULL)) == NULL ||
+			crud_async_wait(ops[1]) != -1 || crud_open_async(NULL, NULL, NULL) != NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on released write or bad handle.");
+		return(-1);
+	}
 
-	// Free the memory allocated by the temporary buffers if they are not pointing to NULL and reset to NULL
-	if( tempBuf ) {
-		free(tempBuf);
-		tempBuf = NULL;
+	for (i=0; i<8; i++) {
+		sprintf(path, "async/f%d", i);
+		if (crud_close(fh[i]) || crudCheckUnitFile(path, contents[i], CIO_UNIT_TEST_MAX_WRITE_SIZE)) {
+			return(-1);
+		}
 	}
-	if( tempBuf2 ) {
-		free(tempBuf2);
-		tempBuf2 = NULL;
+
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount operation.");
+		return(-1);
 	}
 
-	return bytesRead;
+	return(0);
 }
 
-//////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : crud_write
-// Description  : Writes "count" bytes to the file handle "fh" from the
-//                buffer  "buf"
+// Function     : crudCheckUnitDirectory
+// Description  : Checks that the test directory "d" lists "e" then the files
+//                n000 to n099 in order, and that "d/e" holds only "f"
 //
-// Inputs       : fd - the file descriptor for the file to write to
-//                buf - the buffer to write
-//                count - the number of bytes to write
-// Outputs      : the number of bytes written or -1 if failure
-// Write count bytes at the end of the current file position
-// If you write past end of the file, you increase the file size
-// 
-int32_t crud_write(int16_t fd, void *buf, int32_t count) {
+// Inputs       : None
+// Outputs      : 0 if the directories match, -1 if not
 
-	// Temporary buffer used to hold the bytes that need to be written
-	char *tempBuf;
-	// Temporary buffer used to hold the bytes that are currently in the file
-	char *tempBuf2;
+static int crudCheckUnitDirectory(void) {
 
-	int newLength; // Length of the new object when resizing is needed
-	uint8_t req, result=1, flag=0; // variables needed for extract_crud_response function
-	CrudRequest request;
-	CrudResponse response;
-	
-	if( fd < 0 || fd > CRUD_MAX_TOTAL_FILES-1 )
-		return -1; // ERROR - file handle out of range
-	if( !crud_file_table[fd].open )
-		return -1; // ERROR - requested file has not yet been opened
-	if( buf == NULL )
-		return -1; // ERROR - buffer doesn't point to meaningful data
-	if( count < 1 )
-		return 0; // No bytes are to be written from the buffer
+	char name[CRUD_MAX_PATH_LENGTH], last[CRUD_MAX_PATH_LENGTH] = "";
+	CrudDirent dirent;
+	int16_t dd, found, count;
 
-	// Allocate enough memory to store the bytes that need to be written
-	tempBuf = malloc(count);
-	if( tempBuf == NULL )
-		return -1; // ERROR - malloc returned a NULL pointer
+	if ((dd = crud_opendir("d")) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure opening directory d.");
+		return(-1);
+	}
+	for (count=0; (found = crud_readdir(dd, &dirent)) == 1; count++) {
+		if (count == 0) {
+			strcpy(name, "e");
+		} else {
+			sprintf(name, "n%03d", count-1);
+		}
+		if (strcmp(dirent.name, last) <= 0 || strcmp(dirent.name, name) ||
+				dirent.type != ((count == 0) ? CRUD_DIRENT_DIRECTORY : CRUD_DIRENT_FILE) ||
+				dirent.length != (uint32_t)((count == 0) ? 0 : count-1)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : directory d lists %s where %s belongs.", dirent.name, name);
+			crud_closedir(dd);
+			return(-1);
+		}
+		strcpy(last, dirent.name);
+	}
+	if (crud_closedir(dd) || found != 0 || count != 101) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : directory d lists %d entries, not 101.", count);
+		return(-1);
+	}
 
-	tempBuf2 = NULL;
+	if ((dd = crud_opendir("d/e")) == -1 || crud_readdir(dd, &dirent) != 1 || strcmp(dirent.name, "f") ||
+			dirent.type != CRUD_DIRENT_FILE || crud_readdir(dd, &dirent) != 0 || crud_closedir(dd)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : directory d/e does not list only f.");
+		return(-1);
+	}
 
-	// Copy the bytes that need to be written to the temporary buffer "tempBuf"
-	memcpy(tempBuf, buf, count);
+	return(0);
+}
 
-	// CASE 0: The current file has not yet been associated with an object
-	// If the file hasn't been associated with an object yet, create the object and store the bytes in it
-	if( crud_file_table[fd].object_id == CRUD_NO_OBJECT )  {
-		
-		// Create the object and store the bytes from the parameter buffer in it
-		request = create_crud_request(0, CRUD_CREATE, count, 0, 0);
-		response = crud_client_operation(request, tempBuf);
-		
-		// Check for CRUD command success
-		extract_crud_response(response, &crud_file_table[fd].object_id, &req, &crud_file_table[fd].length, 
-			&flag, &result);
-		if( result )
-			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudPrefixUnitTest
+// Description  : Tests crud_list_prefix.  The files under a prefix, which
+//                need not end at a '/', are returned in order of their
+//                paths with their lengths, a file created during the
+//                iteration is returned only if it comes after the last one
+//                returned, and the order survives a remount.
+//
+// Inputs       : None
+// Outputs      : 0 if successful or -1 if failure
 
-		// Assign the position of the file to be at the end of the write
-		crud_file_table[fd].position = count;
-	}
+static int crudPrefixUnitTest(void) {
 
-	// CASE 1: The write DOES NOT change the size of the file
-	else if( crud_file_table[fd].length >= count+crud_file_table[fd].position ) {
-		
-		// Allocate enough memory for tempBuf2 to read all of the contents of the file
-		tempBuf2 = malloc(CRUD_MAX_OBJECT_SIZE);
-		if( tempBuf2 == NULL )
-			return -1; // ERROR - malloc returned a NULL pointer
+	char *paths[7] = { "p/b/z", "p/a2", "q/a", "p/a1/x", "p/a", "pa", "p/a1/w" };
+	// p/a1/v is created behind the listing of p/a and so is not in it
+	char *expected[2][6] = { { "p/a", "p/a1/w", "p/a1/x", "p/a2", "p/b/z", NULL },
+		{ "p/a", "p/a1/w", "p/a1/x", "p/a2", "p/a3", NULL } };
+	CrudPrefixIterator iterator;
+	CrudDirent dirent;
+	int16_t fh, i, n, found, pass;
 
-		// Read the current file and store its contents into tempBuf2
-		request = create_crud_request(crud_file_table[fd].object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, 0, 0);
-		response = crud_client_operation(request, tempBuf2);
+	if (crud_format() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on format or mount operation.");
+		return(-1);
+	}
 
-		// Check for CRUD command success
-		extract_crud_response(response, &crud_file_table[fd].object_id, &req, &crud_file_table[fd].length, 
-			&flag, &result);
-		if( result )
-			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+	// Files are created out of order, each as long as its path
+	for (i=0; i<7; i++) {
+		if ((fh = crud_open(paths[i])) == -1 || crud_write(fh, paths[i], strlen(paths[i])) != (int32_t)strlen(paths[i]) || crud_close(fh)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure creating %s.", paths[i]);
+			return(-1);
+		}
+	}
 
-		// Starting at the current file position, copy 'count' bytes from buf into tempBuf2
-		memcpy(&tempBuf2[crud_file_table[fd].position],buf,count);
-		
-		// Update the file using the newly crafted tempBuf2
-		request = create_crud_request(crud_file_table[fd].object_id, CRUD_UPDATE, crud_file_table[fd].length, 0, 0);
-		response = crud_client_operation(request, tempBuf2);
+	// Every file under "p/" in order, before and after a remount
+	for (pass=0; pass<2; pass++) {
+		if (crud_list_prefix("p/", &iterator)) {
+			return(-1);
+		}
+		for (n=0; (found = crud_next_prefix(&iterator, &dirent)) == 1; n++) {
+			if (expected[0][n] == NULL || strcmp(dirent.name, expected[0][n]) || dirent.type != CRUD_DIRENT_FILE ||
+					dirent.length != strlen(expected[0][n])) {
+				logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : prefix p/ lists %s where %s belongs.", dirent.name, expected[0][n]);
+				return(-1);
+			}
+		}
+		if (found != 0 || expected[0][n] != NULL || crud_unmount() || crud_mount()) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : prefix p/ lists %d files, not 5.", n);
+			return(-1);
+		}
+	}
 
-		// Check for CRUD command success
-		extract_crud_response(response, &crud_file_table[fd].object_id, &req, &crud_file_table[fd].length, 
-			&flag, &result);
-		if( result )
-			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+	// A prefix ending inside a name, a file created behind the iteration and one ahead of it
+	if (crud_list_prefix("p/a", &iterator) || crud_next_prefix(&iterator, &dirent) != 1 || crud_next_prefix(&iterator, &dirent) != 1 ||
+			(fh = crud_open("p/a1/v")) == -1 || crud_close(fh) || (fh = crud_open("p/a3")) == -1 || crud_close(fh)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure listing prefix p/a.");
+		return(-1);
+	}
+	for (n=2; (found = crud_next_prefix(&iterator, &dirent)) == 1; n++) {
+		if (expected[1][n] == NULL || strcmp(dirent.name, expected[1][n])) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : prefix p/a lists %s where %s belongs.", dirent.name, expected[1][n]);
+			return(-1);
+		}
+	}
+	if (found != 0 || expected[1][n] != NULL) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : prefix p/a does not end after p/a3.");
+		return(-1);
+	}
 
-		// Change position to the end of the write
-		crud_file_table[fd].position += count;
+	// The empty prefix lists every file, and one no path starts with lists none
+	if (crud_list_prefix("", &iterator)) {
+		return(-1);
+	}
+	for (n=0; crud_next_prefix(&iterator, &dirent) == 1; n++);
+	if (n != 9 || crud_list_prefix("r", &iterator) || crud_next_prefix(&iterator, &dirent) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : the empty prefix lists %d files, not 9.", n);
+		return(-1);
 	}
 
-	// CASE 2: The write DOES change the size of the file
-	else {
-		// Determine the length that the new object will have
-		newLength = count + crud_file_table[fd].position;
-		// Allocate enough memory to hold the new object
-		tempBuf2 = malloc( newLength );
-		if( tempBuf2 == NULL )
-			return -1; // ERROR - malloc returned a NULL pointer
-
-		// Read the current file and store its contents into tempBuf2
-		request = create_crud_request(crud_file_table[fd].object_id, CRUD_READ, newLength, 0, 0);
-		response = crud_client_operation(request, tempBuf2);
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount operation.");
+		return(-1);
+	}
 
-		// Check for CRUD command success
-		extract_crud_response(response, &crud_file_table[fd].object_id, &req, &crud_file_table[fd].length, 
-			&flag, &result);
-		if( result ) 
-			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
-		
-		// Starting at the file's current position, copy the bytes that need to be written into the buffer
-		memcpy(&tempBuf2[crud_file_table[fd].position], buf, count);
+	return(0);
+}
 
-		// Delete the old object of the shorter length
-		request = create_crud_request(crud_file_table[fd].object_id, CRUD_DELETE, 0, 0, 0);
-		response = crud_client_operation(request, NULL);
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : crudDirectoryUnitTest
+// Description  : Tests the directories.  Files are created in nested and
+//                missing directories, listed in order of their names across
+//                a remount, a name is refused as both a directory and a file,
+//                and the directory table fills at CRUD_MAX_DIRECTORIES.  A
+//                create that does not fit leaves no directory behind.
+//
+// Inputs       : None
+// Outputs      : 0 if successful or -1 if failure
 
-		// Check for CRUD command success
-		extract_crud_response(response, &crud_file_table[fd].object_id, &req, &crud_file_table[fd].length, 
-			&flag, &result);
-		if( result )
-			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+static int crudDirectoryUnitTest(void) {
 
-		// Create the new object of the new longer length
-		request = create_crud_request(0, CRUD_CREATE, newLength, 0, 0);
-		response = crud_client_operation(request, tempBuf2);
+	char path[CRUD_MAX_PATH_LENGTH], zeros[100];
+	int16_t fh, dd, i, pass, made;
 
-		// Check for CRUD command success
-		extract_crud_response(response, &crud_file_table[fd].object_id, &req, &crud_file_table[fd].length, 
-			&flag, &result);
-		if( result )
-			return -1; // ERROR - result code is 1 meaning there was a failure in command execution
+	if (crud_format() || crud_mount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on format or mount operation.");
+		return(-1);
+	}
 
-		// Assign the position of the file to be at the end of the write
-		crud_file_table[fd].position += count;
+	// A nested create in directories made by crud_mkdir, and one in directories crud_open makes
+	if (crud_mkdir("d") || crud_mkdir("d/e") || (fh = crud_open("d/e/f")) == -1 || crud_close(fh) ||
+			(fh = crud_open("x/y/z")) == -1 || crud_close(fh) || (dd = crud_opendir("x/y")) == -1 || crud_closedir(dd)) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on nested create.");
+		return(-1);
 	}
 
-	// Free buffers if the buffers are not pointing to NULL and set them to NULL once freed
-	if(tempBuf) {
-		free(tempBuf);
-		tempBuf = NULL;
+	// Create the files of d out of order, file nNNN holding NNN bytes
+	memset(zeros, 0, sizeof(zeros));
+	for (i=0; i<100; i++) {
+		sprintf(path, "d/n%03d", (i*37)%100);
+		if ((fh = crud_open(path)) == -1 || crud_write(fh, zeros, (i*37)%100) != (i*37)%100 || crud_close(fh)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure creating %s.", path);
+			return(-1);
+		}
 	}
-	if(tempBuf2) {
-		free(tempBuf2);
-		tempBuf2 = NULL;
+
+	// A name is either a directory or a file, never both
+	if (crud_mkdir("d/n001") == 0 || crud_open("d/e") != -1 || crud_mkdir("d/e") == 0 || crud_open("d/n001/g") != -1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : a name was taken as both a directory and a file.");
+		return(-1);
 	}
 
-	return count;
-}
+	// The tree reads back the same before and after a remount
+	for (pass=0; pass<2; pass++) {
+		if (crudCheckUnitDirectory()) {
+			return(-1);
+		}
+		if (crud_unmount() || crud_mount()) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount or mount operation.");
+			return(-1);
+		}
+	}
 
-////////////////////////////////////////////////////////////////////////////////
-//
-// Function     : crud_seek
-// Description  : Seek to specific point in the file
-//
-// Inputs       : fd - the file descriptor for the file to seek
-//                loc - offset from beginning of file to seek to
-// Outputs      : 0 if successful or -1 if failure
-// 
-int32_t crud_seek(int16_t fd, uint32_t loc) {
-	
-	if( fd < 0 || fd > (CRUD_MAX_TOTAL_FILES-1) )
-		return -1; // ERROR - requested file handle out of range
-	
-	if( !crud_file_table[fd].open )
-		return -1; // ERROR - requested file has not yet been opened
-	
-	if( loc > crud_file_table[fd].length || loc < 0 ) 
-		return -1; // ERROR - requested location out of range 
+	// With the file table full, a create in a missing directory fails without making it
+	for (i=0; ; i++) {
+		sprintf(path, "full%04d", i);
+		if ((fh = crud_open(path)) == -1) {
+			break;
+		}
+		crud_close(fh);
+	}
+	if (crud_open("newdir/f") != -1 || crud_opendir("newdir") != -1) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : a create with the file table full left newdir behind.");
+		return(-1);
+	}
 
-	// If both parameters are in range, change the current position in file to loc
-	crud_file_table[fd].position = loc;
-	return 0; // Success
-}
+	// The root, d, d/e, x and x/y leave room for CRUD_MAX_DIRECTORIES-5 more, and with one left
+	// a create needing two makes neither
+	for (made=0; made<CRUD_MAX_DIRECTORIES; made++) {
+		if (made == CRUD_MAX_DIRECTORIES-6 && (crud_open("p/q/f") != -1 || crud_opendir("p") != -1)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : a create needing two directories left p behind.");
+			return(-1);
+		}
+		sprintf(path, "cap%03d", made);
+		if (crud_mkdir(path)) {
+			break;
+		}
+	}
+	sprintf(path, "cap%03d/f", made);
+	if (made != CRUD_MAX_DIRECTORIES-5 || crud_open(path) != -1 || crudCheckUnitDirectory()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : made %d directories, not %d.", made, CRUD_MAX_DIRECTORIES-5);
+		return(-1);
+	}
 
-// Module local methods
+	if (crud_unmount()) {
+		logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : Failure on unmount operation.");
+		return(-1);
+	}
+
+	return(0);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -779,15 +7531,35 @@ int crudIOUnitTest(void) {
 		CRUD_REQUEST_TYPES req;
 		uint32_t length;
 		uint8_t res, flags;
+		int16_t file = crud_open_table[fh].file;
 
-		// Make a fake request to get file handle, then check it
-		request = construct_crud_request(crud_file_table[0].object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, CRUD_NULL_FLAG, 0);
-		response = crud_client_operation(request, tbuf);
-		if ((deconstruct_crud_request(response, &oid, &req, &length, &flags, &res) != 0) || (res != 0))  {
-			logMessage(LOG_ERROR_LEVEL, "Read failure, bad CRUD response [%x]", response);
+		// The bytes held in memory for write-back are stored first, so the object has them
+		if (crud_fsync(fh)) {
+			logMessage(LOG_ERROR_LEVEL, "CRUD_IO_UNIT_TEST : fsync failed.");
 			return(-1);
 		}
-		if ( (cio_utest_length != length) || (memcmp(cio_utest_buffer, tbuf, length)) ) {
+
+		// A file kept in the tables, packed, compressed or with zero pages left out has
+		// no plain first object, so its first stripe is read back through the file instead
+		if (crud_file_table[file].object_id == CRUD_NO_OBJECT || crud_inline_table[file].inlined ||
+				crud_pack_table[file].container != CRUD_NO_OBJECT || crud_codec_table[file].stored[0] ||
+				crud_extent_table[file].holes[0]) {
+			length = (cio_utest_length < CRUD_STRIPE_SIZE) ? cio_utest_length : CRUD_STRIPE_SIZE;
+			if (crud_pread(fh, tbuf, length, 0) != (int32_t)length) {
+				logMessage(LOG_ERROR_LEVEL, "Read failure, short read of the first stripe");
+				return(-1);
+			}
+		} else {
+			// Make a fake request to get file handle, then check it
+			request = construct_crud_request(crud_file_table[file].object_id, CRUD_READ, CRUD_MAX_OBJECT_SIZE, CRUD_NULL_FLAG, 0);
+			response = crud_client_operation(request, tbuf);
+			if ((deconstruct_crud_request(response, &oid, &req, &length, &flags, &res) != 0) || (res != 0))  {
+				logMessage(LOG_ERROR_LEVEL, "Read failure, bad CRUD response [%x]", response);
+				return(-1);
+			}
+		}
+		// The file's first object holds only its first stripe
+		if ( (((cio_utest_length < CRUD_STRIPE_SIZE) ? cio_utest_length : CRUD_STRIPE_SIZE) != length) || (memcmp(cio_utest_buffer, tbuf, length)) ) {
 			logMessage(LOG_ERROR_LEVEL, "Buffer/Object cross validation failed [%x]", response);
 			bufToString((unsigned char *)tbuf, length, (unsigned char *)lstr, 1024 );
 			logMessage(LOG_INFO_LEVEL, "CIO_UTEST VR: %s", lstr);
@@ -817,6 +7589,46 @@ int crudIOUnitTest(void) {
 		return(-1);
 	}
 
+	// Garbage collection must only ever delete objects no file needs
+	if (crudGcUnitTest()) {
+		return(-1);
+	}
+
+	// Truncated and allocated files read zeros where nothing was written
+	if (crudResizeUnitTest()) {
+		return(-1);
+	}
+
+	// Ranges are copied on the server where it can, and through the client where not
+	if (crudCopyRangeUnitTest()) {
+		return(-1);
+	}
+
+	// Bytes skipped by seeking past the end read as zeros and are never stored
+	if (crudHoleUnitTest()) {
+		return(-1);
+	}
+
+	// Compressed stripes read back as they were written
+	if (crudCodecUnitTest()) {
+		return(-1);
+	}
+
+	// Operations started without waiting finish and call back once each
+	if (crudAsyncUnitTest()) {
+		return(-1);
+	}
+
+	// The directories keep their names in order and survive a remount
+	if (crudDirectoryUnitTest()) {
+		return(-1);
+	}
+
+	// Files under a prefix are listed in order of their paths
+	if (crudPrefixUnitTest()) {
+		return(-1);
+	}
+
 	// Return successfully
 	return(0);
 }